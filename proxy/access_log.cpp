@@ -0,0 +1,81 @@
+#include "access_log.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+Log* sink = nullptr;
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+namespace access_log {
+
+thread_local Scope* Current::scope = nullptr;
+thread_local int Current::client_fd = -1;
+thread_local uint64_t Current::client_bytes = 0;
+
+void open() {
+    std::string path = Config::get_string("PROXY_ACCESS_LOG", "./logs/access.bin");
+    if (!path.empty() && path != "off") {
+        sink = new Log(path, false);
+    }
+}
+
+Scope::Scope(const std::string& id, int client_fd, std::chrono::steady_clock::time_point accepted)
+    : record_(), accepted_(accepted) {
+    Current::client_fd = client_fd;
+    Current::client_bytes = 0;
+    record_.magic = MAGIC;
+    record_.version = VERSION;
+    // The UUID's 32 hex digits, dashes skipped
+    size_t nibble = 0;
+    for (char c : id) {
+        int v = hex_value(c);
+        if (v >= 0 && nibble < 32) {
+            record_.id[nibble / 2] |= static_cast<uint8_t>(nibble % 2 == 0 ? v << 4 : v);
+            ++nibble;
+        }
+    }
+    auto since_accept = std::chrono::steady_clock::now() - accepted;
+    record_.accept_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch() - since_accept).count());
+    Current::scope = sink ? this : nullptr;
+}
+
+Scope::~Scope() {
+    Current::client_fd = -1;
+    if (Current::scope != this) {
+        return;
+    }
+    Current::mark(FINISHED);
+    Current::scope = nullptr;
+    record_.bytes_out = Current::client_bytes;
+
+    char buf[sizeof(Record) + sizeof(host_)];
+    record_.size = static_cast<uint16_t>(sizeof(Record) + record_.host_length);
+    memcpy(buf, &record_, sizeof(Record));
+    memcpy(buf + sizeof(Record), host_, record_.host_length);
+    sink->append(buf, record_.size);
+}
+
+void Current::request(std::string_view method, std::string_view host) {
+    if (!scope) {
+        return;
+    }
+    Record& record = scope->record_;
+    record.method = method == "GET" ? Method::Get : method == "POST" ? Method::Post :
+                    method == "CONNECT" ? Method::Connect : Method::Other;
+    record.host_length = static_cast<uint8_t>(std::min(host.size(), sizeof(scope->host_)));
+    memcpy(scope->host_, host.data(), record.host_length);
+}
+
+} // namespace access_log
@@ -0,0 +1,182 @@
+#ifndef ACCESS_LOG_HPP
+#define ACCESS_LOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Structured binary access log: one fixed-layout record per client request,
+ * with the time each phase of the request completed
+ *
+ * The record being filled lives on the connection thread's stack and is
+ * reached through a thread-local pointer, so the handler marks phases
+ * without passing anything around. Threads with no record (background
+ * fills) turn every call into a no-op. Finished records go through an
+ * asynchronous Log in binary mode to PROXY_ACCESS_LOG; tools/access_decode
+ * turns them back into text or latency percentiles.
+ */
+namespace access_log {
+
+const uint32_t MAGIC = 0x4c415850;  // "PXAL" in little-endian byte order
+const uint16_t VERSION = 2;
+
+enum class Method : uint8_t { Other, Get, Post, Connect };
+
+enum class CacheResult : uint8_t {
+    None,         // Not a cacheable request (POST, CONNECT, errors before lookup)
+    Hit,          // Served from a fresh entry
+    Miss,         // Not in the cache
+    Stale,        // In the cache but expired, fetched again
+    Revalidated,  // Reserved: the proxy does not yet send its own conditional requests
+};
+
+/**
+ * Phases after accept, in the order a proxied request passes them
+ */
+enum Phase {
+    PARSED,             // Request read and parsed
+    DNS,                // Origin name resolved
+    CONNECTED,          // Origin connection established
+    ORIGIN_FIRST_BYTE,  // First response byte from the origin
+    CLIENT_FIRST_BYTE,  // First byte sent to the client
+    FINISHED,           // Handler done with the request
+    PHASE_COUNT,
+};
+
+/**
+ * On-disk record, followed by host_length bytes of host name. Phase times
+ * are nanoseconds after accept; 0 means the phase was not reached.
+ */
+struct Record {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;              // Whole record including the host bytes
+    uint8_t id[16];             // Request UUID
+    uint64_t accept_ns;         // Wall clock, nanoseconds since the epoch
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t bytes_in;          // Received from the client
+    uint64_t bytes_out;         // Sent to the client
+    uint64_t object;            // Low 64 bits of the cache key a GET looked up, else 0
+    uint16_t status;
+    Method method;
+    CacheResult cache;
+    uint8_t host_length;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(Record) == 112, "access log record layout changed; bump VERSION");
+
+/**
+ * Bytes before the host name in a record written as the given version, or
+ * 0 for a version this build cannot read. Version 1 had no object field.
+ */
+inline size_t fixed_size(uint16_t version) {
+    if (version == 1) return sizeof(Record) - sizeof(uint64_t);
+    return version == VERSION ? sizeof(Record) : 0;
+}
+
+/**
+ * Copies the fixed part of a record of a readable version into the current
+ * layout; a version 1 record reads as having no object
+ */
+inline void upgrade(const char* data, uint16_t version, Record& out) {
+    if (version == VERSION) {
+        memcpy(&out, data, sizeof(Record));
+        return;
+    }
+    const size_t head = offsetof(Record, object);
+    memcpy(&out, data, head);
+    out.object = 0;
+    memcpy(reinterpret_cast<char*>(&out) + head + sizeof(out.object), data + head,
+           sizeof(Record) - head - sizeof(out.object));
+}
+
+inline const char* method_name(Method method) {
+    switch (method) {
+        case Method::Get: return "GET";
+        case Method::Post: return "POST";
+        case Method::Connect: return "CONNECT";
+        default: return "OTHER";
+    }
+}
+
+inline const char* cache_name(CacheResult cache) {
+    switch (cache) {
+        case CacheResult::Hit: return "hit";
+        case CacheResult::Miss: return "miss";
+        case CacheResult::Stale: return "stale";
+        case CacheResult::Revalidated: return "revalidated";
+        default: return "-";
+    }
+}
+
+/**
+ * Opens PROXY_ACCESS_LOG ("./logs/access.bin"; "off" disables)
+ */
+void open();
+
+/**
+ * Owns the record for one client connection, and writes it on destruction
+ */
+class Scope {
+public:
+    Scope(const std::string& id, int client_fd, std::chrono::steady_clock::time_point accepted);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    friend struct Current;
+
+    Record record_;
+    char host_[255];
+    std::chrono::steady_clock::time_point accepted_;
+};
+
+/**
+ * Fast-path accessors for the calling thread's record
+ */
+struct Current {
+    static thread_local Scope* scope;
+    // Client socket and bytes sent to it, kept even with the log off, since
+    // per-client byte rate limits are charged from them
+    static thread_local int client_fd;
+    static thread_local uint64_t client_bytes;
+
+    static void mark(Phase phase) {
+        if (scope && scope->record_.phase_ns[phase] == 0) {
+            scope->record_.phase_ns[phase] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - scope->accepted_).count());
+        }
+    }
+    static void request(std::string_view method, std::string_view host);
+    static void status(int code) {
+        if (scope) scope->record_.status = static_cast<uint16_t>(code);
+    }
+    static void cache(CacheResult result) {
+        if (scope) scope->record_.cache = result;
+    }
+    static void object(uint64_t key) {
+        if (scope) scope->record_.object = key;
+    }
+    static CacheResult cache() { return scope ? scope->record_.cache : CacheResult::None; }
+    static uint64_t bytes_out() { return client_bytes; }
+    static void received(size_t bytes) {
+        if (scope) scope->record_.bytes_in += bytes;
+    }
+    // Counts bytes written to fd when it is the client's
+    static void sent(int fd, size_t bytes) {
+        if (fd == client_fd && fd >= 0 && bytes > 0) {
+            mark(CLIENT_FIRST_BYTE);
+            client_bytes += bytes;
+        }
+    }
+};
+
+} // namespace access_log
+
+#endif // ACCESS_LOG_HPP
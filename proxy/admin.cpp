@@ -0,0 +1,251 @@
+#include "admin.hpp"
+#include "admission.hpp"
+#include "blob_store.hpp"
+#include "cache.hpp"
+#include "compression.hpp"
+#include "config.hpp"
+#include "lingering.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "rate_limit.hpp"
+#include "slab_allocator.hpp"
+#include "socket.hpp"
+#include "upstream.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sys/socket.h>
+#include <thread>
+
+extern Cache* proxy_cache;
+extern AdmissionControl* proxy_admission;
+extern RateLimiter* proxy_client_limiter;
+extern RateLimiter* proxy_origin_limiter;
+extern UpstreamScheduler* proxy_upstream;
+
+namespace {
+
+using metrics::Callback;
+
+/**
+ * One sample per media type from the compression statistics
+ */
+class CompressionBytes : public metrics::Metric {
+public:
+    CompressionBytes(const char* name, const char* help, bool stored)
+        : Metric(name, help, "counter"), stored_(stored) {}
+
+    void render(std::string& out) const override {
+        for (const compression::TypeStats& stats : compression::type_stats()) {
+            out += std::string(name_) + "{type=\"" + stats.content_type + "\"} " +
+                   std::to_string(stored_ ? stats.stored_bytes : stats.original_bytes) + "\n";
+        }
+    }
+
+private:
+    bool stored_;
+};
+
+void register_collectors() {
+    static Callback cache_entries("proxy_cache_entries", "Entries in the cache", "gauge",
+                                  [] { return double(proxy_cache ? proxy_cache->size() : 0); });
+    static Callback cache_bytes("proxy_cache_bytes", "Cache memory in use: entries plus distinct bodies", "gauge",
+                                [] { return double(proxy_cache ? proxy_cache->bytes() : 0); });
+    static Callback cache_index_bytes("proxy_cache_index_bytes", "Memory of the cache's hash table", "gauge",
+                                      [] { return double(proxy_cache ? proxy_cache->indexBytes() : 0); });
+
+    static Callback slab_mapped("proxy_slab_mapped_bytes", "Slab memory mapped for chunks", "gauge",
+                                [] { return double(SlabAllocator::global().stats().mapped_bytes); });
+    static Callback slab_chunks("proxy_slab_chunk_bytes", "Capacity of chunks handed out", "gauge",
+                                [] { return double(SlabAllocator::global().stats().chunk_bytes); });
+    static Callback slab_requested("proxy_slab_requested_bytes", "Bytes requested from the slab allocator", "gauge",
+                                   [] { return double(SlabAllocator::global().stats().requested_bytes); });
+    static Callback slab_spare("proxy_slab_spare_slabs", "Empty slabs kept for reuse", "gauge",
+                               [] { return double(SlabAllocator::global().stats().spare_slabs); });
+
+    static Callback blobs("proxy_blob_bodies", "Distinct bodies in the blob store", "gauge",
+                          [] { return double(BlobStore::global().stats().blobs); });
+    static Callback blob_logical("proxy_blob_logical_bytes", "Body bytes referenced by cache entries", "gauge",
+                                 [] { return double(BlobStore::global().stats().logical_bytes); });
+    static Callback blob_physical("proxy_blob_physical_bytes", "Body bytes stored once each", "gauge",
+                                  [] { return double(BlobStore::global().stats().physical_bytes); });
+    static Callback blob_dedup("proxy_blob_dedup_hits_total", "Bodies found already stored", "counter",
+                               [] { return double(BlobStore::global().stats().dedup_hits); });
+
+    static CompressionBytes original("proxy_compression_original_bytes_total",
+                                     "Body bytes before compression, by media type", false);
+    static CompressionBytes stored("proxy_compression_stored_bytes_total",
+                                   "Body bytes after compression, by media type", true);
+
+    static Callback admission_in_flight("proxy_admission_in_flight", "Requests holding a processing slot", "gauge",
+                                        [] { return double(proxy_admission ? proxy_admission->inFlight() : 0); });
+    static Callback admission_queued("proxy_admission_queued", "Requests waiting for a processing slot", "gauge",
+                                     [] { return double(proxy_admission ? proxy_admission->queued() : 0); });
+
+    static Callback upstream_in_flight("proxy_upstream_in_flight", "Origin requests holding an upstream slot", "gauge",
+                                       [] { return double(proxy_upstream ? proxy_upstream->inFlight() : 0); });
+    static Callback upstream_queued("proxy_upstream_queued", "Origin requests waiting for an upstream slot", "gauge",
+                                    [] { return double(proxy_upstream ? proxy_upstream->queued() : 0); });
+    static Callback upstream_open("proxy_upstream_open_circuits", "Origins whose circuit breaker is open or probing",
+                                  "gauge", [] { return double(proxy_upstream ? proxy_upstream->openCircuits() : 0); });
+
+    static Callback lingering_sockets("proxy_lingering_connections", "Closed client connections still being drained",
+                                      "gauge", [] { return double(lingering::pending()); });
+
+    static Callback log_dropped("proxy_log_dropped_lines_total", "Log lines lost to full ring buffers", "counter",
+                                [] { return double(proxy_logger ? proxy_logger->dropped() : 0); });
+}
+
+bool send_fully(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string describe_limits(const RateLimiter* limiter) {
+    if (limiter == nullptr) {
+        return "";
+    }
+    RateLimiter::Limits limits = limiter->limits();
+    std::string kind = limiter->kind();
+    return kind + "_rps " + std::to_string(limits.requests_per_sec) + "\n" +
+           kind + "_burst " + std::to_string(limits.burst) + "\n" +
+           kind + "_max_connections " + std::to_string(limits.max_connections) + "\n" +
+           kind + "_bytes_per_sec " + std::to_string(limits.bytes_per_sec) + "\n";
+}
+
+/**
+ * Applies "client_rps=10&origin_max_connections=4"-style settings
+ *
+ * @return False, changing nothing, if any name or value is not understood
+ */
+bool apply_limits(std::string_view query) {
+    RateLimiter* limiters[] = {proxy_client_limiter, proxy_origin_limiter};
+    RateLimiter::Limits updated[2];
+    for (int i = 0; i < 2; ++i) {
+        if (limiters[i] == nullptr) return false;
+        updated[i] = limiters[i]->limits();
+    }
+    while (!query.empty()) {
+        size_t end = std::min(query.find('&'), query.size());
+        std::string_view pair = query.substr(0, end);
+        query.remove_prefix(std::min(end + 1, query.size()));
+        size_t eq = pair.find('=');
+        if (eq == std::string_view::npos) return false;
+        std::string name(pair.substr(0, eq));
+        std::string text(pair.substr(eq + 1));
+        char* parsed_end = nullptr;
+        double value = std::strtod(text.c_str(), &parsed_end);
+        if (text.empty() || *parsed_end != '\0' || !std::isfinite(value) || value < 0) return false;
+
+        int which = name.compare(0, 7, "client_") == 0 ? 0 : name.compare(0, 7, "origin_") == 0 ? 1 : -1;
+        if (which < 0) return false;
+        std::string field = name.substr(7);
+        if (field == "rps") {
+            updated[which].requests_per_sec = value;
+        } else if (field == "burst") {
+            updated[which].burst = value;
+        } else if (field == "max_connections") {
+            if (value >= static_cast<double>(std::numeric_limits<long>::max())) return false;
+            updated[which].max_connections = static_cast<long>(value);
+        } else if (field == "bytes_per_sec") {
+            updated[which].bytes_per_sec = value;
+        } else {
+            return false;
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        limiters[i]->setLimits(updated[i]);
+    }
+    return true;
+}
+
+bool is_loopback(const std::string& address) {
+    return address.compare(0, 4, "127.") == 0 || address == "::1";
+}
+
+void serve(std::shared_ptr<TcpSocket> listener, bool allow_changes) {
+    while (true) {
+        std::shared_ptr<ISocket> client = listener->accept();
+        if (!client) {
+            continue;
+        }
+        // A stalled scraper must not hold up the next one for long
+        timeval timeout = {2, 0};
+        setsockopt(client->getSocketFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::vector<uint8_t> request;
+        if (client->receive(request, 4096) <= 0) {
+            continue;
+        }
+        std::string_view line(reinterpret_cast<const char*>(request.data()), request.size());
+        std::string response;
+        if (line.compare(0, 12, "GET /metrics") == 0) {
+            std::string body = metrics::Registry::global().render();
+            response = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+        } else if (line.compare(0, 14, "GET /ratelimit") == 0 || line.compare(0, 15, "POST /ratelimit") == 0) {
+            bool ok = true;
+            std::string status = "HTTP/1.1 200 OK";
+            std::string body;
+            if (line[0] == 'P' && !(allow_changes && is_loopback(client->getRemoteAddress()))) {
+                // Limits are changed from the proxy host only, and only when enabled
+                status = "HTTP/1.1 403 Forbidden";
+                body = "runtime changes are disabled; set PROXY_ADMIN_ALLOW_CHANGES=1 and use a local client\n";
+                LOG_WARNING("(admin)", "refused rate limit change from " + client->getRemoteAddress());
+                ok = false;
+            } else if (line[0] == 'P') {
+                std::string_view target = line.substr(5, line.find(' ', 5) - 5);
+                size_t query = target.find('?');
+                ok = query != std::string_view::npos && apply_limits(target.substr(query + 1));
+                if (ok) {
+                    LOG_NOTE("(admin)", "rate limits changed: " + std::string(target.substr(query + 1)));
+                } else {
+                    status = "HTTP/1.1 400 Bad Request";
+                    body = "unknown setting or bad value\n";
+                }
+            }
+            if (ok) {
+                body = describe_limits(proxy_client_limiter) + describe_limits(proxy_origin_limiter);
+            }
+            response = status + "\r\n"
+                       "Content-Type: text/plain\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        send_fully(client->getSocketFd(), response);
+        client->shutdownWrite();
+    }
+}
+
+} // namespace
+
+namespace admin {
+
+void start() {
+    long port = Config::get_long("PROXY_ADMIN_PORT", 12346);
+    if (port <= 0) {
+        return;
+    }
+    register_collectors();
+    auto listener = std::make_shared<TcpSocket>();
+    if (!listener->bind(static_cast<int>(port)) || !listener->listen(16)) {
+        LOG_ERROR("(no-id)", "Failed to open admin port " + std::to_string(port));
+        return;
+    }
+    LOG_NOTE("(no-id)", "Serving metrics on port " + std::to_string(port));
+    std::thread(serve, listener, Config::get_long("PROXY_ADMIN_ALLOW_CHANGES", 0) != 0).detach();
+}
+
+} // namespace admin
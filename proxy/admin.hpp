@@ -0,0 +1,25 @@
+#ifndef ADMIN_HPP
+#define ADMIN_HPP
+
+/**
+ * Admin endpoint, kept off the proxy port
+ *
+ * Serves GET /metrics in Prometheus text format on PROXY_ADMIN_PORT
+ * (default 12346, 0 disables) from its own thread. Besides the request-path
+ * instruments in metrics.hpp, it publishes the cache, slab allocator, blob
+ * store, compression and logger statistics, read at scrape time.
+ *
+ * GET /ratelimit lists the per-client and per-origin rate limits, and
+ * POST /ratelimit?client_rps=10&origin_max_connections=4 changes them
+ * while the proxy runs (names as listed; 0 is unlimited).
+ */
+namespace admin {
+
+/**
+ * Binds the admin port and starts serving; logs and returns if it can't bind
+ */
+void start();
+
+} // namespace admin
+
+#endif // ADMIN_HPP
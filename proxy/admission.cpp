@@ -0,0 +1,118 @@
+#include "admission.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+
+AdmissionControl::AdmissionControl(size_t max_concurrency, size_t max_queue, Clock::duration target,
+                                   Clock::duration interval)
+    : max_concurrency_(max_concurrency), max_queue_(max_queue), hit_headroom_(std::max<size_t>(1, max_concurrency / 4)),
+      target_(target), interval_(interval), last_empty_(Clock::now()),
+      max_connections_(max_concurrency + max_queue + 2 * hit_headroom_) {}
+
+bool AdmissionControl::enter() {
+    if (!enabled()) {
+        return true;
+    }
+    if (connections_.fetch_add(1, std::memory_order_relaxed) >= max_connections_) {
+        connections_.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::leave() {
+    if (enabled()) {
+        connections_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+AdmissionControl::Result AdmissionControl::acquire(Priority priority) {
+    if (!enabled()) {
+        return Result::Admitted;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    std::deque<Waiter*>& hits = queues_[static_cast<int>(Priority::Hit)];
+    std::deque<Waiter*>& misses = queues_[static_cast<int>(Priority::Miss)];
+    bool free = priority == Priority::Hit ? in_flight_ < max_concurrency_ + hit_headroom_ && hits.empty()
+                                          : in_flight_ < max_concurrency_ && hits.empty() && misses.empty();
+    if (free) {
+        ++in_flight_;
+        if (hits.empty() && misses.empty()) {
+            last_empty_ = now;
+        }
+        metrics::admission_wait.record(0);
+        return Result::Admitted;
+    }
+    if (hits.size() + misses.size() >= max_queue_) {
+        if (priority == Priority::Miss || misses.empty()) {
+            return Result::QueueFull;
+        }
+        Waiter* pushed_out = misses.back();
+        misses.pop_back();
+        pushed_out->shed = true;
+        pushed_out->cv.notify_one();
+    }
+
+    bool standing = now - last_empty_ > interval_;
+    Clock::time_point deadline = now + (standing && priority == Priority::Miss ? target_ : interval_);
+    Waiter waiter;
+    queues_[static_cast<int>(priority)].push_back(&waiter);
+    waiter.cv.wait_until(lock, deadline, [&] { return waiter.granted || waiter.shed; });
+    if (waiter.shed) {
+        return Result::QueueFull;
+    }
+    if (!waiter.granted) {
+        forget(&waiter, priority, Clock::now());
+        return Result::TimedOut;
+    }
+    metrics::admission_wait.record(Clock::now() - now);
+    return Result::Admitted;
+}
+
+void AdmissionControl::release() {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    --in_flight_;
+    grant(Clock::now());
+}
+
+void AdmissionControl::grant(Clock::time_point now) {
+    std::deque<Waiter*>& hits = queues_[static_cast<int>(Priority::Hit)];
+    std::deque<Waiter*>& misses = queues_[static_cast<int>(Priority::Miss)];
+    std::deque<Waiter*>* queue = nullptr;
+    if (!hits.empty()) {
+        queue = &hits;
+    } else if (!misses.empty() && in_flight_ < max_concurrency_) {
+        queue = &misses;
+    }
+    if (queue) {
+        Waiter* next = queue->front();
+        queue->pop_front();
+        next->granted = true;
+        next->cv.notify_one();
+        ++in_flight_;
+    }
+    if (hits.empty() && misses.empty()) {
+        last_empty_ = now;
+    }
+}
+
+void AdmissionControl::forget(Waiter* waiter, Priority priority, Clock::time_point now) {
+    std::deque<Waiter*>& queue = queues_[static_cast<int>(priority)];
+    queue.erase(std::find(queue.begin(), queue.end(), waiter));
+    if (queues_[0].empty() && queues_[1].empty()) {
+        last_empty_ = now;
+    }
+}
+
+size_t AdmissionControl::inFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+size_t AdmissionControl::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queues_[0].size() + queues_[1].size();
+}
@@ -0,0 +1,139 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Admission control for parsed requests
+ *
+ * At most max_concurrency requests are processed at once; the rest wait in
+ * a bounded queue. Waiting is bounded CoDel style: while the queue keeps
+ * emptying, a request may wait up to interval, but once it has stood
+ * non-empty for longer than interval, misses only wait target before they
+ * are shed. A standing queue then drains quickly into fast 503s instead of
+ * every request slowing down.
+ *
+ * Overload costs misses first. Hits are cheap, so they may use a quarter
+ * more slots than misses, are handed freed slots first, always get the
+ * longer wait, and push the newest waiting miss out of a full queue.
+ *
+ * Whether a request is a hit is only known once it has been read, on its
+ * own thread. So connections are also counted from accept: once as many
+ * are open as could be processed or queued, with a little room for hits,
+ * the accept loop sheds the next one without starting a thread for it.
+ */
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Priority { Hit = 0, Miss = 1 };
+    enum class Result { Admitted, QueueFull, TimedOut };
+
+    /**
+     * @param max_concurrency Requests processed at once (0 disables the limit)
+     * @param max_queue Requests allowed to wait for a slot
+     * @param target Wait allowed to misses while the queue is standing
+     * @param interval Wait allowed otherwise, and how long the queue may stand
+     */
+    AdmissionControl(size_t max_concurrency, size_t max_queue, Clock::duration target, Clock::duration interval);
+
+    /**
+     * Waits for a processing slot
+     *
+     * @return Admitted, after which release() must be called once
+     */
+    Result acquire(Priority priority);
+
+    /**
+     * Frees a slot, handing it straight to the next waiter if there is one
+     */
+    void release();
+
+    /**
+     * Claims a connection before its thread is started
+     *
+     * @return False when the connection should be shed instead
+     */
+    bool enter();
+    void leave();
+
+    size_t inFlight() const;
+    size_t queued() const;
+    bool enabled() const { return max_concurrency_ > 0; }
+
+private:
+    struct Waiter {
+        std::condition_variable cv;
+        bool granted = false;
+        bool shed = false;
+    };
+
+    /**
+     * Hands a free slot to the next waiter that may take it; caller holds the lock
+     */
+    void grant(Clock::time_point now);
+
+    /**
+     * Removes a waiter that gave up; caller holds the lock
+     */
+    void forget(Waiter* waiter, Priority priority, Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    size_t max_concurrency_;
+    size_t max_queue_;
+    size_t hit_headroom_;
+    Clock::duration target_;
+    Clock::duration interval_;
+    size_t in_flight_ = 0;
+    std::deque<Waiter*> queues_[2];  // Indexed by Priority
+    Clock::time_point last_empty_;
+    size_t max_connections_;
+    std::atomic<size_t> connections_{0};
+};
+
+/**
+ * Holds an admitted slot for the lifetime of a scope
+ */
+class AdmissionTicket {
+public:
+    AdmissionTicket() = default;
+    explicit AdmissionTicket(AdmissionControl* control) : control_(control) {}
+    ~AdmissionTicket() {
+        if (control_) control_->release();
+    }
+
+    AdmissionTicket(const AdmissionTicket&) = delete;
+    AdmissionTicket& operator=(const AdmissionTicket&) = delete;
+
+private:
+    AdmissionControl* control_ = nullptr;
+};
+
+/**
+ * Holds a connection claimed with AdmissionControl::enter() until leave() or
+ * the end of the scope
+ */
+class ConnectionClaim {
+public:
+    ConnectionClaim() = default;
+    explicit ConnectionClaim(AdmissionControl* control) : control_(control) {}
+    ~ConnectionClaim() { leave(); }
+
+    ConnectionClaim(const ConnectionClaim&) = delete;
+    ConnectionClaim& operator=(const ConnectionClaim&) = delete;
+
+    void leave() {
+        if (control_) control_->leave();
+        control_ = nullptr;
+    }
+
+private:
+    AdmissionControl* control_ = nullptr;
+};
+
+#endif // ADMISSION_HPP
@@ -0,0 +1,297 @@
+/**
+ * Load generator for the proxy: GETs objects from the bench origin through
+ * the proxy and reports throughput, latency percentiles, the cache hit
+ * ratio and proxy CPU time per request.
+ *
+ *   -x host:port   proxy (127.0.0.1:12345)
+ *   -o host:port   origin named in the request URLs (127.0.0.1:8090)
+ *   -t threads     concurrent clients (8)
+ *   -d seconds     test length (10)
+ *   -r rate        open loop at this many requests/s in total; 0 runs
+ *                  closed loop, each client sending as soon as its last
+ *                  request finished (0)
+ *   -n objects     distinct URLs (1000)
+ *   -z s           Zipf exponent of URL popularity; 0 is uniform (0.9)
+ *   -a port        proxy admin port scraped for hit counts; 0 skips (12346)
+ *   -P pid         proxy process charged for CPU; 0 skips (0)
+ *
+ * Open-loop latency runs from when a request was due, not when it was
+ * sent, so a stalled proxy shows up in the percentiles instead of quietly
+ * lowering the offered load. Build with `make bench`.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    std::string proxy_host = "127.0.0.1";
+    int proxy_port = 12345;
+    std::string origin = "127.0.0.1:8090";
+    int threads = 8;
+    double seconds = 10;
+    double rate = 0;
+    size_t objects = 1000;
+    double zipf = 0.9;
+    int admin_port = 12346;
+    int pid = 0;
+};
+
+struct Totals {
+    std::vector<uint64_t> latencies_ns;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+Settings settings;
+
+bool split_host_port(const char* text, std::string& host, int& port) {
+    const char* colon = strrchr(text, ':');
+    if (!colon) return false;
+    host.assign(text, colon - text);
+    port = std::atoi(colon + 1);
+    return port > 0;
+}
+
+int connect_to(const std::string& host, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return fd;
+}
+
+/**
+ * One request on its own connection, read until the proxy closes it
+ *
+ * @return The status code, or 0 when the exchange failed
+ */
+int fetch(const std::string& request, uint64_t& bytes) {
+    int fd = connect_to(settings.proxy_host, settings.proxy_port);
+    if (fd < 0) return 0;
+    timeval timeout{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        close(fd);
+        return 0;
+    }
+    char buf[65536];
+    char status_line[16] = {};
+    size_t head = 0;
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        if (head < sizeof(status_line) - 1) {
+            size_t take = std::min(static_cast<size_t>(n), sizeof(status_line) - 1 - head);
+            memcpy(status_line + head, buf, take);
+            head += take;
+        }
+        bytes += static_cast<uint64_t>(n);
+    }
+    close(fd);
+    if (n < 0 || strncmp(status_line, "HTTP/1.", 7) != 0) return 0;
+    return std::atoi(status_line + 9);
+}
+
+// Cumulative Zipf weights over object ranks
+std::vector<double> zipf_cdf(size_t n, double s) {
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+        cdf[i] = sum;
+    }
+    for (double& c : cdf) c /= sum;
+    return cdf;
+}
+
+void client(int index, const std::vector<double>& cdf, Clock::time_point start, Clock::time_point stop,
+            Totals& totals) {
+    std::mt19937_64 rng(0x5eed + index);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    // Each client offers an equal share of the rate, staggered so they don't send in lockstep
+    double interval_ns = settings.rate > 0 ? 1e9 * settings.threads / settings.rate : 0;
+    Clock::time_point due = start + std::chrono::nanoseconds(static_cast<int64_t>(interval_ns * index / settings.threads));
+    std::string request;
+
+    while (true) {
+        if (interval_ns > 0) {
+            if (due >= stop) break;
+            std::this_thread::sleep_until(due);
+        }
+        Clock::time_point sent = Clock::now();
+        if (sent >= stop) break;
+
+        size_t object = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        object = std::min(object, cdf.size() - 1);
+        request = "GET http://" + settings.origin + "/obj/" + std::to_string(object) + " HTTP/1.1\r\nHost: " +
+                  settings.origin + "\r\nConnection: close\r\n\r\n";
+        int status = fetch(request, totals.bytes);
+        Clock::time_point done = Clock::now();
+        Clock::time_point from = interval_ns > 0 ? due : sent;
+        totals.latencies_ns.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(done - from).count()));
+        if (status < 200 || status >= 400) ++totals.errors;
+        due += std::chrono::nanoseconds(static_cast<int64_t>(interval_ns));
+    }
+}
+
+// Sums the proxy's proxy_cache_lookups_total samples; false when the admin port is off
+bool cache_lookups(uint64_t& hits, uint64_t& lookups) {
+    if (settings.admin_port <= 0) return false;
+    int fd = connect_to(settings.proxy_host, settings.admin_port);
+    if (fd < 0) return false;
+    const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL);
+    std::string text;
+    char buf[65536];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) text.append(buf, static_cast<size_t>(n));
+    close(fd);
+
+    hits = lookups = 0;
+    const std::string name = "proxy_cache_lookups_total{result=\"";
+    bool found = false;
+    for (size_t pos = text.find(name); pos != std::string::npos; pos = text.find(name, pos + 1)) {
+        if (pos > 0 && text[pos - 1] != '\n') continue;
+        size_t value = text.find("} ", pos);
+        if (value == std::string::npos) break;
+        uint64_t count = std::strtoull(text.c_str() + value + 2, nullptr, 10);
+        lookups += count;
+        if (text.compare(pos + name.size(), 4, "hit\"") == 0) hits += count;
+        found = true;
+    }
+    return found;
+}
+
+// utime + stime of a process, in seconds; negative when unavailable
+double process_cpu_seconds(int pid) {
+    if (pid <= 0) return -1;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* file = fopen(path, "r");
+    if (!file) return -1;
+    char line[1024];
+    size_t len = fread(line, 1, sizeof(line) - 1, file);
+    fclose(file);
+    line[len] = '\0';
+    // Fields after the parenthesised command name; utime and stime are the 12th and 13th
+    const char* p = strrchr(line, ')');
+    if (!p) return -1;
+    unsigned long utime = 0, stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) return -1;
+    return static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+}
+
+double percentile_ms(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1e6;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-x proxy] [-o origin] [-t threads] [-d seconds] [-r rate] [-n objects] [-z zipf]"
+            " [-a admin_port] [-P pid]\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "x:o:t:d:r:n:z:a:P:")) != -1) {
+        switch (opt) {
+            case 'x':
+                if (!split_host_port(optarg, settings.proxy_host, settings.proxy_port)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'o': settings.origin = optarg; break;
+            case 't': settings.threads = std::max(1, std::atoi(optarg)); break;
+            case 'd': settings.seconds = std::atof(optarg); break;
+            case 'r': settings.rate = std::atof(optarg); break;
+            case 'n': settings.objects = std::max(1L, std::atol(optarg)); break;
+            case 'z': settings.zipf = std::atof(optarg); break;
+            case 'a': settings.admin_port = std::atoi(optarg); break;
+            case 'P': settings.pid = std::atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<double> cdf = zipf_cdf(settings.objects, settings.zipf);
+    std::vector<Totals> totals(settings.threads);
+    uint64_t hits_before = 0, lookups_before = 0;
+    bool have_hits = cache_lookups(hits_before, lookups_before);
+    double cpu_before = process_cpu_seconds(settings.pid);
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point stop = start + std::chrono::nanoseconds(static_cast<int64_t>(settings.seconds * 1e9));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < settings.threads; ++i) {
+        threads.emplace_back(client, i, std::cref(cdf), start, stop, std::ref(totals[i]));
+    }
+    for (std::thread& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0, bytes = 0;
+    for (Totals& t : totals) {
+        latencies.insert(latencies.end(), t.latencies_ns.begin(), t.latencies_ns.end());
+        errors += t.errors;
+        bytes += t.bytes;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t requests = latencies.size();
+
+    printf("mode          %s, %d clients, %zu objects, zipf %.2f\n",
+           settings.rate > 0 ? "open loop" : "closed loop", settings.threads, settings.objects, settings.zipf);
+    printf("requests      %zu in %.2f s, %llu errors\n", requests, elapsed, static_cast<unsigned long long>(errors));
+    printf("throughput    %.1f req/s, %.2f MB/s\n", requests / elapsed, bytes / elapsed / 1e6);
+    printf("latency ms    p50 %.3f  p99 %.3f  p999 %.3f  max %.3f\n", percentile_ms(latencies, 0.5),
+           percentile_ms(latencies, 0.99), percentile_ms(latencies, 0.999),
+           latencies.empty() ? 0.0 : latencies.back() / 1e6);
+
+    uint64_t hits_after = 0, lookups_after = 0;
+    if (have_hits && cache_lookups(hits_after, lookups_after) && lookups_after > lookups_before) {
+        printf("hit ratio     %.3f (%llu of %llu lookups)\n",
+               static_cast<double>(hits_after - hits_before) / (lookups_after - lookups_before),
+               static_cast<unsigned long long>(hits_after - hits_before),
+               static_cast<unsigned long long>(lookups_after - lookups_before));
+    } else {
+        printf("hit ratio     n/a (admin port not reachable)\n");
+    }
+    double cpu_after = process_cpu_seconds(settings.pid);
+    if (cpu_before >= 0 && cpu_after >= 0 && requests > 0) {
+        printf("proxy cpu     %.1f us/request (%.2f s total)\n", (cpu_after - cpu_before) * 1e6 / requests,
+               cpu_after - cpu_before);
+    } else {
+        printf("proxy cpu     n/a (no -P pid)\n");
+    }
+    return errors == 0 ? 0 : 1;
+}
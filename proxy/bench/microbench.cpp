@@ -0,0 +1,409 @@
+/**
+ * Microbenchmarks for the request path: request and response parsing,
+ * HTTP-date parsing, cache lookups, stores and evictions, and
+ * Handler::sendAll.
+ *
+ *   microbench [--json] [--filter=text] [--min-time=seconds]
+ *
+ * Cache workloads draw keys from a Zipf distribution over bodies of mixed
+ * sizes and run at 1 to 64 threads. real_time is wall-clock nanoseconds per
+ * operation as seen by one thread; cpu_time is process CPU nanoseconds per
+ * operation. --json writes the Google Benchmark JSON layout, so two runs
+ * can be compared with its tools/compare.py.
+ *
+ * Build and run with `make microbench` (MICROBENCH_ARGS passes options).
+ */
+#include "../cache.hpp"
+#include "../handler.hpp"
+#include "../http_date.hpp"
+#include "../request.hpp"
+#include "../response.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Defined by main.cpp in the proxy; Handler refers to it
+boost::asio::thread_pool* global_thread_pool = nullptr;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    int threads;
+    uint64_t iterations;
+    double real_ns;
+    double cpu_ns;
+    double items_per_second;
+};
+
+double process_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Calls a body repeatedly on each of N threads for min_time seconds
+ */
+class Runner {
+public:
+    Runner(std::string filter, double min_time) : filter_(std::move(filter)), min_time_(min_time) {}
+
+    /**
+     * @param body size_t(int thread, uint64_t iteration), one operation per call
+     */
+    template <typename Body>
+    void run(const std::string& name, int threads, Body body) {
+        std::string full = threads > 1 ? name + "/threads:" + std::to_string(threads) : name;
+        if (!filter_.empty() && full.find(filter_) == std::string::npos) {
+            return;
+        }
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false}, stop{false};
+        std::vector<uint64_t> counts(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                size_t sink = 0;
+                uint64_t n = 0;
+                ready.fetch_add(1);
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (int i = 0; i < 64; ++i) sink += body(t, n++);
+                }
+                asm volatile("" : : "r"(sink) : "memory");
+                counts[t] = n;
+            });
+        }
+        while (ready.load() < threads) std::this_thread::yield();
+        double cpu_start = process_cpu_ns();
+        Clock::time_point start = Clock::now();
+        go.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(std::chrono::duration<double>(min_time_));
+        stop.store(true);
+        for (std::thread& worker : workers) worker.join();
+        double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        double cpu = process_cpu_ns() - cpu_start;
+
+        uint64_t total = 0;
+        for (uint64_t c : counts) total += c;
+        Result result{full, threads, total, elapsed * threads / total, cpu / total, total / (elapsed / 1e9)};
+        fprintf(stderr, "%-48s %14llu %12.1f %12.1f %14.0f\n", full.c_str(),
+                static_cast<unsigned long long>(total), result.real_ns, result.cpu_ns, result.items_per_second);
+        results_.push_back(result);
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+private:
+    std::string filter_;
+    double min_time_;
+    std::vector<Result> results_;
+};
+
+void print_json(const std::vector<Result>& results, const char* executable) {
+    char date[32];
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", &tm);
+    printf("{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\",\n"
+           "    \"num_cpus\": %u,\n    \"library_build_type\": \"release\"\n  },\n  \"benchmarks\": [\n",
+           date, executable, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        printf("    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n"
+               "      \"threads\": %d,\n      \"iterations\": %llu,\n      \"real_time\": %.3f,\n"
+               "      \"cpu_time\": %.3f,\n      \"time_unit\": \"ns\",\n      \"items_per_second\": %.1f\n    }%s\n",
+               r.name.c_str(), r.name.c_str(), r.threads, static_cast<unsigned long long>(r.iterations), r.real_ns,
+               r.cpu_ns, r.items_per_second, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+// ---- Parsing corpora ----
+
+struct Corpus {
+    const char* name;
+    std::string text;
+};
+
+std::vector<Corpus> request_corpora() {
+    return {
+        {"minimal", "GET http://example.com/ HTTP/1.1\r\nHost: example.com\r\n\r\n"},
+        {"browser",
+         "GET http://www.example.com/assets/app.3f9a1c.js?v=12 HTTP/1.1\r\n"
+         "Host: www.example.com\r\n"
+         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:124.0) Gecko/20100101 Firefox/124.0\r\n"
+         "Accept: */*\r\n"
+         "Accept-Language: en-US,en;q=0.5\r\n"
+         "Accept-Encoding: gzip, deflate, br\r\n"
+         "Referer: http://www.example.com/\r\n"
+         "Cookie: session=8f2a9c1e7b; theme=dark; _ga=GA1.2.1234567890.1700000000\r\n"
+         "Connection: keep-alive\r\n"
+         "If-None-Match: \"5f1c6a2b-2c1a9\"\r\n"
+         "If-Modified-Since: Tue, 28 Jul 2020 10:00:00 GMT\r\n"
+         "\r\n"},
+        {"connect", "CONNECT www.example.com:443 HTTP/1.1\r\nHost: www.example.com:443\r\n"
+                    "User-Agent: curl/8.5.0\r\nProxy-Connection: Keep-Alive\r\n\r\n"},
+        {"post-json",
+         "POST http://api.example.com/v1/items HTTP/1.1\r\n"
+         "Host: api.example.com\r\n"
+         "Content-Type: application/json\r\n"
+         "Content-Length: 47\r\n"
+         "Accept: application/json\r\n"
+         "\r\n"
+         "{\"name\": \"John Doe\", \"age\": 30, \"tags\": [1,2]}"},
+    };
+}
+
+std::vector<Corpus> response_corpora() {
+    return {
+        {"small-api",
+         "HTTP/1.1 200 OK\r\n"
+         "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+         "Content-Type: application/json\r\n"
+         "Content-Length: 348\r\n"
+         "Connection: close\r\n"
+         "\r\n"},
+        {"cdn-asset",
+         "HTTP/1.1 200 OK\r\n"
+         "Accept-Ranges: bytes\r\n"
+         "Age: 84211\r\n"
+         "Cache-Control: public, max-age=31536000, immutable\r\n"
+         "Content-Type: application/javascript; charset=utf-8\r\n"
+         "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+         "ETag: \"5f1c6a2b-2c1a9\"\r\n"
+         "Expires: Thu, 01 Mar 2026 12:34:56 GMT\r\n"
+         "Last-Modified: Tue, 28 Jul 2020 10:00:00 GMT\r\n"
+         "Server: ECAcc (nyb/1D2E)\r\n"
+         "Vary: Accept-Encoding\r\n"
+         "X-Cache: HIT\r\n"
+         "Content-Length: 180649\r\n"
+         "\r\n"},
+        {"html-cookies",
+         "HTTP/1.1 200 OK\r\n"
+         "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+         "Content-Type: text/html; charset=UTF-8\r\n"
+         "Transfer-Encoding: chunked\r\n"
+         "Cache-Control: private, no-cache, must-revalidate\r\n"
+         "Set-Cookie: session=8f2a9c1e7b; Path=/; HttpOnly; Secure; SameSite=Lax\r\n"
+         "Set-Cookie: csrf=0b7c4e1d2f; Path=/; Secure\r\n"
+         "Strict-Transport-Security: max-age=63072000; includeSubDomains; preload\r\n"
+         "Content-Security-Policy: default-src 'self'; img-src * data:; script-src 'self' 'unsafe-inline'\r\n"
+         "X-Frame-Options: SAMEORIGIN\r\n"
+         "X-Content-Type-Options: nosniff\r\n"
+         "Last-Modified: Tue, 28 Feb 2025 10:00:00 GMT\r\n"
+         "\r\n"},
+    };
+}
+
+// ---- Cache workloads ----
+
+const size_t KEY_SPACE = 8192;     // Distinct URLs drawn from
+const size_t CACHE_ENTRIES = 4096; // The most popular half fits
+const double ZIPF = 0.9;
+
+std::string body_source;
+
+// Mixed body sizes: mostly small, a long tail of large ones
+size_t body_size(size_t key) {
+    size_t bucket = (key * 2654435761u) % 100;
+    if (bucket < 60) return 512;
+    if (bucket < 90) return 4096;
+    if (bucket < 99) return 32768;
+    return 262144;
+}
+
+CacheKey make_key(uint64_t n) {
+    return utils::hash128(&n, sizeof(n), 0x6b6579);
+}
+
+CacheEntry make_entry(uint64_t n, size_t size) {
+    CacheEntry entry;
+    entry.data = BlobStore::global().intern(utils::hash128(&n, sizeof(n)), body_source.data() + n % 251, size);
+    entry.response_line = "HTTP/1.1 200 OK";
+    entry.header_block = SlabBuffer(std::string_view(
+        "Content-Type: application/octet-stream\r\n"
+        "Cache-Control: public, max-age=3600\r\n"
+        "ETag: \"5f1c6a2b-2c1a9\"\r\n"
+        "Last-Modified: Tue, 28 Jul 2020 10:00:00 GMT\r\n"));
+    entry.creation_time = std::chrono::system_clock::now();
+    entry.expires_time = entry.creation_time + std::chrono::hours(1);
+    entry.requires_validation = false;
+    entry.primary_key = make_key(n);
+    entry.identity_length = size;
+    entry.has_length = true;
+    return entry;
+}
+
+// Key ranks in request order, drawn from a Zipf distribution over KEY_SPACE
+std::vector<uint32_t> zipf_sequence(size_t length, uint64_t seed) {
+    std::vector<double> cdf(KEY_SPACE);
+    double sum = 0;
+    for (size_t i = 0; i < KEY_SPACE; ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), ZIPF);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    std::vector<uint32_t> sequence(length);
+    for (uint32_t& rank : sequence) {
+        rank = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+        if (rank >= KEY_SPACE) rank = KEY_SPACE - 1;
+    }
+    return sequence;
+}
+
+void fill_cache(Cache& cache) {
+    for (uint64_t n = 0; n < CACHE_ENTRIES; ++n) {
+        cache.put(make_key(n), make_entry(n, body_size(n)), {});
+    }
+}
+
+void cache_benchmarks(Runner& runner) {
+    const int thread_counts[] = {1, 4, 16, 64};
+    const size_t SEQUENCE = 1 << 16;
+    std::vector<std::vector<uint32_t>> sequences;
+    for (int t = 0; t < 64; ++t) sequences.push_back(zipf_sequence(SEQUENCE, 1000 + t));
+    std::vector<CacheKey> keys(KEY_SPACE);
+    for (size_t n = 0; n < KEY_SPACE; ++n) keys[n] = make_key(n);
+
+    for (int threads : thread_counts) {
+        Cache cache(CACHE_ENTRIES, size_t(1) << 30);
+        fill_cache(cache);
+        runner.run("cache_get/zipf", threads, [&](int t, uint64_t i) -> size_t {
+            CacheRef ref = cache.get(keys[sequences[t][i & (SEQUENCE - 1)]]);
+            return ref ? ref->data.size() : 0;
+        });
+    }
+
+    // Read-mostly traffic: every 20th request stores the key again (a miss fill or a refresh)
+    for (int threads : thread_counts) {
+        Cache cache(CACHE_ENTRIES, size_t(1) << 30);
+        fill_cache(cache);
+        runner.run("cache_get_put_95_5/zipf", threads, [&](int t, uint64_t i) -> size_t {
+            uint32_t rank = sequences[t][i & (SEQUENCE - 1)];
+            if (i % 20 == 19) {
+                return cache.put(keys[rank], make_entry(rank, body_size(rank)), {});
+            }
+            CacheRef ref = cache.get(keys[rank]);
+            return ref ? ref->data.size() : 0;
+        });
+    }
+
+    // Every store into a full cache evicts the least recently used entry
+    for (int threads : thread_counts) {
+        Cache cache(1024, size_t(1) << 30);
+        runner.run("cache_put_evict", threads, [&](int t, uint64_t i) -> size_t {
+            uint64_t n = (uint64_t(t + 1) << 40) | i;
+            return cache.put(make_key(n), make_entry(n, 512), {});
+        });
+    }
+}
+
+// ---- sendAll ----
+
+void send_benchmarks(Runner& runner) {
+    const size_t sizes[] = {64, 4096, 65536};
+    for (size_t size : sizes) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            perror("socketpair");
+            return;
+        }
+        // Drain the far end so sends never block for long
+        std::thread reader([fd = fds[1]] {
+            char buf[1 << 16];
+            while (read(fd, buf, sizeof(buf)) > 0) {
+            }
+        });
+        std::string payload(body_source.data(), size);
+        runner.run("handler_sendAll/" + std::to_string(size), 1, [&](int, uint64_t) -> size_t {
+            return Handler::sendAll(fds[0], payload.data(), payload.size());
+        });
+        close(fds[0]);
+        reader.join();
+        close(fds[1]);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool json = false;
+    std::string filter;
+    double min_time = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+            min_time = std::atof(argv[i] + 11);
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--filter=text] [--min-time=seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    body_source.resize(262144 + 256);
+    std::mt19937 rng(42);
+    for (char& c : body_source) c = static_cast<char>('!' + rng() % 94);
+
+    Runner runner(filter, min_time);
+    fprintf(stderr, "%-48s %14s %12s %12s %14s\n", "benchmark", "iterations", "real ns/op", "cpu ns/op", "ops/s");
+
+    for (const Corpus& c : request_corpora()) {
+        runner.run(std::string("request_parse/") + c.name, 1, [&](int, uint64_t) -> size_t {
+            Request request(c.text);
+            try {
+                request.parse();
+            } catch (const InvalidRequest&) {
+                return 0;
+            }
+            return request.get_hostname().size();
+        });
+    }
+    for (const Corpus& c : response_corpora()) {
+        runner.run(std::string("response_parse/") + c.name, 1, [&](int, uint64_t) -> size_t {
+            Response response(c.text, 1740832496, 1740832496);
+            return static_cast<size_t>(response.get_freshness_lifetime());
+        });
+    }
+    // Response::parse_time is http_date::parse behind a private wrapper
+    const Corpus dates[] = {
+        {"imf-fixdate", "Wed, 01 Mar 2025 12:34:56 GMT"},
+        {"rfc850", "Wednesday, 01-Mar-25 12:34:56 GMT"},
+        {"asctime", "Wed Mar  1 12:34:56 2025"},
+        {"invalid", "not a date at all"},
+    };
+    for (const Corpus& c : dates) {
+        runner.run(std::string("response_parse_time/") + c.name, 1, [&](int, uint64_t) -> size_t {
+            time_t parsed = 0;
+            return http_date::parse(c.text, parsed) ? static_cast<size_t>(parsed) : 0;
+        });
+    }
+
+    cache_benchmarks(runner);
+    send_benchmarks(runner);
+
+    if (json) {
+        print_json(runner.results(), argv[0]);
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * Stand-in origin server for load tests, so the proxy can be benchmarked
+ * offline and reproducibly.
+ *
+ * Every path names an object. Its size, Cache-Control and framing are
+ * drawn from the configured mixes by a hash of the path, so repeated
+ * requests for one URL always get the same answer.
+ *
+ *   -p port        listen port (8090)
+ *   -s mix         body sizes, "bytes:weight,..." ("1024:40,16384:40,262144:15,1048576:5")
+ *   -c mix         Cache-Control values, "value:weight,..."
+ *                  ("max-age=300:80,no-store:10,no-cache:10")
+ *   -l ms          delay before each response (0)
+ *   -j ms          extra random delay, uniform in [0, ms] (0)
+ *   -k percent     objects sent chunked instead of with Content-Length (0)
+ *
+ * Build with `make bench`, which also starts it.
+ */
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <strings.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template <typename T>
+struct Choice {
+    T value;
+    unsigned weight;
+};
+
+struct Settings {
+    int port = 8090;
+    std::vector<Choice<size_t>> sizes;
+    std::vector<Choice<std::string>> policies;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    int chunked_percent = 0;
+};
+
+Settings settings;
+std::string body_source;  // Bodies are slices of this, sized for the largest object
+
+// Parses "value:weight,..."; the weight follows the last colon
+bool parse_mix(const char* text, std::vector<std::string>& values, std::vector<unsigned>& weights) {
+    std::string list(text);
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(start, end - start);
+        size_t colon = item.rfind(':');
+        if (colon == std::string::npos || colon == 0) {
+            return false;
+        }
+        values.push_back(item.substr(0, colon));
+        weights.push_back(static_cast<unsigned>(std::strtoul(item.c_str() + colon + 1, nullptr, 10)));
+        start = end + 1;
+    }
+    return !values.empty();
+}
+
+template <typename T>
+const T& pick(const std::vector<Choice<T>>& choices, uint64_t hash) {
+    unsigned total = 0;
+    for (const auto& choice : choices) total += choice.weight;
+    unsigned point = total ? static_cast<unsigned>(hash % total) : 0;
+    for (const auto& choice : choices) {
+        if (point < choice.weight) return choice.value;
+        point -= choice.weight;
+    }
+    return choices.back().value;
+}
+
+// splitmix64 over FNV-1a, so nearby paths land far apart
+uint64_t hash_path(const std::string& path) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : path) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+bool send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool respond(int fd, const std::string& path, std::mt19937& rng) {
+    uint64_t h = hash_path(path);
+    size_t size = pick(settings.sizes, h);
+    const std::string& policy = pick(settings.policies, h >> 16);
+    bool chunked = static_cast<int>((h >> 32) % 100) < settings.chunked_percent;
+
+    if (settings.latency_ms > 0 || settings.jitter_ms > 0) {
+        int delay = settings.latency_ms;
+        if (settings.jitter_ms > 0) {
+            delay += std::uniform_int_distribution<int>(0, settings.jitter_ms)(rng);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    }
+
+    char date[64];
+    time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    std::string head = "HTTP/1.1 200 OK\r\nDate: ";
+    head += date;
+    head += "\r\nContent-Type: application/octet-stream\r\nCache-Control: " + policy + "\r\n";
+    if (chunked) {
+        head += "Transfer-Encoding: chunked\r\n\r\n";
+    } else {
+        head += "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+    }
+
+    const char* body = body_source.data() + (h % 251);
+    if (!chunked) {
+        head.append(body, size);
+        return send_all(fd, head.data(), head.size());
+    }
+    if (!send_all(fd, head.data(), head.size())) {
+        return false;
+    }
+    const size_t CHUNK = 16384;
+    std::string frame;
+    for (size_t offset = 0; offset < size; offset += CHUNK) {
+        size_t n = std::min(CHUNK, size - offset);
+        char prefix[24];
+        int len = snprintf(prefix, sizeof(prefix), "%zx\r\n", n);
+        frame.assign(prefix, len);
+        frame.append(body + offset, n);
+        frame += "\r\n";
+        if (offset + n >= size) frame += "0\r\n\r\n";
+        if (!send_all(fd, frame.data(), frame.size())) {
+            return false;
+        }
+    }
+    return size > 0 || send_all(fd, "0\r\n\r\n", 5);
+}
+
+// Serves requests on one connection until the client closes or asks to
+void serve(int fd) {
+    std::mt19937 rng(static_cast<unsigned>(fd) * 2654435761u);
+    std::string pending;
+    char buf[8192];
+    while (true) {
+        size_t end;
+        while ((end = pending.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            pending.append(buf, static_cast<size_t>(n));
+        }
+        std::string head = pending.substr(0, end);
+        pending.erase(0, end + 4);
+
+        size_t first = head.find(' ');
+        size_t second = head.find(' ', first + 1);
+        std::string target = first == std::string::npos ? "/" : head.substr(first + 1, second - first - 1);
+        // An absolute-form target names the same object as its path
+        size_t scheme = target.find("://");
+        if (scheme != std::string::npos) {
+            size_t slash = target.find('/', scheme + 3);
+            target = slash == std::string::npos ? "/" : target.substr(slash);
+        }
+        bool close_after = strcasestr(head.c_str(), "\r\nConnection: close") != nullptr;
+
+        if (!respond(fd, target, rng) || close_after) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-p port] [-s sizes] [-c policies] [-l ms] [-j ms] [-k percent]\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* sizes = "1024:40,16384:40,262144:15,1048576:5";
+    const char* policies = "max-age=300:80,no-store:10,no-cache:10";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:c:l:j:k:")) != -1) {
+        switch (opt) {
+            case 'p': settings.port = std::atoi(optarg); break;
+            case 's': sizes = optarg; break;
+            case 'c': policies = optarg; break;
+            case 'l': settings.latency_ms = std::atoi(optarg); break;
+            case 'j': settings.jitter_ms = std::atoi(optarg); break;
+            case 'k': settings.chunked_percent = std::atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+
+    std::vector<std::string> values;
+    std::vector<unsigned> weights;
+    if (!parse_mix(sizes, values, weights)) {
+        fprintf(stderr, "bad size mix: %s\n", sizes);
+        return 2;
+    }
+    size_t largest = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        size_t size = std::strtoull(values[i].c_str(), nullptr, 10);
+        settings.sizes.push_back({size, weights[i]});
+        largest = std::max(largest, size);
+    }
+    values.clear();
+    weights.clear();
+    if (!parse_mix(policies, values, weights)) {
+        fprintf(stderr, "bad Cache-Control mix: %s\n", policies);
+        return 2;
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        settings.policies.push_back({values[i], weights[i]});
+    }
+
+    // Printable, poorly compressible bytes, offset per object
+    std::mt19937 rng(42);
+    body_source.resize(largest + 256);
+    for (char& c : body_source) {
+        c = static_cast<char>('!' + rng() % 94);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(settings.port));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 1024) < 0) {
+        perror("origin: bind");
+        return 1;
+    }
+    fprintf(stderr, "origin: listening on 127.0.0.1:%d\n", settings.port);
+
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("origin: accept");
+            return 1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        std::thread(serve, fd).detach();
+    }
+}
@@ -0,0 +1,42 @@
+#!/bin/bash
+# Runs the load generator against a fresh proxy and the bench origin, all on
+# this machine, on ports apart from a proxy that may already be running.
+#
+#   ORIGIN_ARGS   passed to bench/origin (object sizes, Cache-Control mix, latency, chunking)
+#   BENCH_ARGS    passed to bench/loadgen (threads, duration, rate, objects, zipf)
+#
+# Proxy settings come from the environment as usual, e.g.
+#   PROXY_CACHE_MAX_BYTES=$((64 << 20)) BENCH_ARGS="-t 32 -d 30" make bench
+
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROXY="$BENCH_DIR/../proxy"
+PROXY_PORT=${BENCH_PROXY_PORT:-18080}
+ADMIN_PORT=${BENCH_ADMIN_PORT:-18081}
+ORIGIN_PORT=${BENCH_ORIGIN_PORT:-18090}
+
+WORK_DIR=$(mktemp -d)
+cleanup() {
+    [ -n "$PROXY_PID" ] && kill "$PROXY_PID" 2>/dev/null
+    [ -n "$ORIGIN_PID" ] && kill "$ORIGIN_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+"$BENCH_DIR/origin" -p "$ORIGIN_PORT" $ORIGIN_ARGS 2>/dev/null &
+ORIGIN_PID=$!
+
+# Logs go to the scratch directory; the access log would only add disk writes
+mkdir -p "$WORK_DIR/logs"
+(cd "$WORK_DIR" && PROXY_PORT=$PROXY_PORT PROXY_ADMIN_PORT=$ADMIN_PORT PROXY_ACCESS_LOG=${PROXY_ACCESS_LOG:-off} \
+    exec "$PROXY" >/dev/null 2>&1) &
+PROXY_PID=$!
+
+for _ in $(seq 50); do
+    if (exec 3<>/dev/tcp/127.0.0.1/$PROXY_PORT) 2>/dev/null && (exec 3<>/dev/tcp/127.0.0.1/$ORIGIN_PORT) 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+"$BENCH_DIR/loadgen" -x "127.0.0.1:$PROXY_PORT" -o "127.0.0.1:$ORIGIN_PORT" -a "$ADMIN_PORT" -P "$PROXY_PID" $BENCH_ARGS
@@ -0,0 +1,172 @@
+/**
+ * Compares the vectorized header scanner with the string::find / istringstream
+ * code it replaced, on a few realistic response header blocks.
+ *
+ * Build and run with `make scanner_bench`.
+ */
+#include "../http_scanner.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Corpus {
+    const char* name;
+    std::string headers;
+};
+
+std::vector<Corpus> make_corpora() {
+    std::vector<Corpus> corpora;
+    corpora.push_back({"small-api",
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 348\r\n"
+        "Connection: close\r\n"
+        "\r\n"});
+    corpora.push_back({"cdn-asset",
+        "HTTP/1.1 200 OK\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "Age: 84211\r\n"
+        "Cache-Control: public, max-age=31536000, immutable\r\n"
+        "Content-Type: application/javascript; charset=utf-8\r\n"
+        "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+        "ETag: \"5f1c6a2b-2c1a9\"\r\n"
+        "Expires: Thu, 01 Mar 2026 12:34:56 GMT\r\n"
+        "Last-Modified: Tue, 28 Jul 2020 10:00:00 GMT\r\n"
+        "Server: ECAcc (nyb/1D2E)\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "X-Cache: HIT\r\n"
+        "X-Content-Type-Options: nosniff\r\n"
+        "Content-Length: 180649\r\n"
+        "\r\n"});
+    std::string portal =
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Wed, 01 Mar 2025 12:34:56 GMT\r\n"
+        "Content-Type: text/html; charset=UTF-8\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Cache-Control: private, no-cache, no-store, must-revalidate\r\n"
+        "Expires: -1\r\n"
+        "Pragma: no-cache\r\n"
+        "Strict-Transport-Security: max-age=31536000; includeSubDomains; preload\r\n"
+        "Content-Security-Policy: default-src 'self'; script-src 'self' 'unsafe-inline' "
+        "https://www.googletagmanager.com https://www.google-analytics.com; img-src * data:\r\n"
+        "P3P: CP=\"This is not a P3P policy!\"\r\n"
+        "X-Frame-Options: SAMEORIGIN\r\n";
+    for (int i = 0; i < 8; ++i) {
+        portal += "Set-Cookie: session_" + std::to_string(i) +
+                  "=AEC0d3c2b1a09f8e7d6c5b4a39281706f5e4d3c2b1a0; expires=Thu, 01-Mar-2026 12:34:56 GMT;"
+                  " path=/; domain=.example.com; Secure; HttpOnly; SameSite=lax\r\n";
+    }
+    portal += "Server: gws\r\nAlt-Svc: h3=\":443\"; ma=2592000,h3-29=\":443\"; ma=2592000\r\n\r\n";
+    corpora.push_back({"portal-cookies", portal});
+    return corpora;
+}
+
+// The framing loop forwardRequest used before: rescan everything after each recv
+size_t legacy_frame(const std::string& wire, size_t chunk) {
+    std::string acc;
+    for (size_t off = 0; off < wire.size(); off += chunk) {
+        acc.append(wire, off, chunk);
+        size_t end = acc.find("\r\n\r\n");
+        if (end != std::string::npos) return end;
+    }
+    return std::string::npos;
+}
+
+size_t scanner_frame(const std::string& wire, size_t chunk) {
+    std::string acc;
+    size_t scan_from = 0;
+    for (size_t off = 0; off < wire.size(); off += chunk) {
+        acc.append(wire, off, chunk);
+        size_t end = http_scan::find_header_end(acc.data(), acc.size(), scan_from);
+        if (end != http_scan::npos) return end;
+    }
+    return http_scan::npos;
+}
+
+// The Response::parse line splitting used before
+size_t legacy_parse(const std::string& headers) {
+    std::unordered_map<std::string, std::string> map;
+    std::istringstream header_stream(headers);
+    std::string line;
+    std::getline(header_stream, line);
+    while (std::getline(header_stream, line) && !line.empty()) {
+        size_t colon = line.find(": ");
+        if (colon != std::string::npos) {
+            map[line.substr(0, colon)] = line.substr(colon + 2);
+        }
+    }
+    return map.size();
+}
+
+size_t scanner_parse(const std::string& headers) {
+    std::unordered_map<std::string, std::string> map;
+    size_t pos = http_scan::find_crlf(headers.data(), headers.size()) + 2;
+    while (pos < headers.size()) {
+        size_t len = http_scan::find_crlf(headers.data() + pos, headers.size() - pos);
+        if (len == 0 || len == http_scan::npos) break;
+        std::string_view name, value;
+        if (http_scan::split_header(std::string_view(headers).substr(pos, len), name, value)) {
+            map[std::string(name)] = std::string(value);
+        }
+        pos += len + 2;
+    }
+    return map.size();
+}
+
+template <typename Fn>
+double ns_per_op(Fn&& fn, int iterations) {
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        sink += fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    asm volatile("" : : "r"(sink) : "memory");
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+    const http_scan::SimdLevel levels[] = {http_scan::SimdLevel::Scalar,
+                                           http_scan::SimdLevel::SSE42,
+                                           http_scan::SimdLevel::AVX2};
+    const http_scan::SimdLevel native = http_scan::active_level();
+
+    std::printf("%-16s %-10s %-22s %12s\n", "corpus", "impl", "task", "ns/op");
+    for (const Corpus& c : make_corpora()) {
+        // Slow header arrival: the terminator is found after many small recvs
+        std::string wire = c.headers + std::string(4096, 'x');
+        const size_t chunk = 64;
+
+        std::printf("%-16s %-10s %-22s %12.1f\n", c.name, "legacy", "frame(64B recvs)",
+                    ns_per_op([&] { return legacy_frame(wire, chunk); }, iterations));
+        std::printf("%-16s %-10s %-22s %12.1f\n", c.name, "legacy", "parse",
+                    ns_per_op([&] { return legacy_parse(c.headers); }, iterations));
+
+        for (http_scan::SimdLevel level : levels) {
+            if (http_scan::force_level(level) != level) continue;
+            const char* impl = http_scan::level_name(level);
+            std::printf("%-16s %-10s %-22s %12.1f\n", c.name, impl, "frame(64B recvs)",
+                        ns_per_op([&] { return scanner_frame(wire, chunk); }, iterations));
+            std::printf("%-16s %-10s %-22s %12.1f\n", c.name, impl, "parse",
+                        ns_per_op([&] { return scanner_parse(c.headers); }, iterations));
+            std::printf("%-16s %-10s %-22s %12.1f\n", c.name, impl, "find_header_end",
+                        ns_per_op([&] {
+                            size_t from = 0;
+                            return http_scan::find_header_end(c.headers.data(), c.headers.size(), from);
+                        }, iterations));
+        }
+        http_scan::force_level(native);
+    }
+    return 0;
+}
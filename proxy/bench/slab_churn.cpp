@@ -0,0 +1,106 @@
+/**
+ * Cache memory churn: stores lognormal-sized bodies under a byte budget,
+ * evicting the oldest, and reports resident memory. Compares SlabBuffer
+ * with the per-entry std::vector bodies it replaced.
+ *
+ * Build and run with `make slab_churn`; each mode runs in its own process
+ * so one does not inherit the other's heap.
+ *
+ *   slab_churn slab|vector [bodies] [budget_mib] [threads]
+ */
+#include "../slab_allocator.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t SOURCE_BYTES = 16 << 20;  // Bodies are copied out of this
+const size_t MAX_BODY = 1 << 20;
+
+long status_kib(const char* field) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long value = -1;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, len) == 0) {
+            value = strtol(line + len, nullptr, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+// Median about 4 KiB with a long tail, like web objects
+size_t body_size(std::mt19937_64& rng) {
+    std::lognormal_distribution<double> dist(std::log(4096.0), 1.5);
+    return std::min(MAX_BODY, std::max<size_t>(64, static_cast<size_t>(dist(rng))));
+}
+
+template <typename Body, typename Make, typename Charge>
+void churn(const std::string& source, size_t bodies, size_t budget, unsigned seed, Make make, Charge charge) {
+    std::mt19937_64 rng(seed);
+    std::deque<std::pair<Body, size_t>> store;
+    size_t used = 0;
+    for (size_t i = 0; i < bodies; ++i) {
+        size_t size = body_size(rng);
+        size_t offset = rng() % (source.size() - size);
+        Body body = make(source.data() + offset, size);
+        size_t cost = charge(body);
+        while (!store.empty() && used + cost > budget) {
+            used -= store.front().second;
+            store.pop_front();
+        }
+        used += cost;
+        store.emplace_back(std::move(body), cost);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "slab";
+    size_t bodies = argc > 2 ? strtoul(argv[2], nullptr, 10) : 600000;
+    size_t budget = (argc > 3 ? strtoul(argv[3], nullptr, 10) : 64) << 20;
+    unsigned threads = argc > 4 ? static_cast<unsigned>(atoi(argv[4])) : 4;
+    if (mode != "slab" && mode != "vector") {
+        fprintf(stderr, "usage: %s slab|vector [bodies] [budget_mib] [threads]\n", argv[0]);
+        return 2;
+    }
+
+    std::string source(SOURCE_BYTES, '\0');
+    std::mt19937_64 fill(1);
+    for (char& c : source) c = static_cast<char>(fill());
+
+    // Each thread keeps its own share of the budget, as cache shards would
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            size_t share = bodies / threads;
+            if (mode == "slab") {
+                churn<SlabBuffer>(source, share, budget / threads, t + 1,
+                                  [](const char* p, size_t n) { return SlabBuffer(p, n); },
+                                  [](const SlabBuffer& b) { return b.footprint(); });
+            } else {
+                churn<std::vector<char>>(source, share, budget / threads, t + 1,
+                                         [](const char* p, size_t n) { return std::vector<char>(p, p + n); },
+                                         [](const std::vector<char>& b) { return b.capacity(); });
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    printf("%-6s bodies=%zu budget=%zuMiB threads=%u  peak_rss=%ldMiB rss=%ldMiB (includes %zuMiB of source data)\n",
+           mode.c_str(), bodies, budget >> 20, threads, status_kib("VmHWM:") >> 10, status_kib("VmRSS:") >> 10,
+           SOURCE_BYTES >> 20);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * Consistency check for the cache's Vary bookkeeping: a primary key whose
+ * response stops varying and then varies again must keep its Vary record
+ * for as long as any variant stored under it is cached.
+ *
+ * Build and run with `make vary_check`; exits non-zero on the first failure.
+ */
+#include "../cache.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Defined by main.cpp in the proxy; Handler refers to it
+boost::asio::thread_pool* global_thread_pool = nullptr;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) ++failures;
+}
+
+CacheKey make_key(uint64_t n) {
+    return utils::hash128(&n, sizeof(n), 0x76617279);
+}
+
+CacheEntry make_entry(const CacheKey& primary) {
+    CacheEntry entry;
+    entry.response_line = "HTTP/1.1 200 OK";
+    entry.creation_time = std::chrono::system_clock::now();
+    entry.expires_time = entry.creation_time + std::chrono::hours(1);
+    entry.primary_key = primary;
+    return entry;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::string> vary = {"accept-encoding"};
+    Cache cache(64, size_t(1) << 20);
+    CacheKey primary = make_key(0);
+    CacheKey gzip = make_key(1);
+    CacheKey br = make_key(2);
+
+    cache.put(gzip, make_entry(primary), vary);
+    expect(cache.getVary(primary) == vary, "first variant records Vary");
+
+    // The response stops varying; the gzip variant is still cached
+    cache.put(primary, make_entry(primary));
+    expect(cache.getVary(primary).empty(), "non-varying response hides the Vary names");
+
+    // ...and varies again, recreating the record
+    cache.put(br, make_entry(primary), vary);
+    expect(cache.getVary(primary) == vary, "varying again restores the Vary names");
+
+    // Dropping the variant from before the erase must not drop the record
+    cache.remove(gzip);
+    expect(cache.getVary(primary) == vary, "record survives the older variant's removal");
+
+    cache.remove(br);
+    expect(cache.getVary(primary).empty(), "record goes with the last variant");
+
+    // A record with no variants left is dropped by a non-varying response
+    cache.put(gzip, make_entry(primary), vary);
+    cache.remove(gzip);
+    cache.put(br, make_entry(primary), vary);
+    cache.put(primary, make_entry(primary));
+    cache.remove(br);
+    cache.put(gzip, make_entry(primary), vary);
+    cache.remove(gzip);
+    expect(cache.getVary(primary).empty(), "reinsert after erase counts from zero");
+
+    return failures == 0 ? 0 : 1;
+}
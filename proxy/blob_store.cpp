@@ -0,0 +1,126 @@
+#include "blob_store.hpp"
+#include <cstring>
+#include "utils/locks.hpp"
+
+namespace {
+
+utils::LockSite lock_site("blob_store");
+
+// Byte-for-byte comparison of a stored body with a candidate
+bool same_content(const SlabBuffer& stored, const uint8_t* data, size_t size) {
+    if (stored.size() != size) {
+        return false;
+    }
+    for (size_t i = 0; i < stored.chunkCount(); ++i) {
+        std::string_view chunk = stored.chunk(i);
+        if (std::memcmp(chunk.data(), data, chunk.size()) != 0) {
+            return false;
+        }
+        data += chunk.size();
+    }
+    return true;
+}
+
+} // namespace
+
+void BlobRef::reset() {
+    if (blob_) {
+        blob_->store->release(blob_);
+        blob_ = nullptr;
+    }
+}
+
+BlobStore& BlobStore::global() {
+    static BlobStore* instance = new BlobStore();  // Never destroyed: cache entries may outlive main()
+    return *instance;
+}
+
+BlobRef BlobStore::intern(const utils::Hash128& hash, const void* data, size_t size, bool* shared) {
+    if (shared) {
+        *shared = false;
+    }
+    if (size == 0) {
+        return BlobRef();
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    Blob* candidate = nullptr;
+    {
+        utils::ScopedLock<std::mutex> lock(mutex_, lock_site);
+        auto it = blobs_.find(hash);
+        if (it != blobs_.end()) {
+            // Retain only while some reference remains; a blob at zero is being freed
+            Blob* blob = it->second;
+            uint32_t refs = blob->refs.load(std::memory_order_relaxed);
+            while (refs > 0 && !blob->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel)) {
+            }
+            if (refs > 0) {
+                candidate = blob;
+            }
+        }
+    }
+    if (candidate) {
+        references_.fetch_add(1, std::memory_order_relaxed);
+        logical_bytes_.fetch_add(candidate->data.size(), std::memory_order_relaxed);
+        BlobRef ref(candidate);
+        // Compared outside the lock; a mismatch just drops the extra reference
+        if (same_content(candidate->data, bytes, size)) {
+            dedup_hits_.fetch_add(1, std::memory_order_relaxed);
+            if (shared) {
+                *shared = true;
+            }
+            return ref;
+        }
+    }
+
+    // Copy into slabs outside the lock; bodies can be large
+    Blob* blob = new Blob;
+    blob->hash = hash;
+    blob->data = SlabBuffer(data, size);
+    blob->store = this;
+    if (!blob->data.valid()) {
+        delete blob;
+        return BlobRef();
+    }
+
+    {
+        // A colliding or dying blob under the same hash is simply displaced;
+        // it stays valid for its holders and release() won't unmap ours
+        utils::ScopedLock<std::mutex> lock(mutex_, lock_site);
+        blobs_[hash] = blob;
+    }
+    references_.fetch_add(1, std::memory_order_relaxed);
+    logical_bytes_.fetch_add(size, std::memory_order_relaxed);
+    physical_bytes_.fetch_add(size, std::memory_order_relaxed);
+    return BlobRef(blob);
+}
+
+void BlobStore::release(Blob* blob) {
+    size_t size = blob->data.size();
+    references_.fetch_sub(1, std::memory_order_relaxed);
+    logical_bytes_.fetch_sub(size, std::memory_order_relaxed);
+    if (blob->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    {
+        utils::ScopedLock<std::mutex> lock(mutex_, lock_site);
+        auto it = blobs_.find(blob->hash);
+        if (it != blobs_.end() && it->second == blob) {
+            blobs_.erase(it);
+        }
+    }
+    physical_bytes_.fetch_sub(size, std::memory_order_relaxed);
+    delete blob;
+}
+
+BlobStats BlobStore::stats() const {
+    BlobStats stats;
+    {
+        utils::ScopedLock<std::mutex> lock(mutex_, lock_site);
+        stats.blobs = blobs_.size();
+    }
+    stats.references = references_.load(std::memory_order_relaxed);
+    stats.logical_bytes = logical_bytes_.load(std::memory_order_relaxed);
+    stats.physical_bytes = physical_bytes_.load(std::memory_order_relaxed);
+    stats.dedup_hits = dedup_hits_.load(std::memory_order_relaxed);
+    return stats;
+}
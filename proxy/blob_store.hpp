@@ -0,0 +1,121 @@
+#ifndef BLOB_STORE_HPP
+#define BLOB_STORE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "slab_allocator.hpp"
+#include "utils/hash.hpp"
+
+class BlobStore;
+
+/**
+ * One stored body, shared by every cache entry with the same content
+ */
+struct Blob {
+    utils::Hash128 hash;
+    SlabBuffer data;
+    std::atomic<uint32_t> refs{1};
+    BlobStore* store = nullptr;
+};
+
+/**
+ * Counted reference to a shared body
+ *
+ * Move-only: each BlobRef is one logical copy of the body, which is what the
+ * dedup figures count. An empty BlobRef stands for an empty body.
+ */
+class BlobRef {
+private:
+    Blob* blob_ = nullptr;
+
+public:
+    BlobRef() = default;
+    explicit BlobRef(Blob* blob) : blob_(blob) {}
+    ~BlobRef() { reset(); }
+
+    BlobRef(BlobRef&& other) noexcept : blob_(other.blob_) { other.blob_ = nullptr; }
+    BlobRef& operator=(BlobRef&& other) noexcept {
+        if (this != &other) {
+            reset();
+            blob_ = other.blob_;
+            other.blob_ = nullptr;
+        }
+        return *this;
+    }
+    BlobRef(const BlobRef&) = delete;
+    BlobRef& operator=(const BlobRef&) = delete;
+
+    void reset();
+
+    size_t size() const { return blob_ ? blob_->data.size() : 0; }
+    bool empty() const { return size() == 0; }
+    size_t chunkCount() const { return blob_ ? blob_->data.chunkCount() : 0; }
+    std::string_view chunk(size_t i) const { return blob_->data.chunk(i); }
+    const Blob* get() const { return blob_; }  // Identifies the shared body
+};
+
+/**
+ * Deduplication figures; logical counts every reference, physical each body once
+ */
+struct BlobStats {
+    size_t blobs = 0;           // Distinct bodies stored
+    size_t references = 0;      // Live BlobRefs
+    size_t logical_bytes = 0;   // Sum of body sizes over all references
+    size_t physical_bytes = 0;  // Sum of body sizes over distinct bodies
+    size_t dedup_hits = 0;      // intern() calls answered by an existing body
+
+    size_t bytesSaved() const { return logical_bytes - physical_bytes; }
+    double dedupRatio() const { return physical_bytes ? double(logical_bytes) / physical_bytes : 1.0; }
+};
+
+/**
+ * Content-addressed store of cached bodies
+ *
+ * Bodies are keyed by a 128-bit hash computed while the response streams
+ * in. Versioned assets, mirrors and query-string variants that return the
+ * same bytes share one copy in the slab allocator. A candidate match is
+ * compared byte for byte before sharing, since the hash is not
+ * collision-resistant against crafted input.
+ *
+ * Thread-safe.
+ */
+class BlobStore {
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<utils::Hash128, Blob*> blobs_;
+    std::atomic<size_t> references_{0};
+    std::atomic<size_t> logical_bytes_{0};
+    std::atomic<size_t> physical_bytes_{0};
+    std::atomic<size_t> dedup_hits_{0};
+
+    friend class BlobRef;
+    void release(Blob* blob);
+
+public:
+    BlobStore() = default;
+    BlobStore(const BlobStore&) = delete;
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    /**
+     * Returns a reference to the stored body with this content, storing it first if new
+     *
+     * @param hash Hasher128 digest of the body
+     * @param shared Set when an existing copy was reused (optional)
+     * @return Empty ref for an empty body or if the slab allocator is out of memory
+     */
+    BlobRef intern(const utils::Hash128& hash, const void* data, size_t size, bool* shared = nullptr);
+
+    /**
+     * Bytes of distinct bodies currently alive
+     */
+    size_t physicalBytes() const { return physical_bytes_.load(std::memory_order_relaxed); }
+
+    BlobStats stats() const;
+
+    static BlobStore& global();
+};
+
+#endif // BLOB_STORE_HPP
@@ -1,74 +1,251 @@
 #include "cache.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+const size_t MIN_SLOTS = 64;
+
+// Lock sites; see utils::LockSite
+utils::LockSite read_site("cache.read");
+utils::LockSite write_site("cache.write");
+utils::LockSite lru_site("cache.lru");
+
+// Home slot of a key; the key is already a uniform digest
+inline size_t home_slot(const CacheKey& key, size_t mask) {
+    return static_cast<size_t>(key.lo) & mask;
+}
+
+} // namespace
 
 // Constructor
-Cache::Cache(size_t max_entries) : max_entries_(max_entries) {}
+Cache::Cache(size_t max_entries, size_t max_bytes)
+    : slots_(MIN_SLOTS, nullptr), max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+// Destructor drops the cache's references; handles still out keep their nodes
+Cache::~Cache() {
+    clear();
+}
+
+// Linear probe for key or the first empty slot
+size_t Cache::findSlot(const CacheKey& key) const {
+    size_t slot = home_slot(key, mask());
+    while (slots_[slot] && slots_[slot]->key != key) {
+        slot = (slot + 1) & mask();
+    }
+    return slot;
+}
+
+// Rehash every node into a larger table
+void Cache::grow(size_t new_size) {
+    std::vector<CacheNode*> old;
+    old.swap(slots_);
+    slots_.assign(new_size, nullptr);
+    for (CacheNode* node : old) {
+        if (node) {
+            slots_[findSlot(node->key)] = node;
+        }
+    }
+}
+
+// Backward-shift deletion keeps probe runs intact without tombstones
+void Cache::eraseSlot(size_t slot) {
+    slots_[slot] = nullptr;
+    size_t next = slot;
+    while (true) {
+        next = (next + 1) & mask();
+        CacheNode* node = slots_[next];
+        if (!node) {
+            return;
+        }
+        // Move node back unless its home lies cyclically in (slot, next]
+        size_t home = home_slot(node->key, mask());
+        bool stays = (slot <= next) ? (slot < home && home <= next)
+                                    : (slot < home || home <= next);
+        if (!stays) {
+            slots_[slot] = node;
+            slots_[next] = nullptr;
+            slot = next;
+        }
+    }
+}
+
+// LRU helpers
+void Cache::lruUnlink(CacheNode* node) const {
+    if (node->lru_prev) node->lru_prev->lru_next = node->lru_next;
+    else lru_head_ = node->lru_next;
+    if (node->lru_next) node->lru_next->lru_prev = node->lru_prev;
+    else lru_tail_ = node->lru_prev;
+    node->lru_prev = node->lru_next = nullptr;
+}
+
+void Cache::lruPushFront(CacheNode* node) const {
+    node->lru_prev = nullptr;
+    node->lru_next = lru_head_;
+    if (lru_head_) lru_head_->lru_prev = node;
+    lru_head_ = node;
+    if (!lru_tail_) lru_tail_ = node;
+}
+
+// Remove the node in a slot from every structure
+void Cache::unlinkNode(size_t slot) {
+    CacheNode* node = slots_[slot];
+    {
+        utils::ScopedLock<std::mutex> lru_lock(lru_mutex_, lru_site);
+        lruUnlink(node);
+    }
+    releaseVariant(node->key, node->entry);
+    eraseSlot(slot);
+    --count_;
+    bytes_ -= node->charge;
+    unchargeBody(node->entry.data);
+    node->release();
+}
 
 // Helper to evict oldest entry
 void Cache::evictOldest() {
-    if (!access_order_.empty()) {
-        std::string oldest_key = access_order_.back();
-        access_order_.pop_back();
-        cache_map_.erase(oldest_key);
-        key_to_iterator_.erase(oldest_key);
+    CacheNode* oldest;
+    {
+        utils::ScopedLock<std::mutex> lru_lock(lru_mutex_, lru_site);
+        oldest = lru_tail_;
+    }
+    if (oldest) {
+        unlinkNode(findSlot(oldest->key));
+        metrics::cache_evictions.inc();
     }
 }
 
-// Update access order for LRU
-void Cache::updateAccessOrder(const std::string& key) {
-    auto it = key_to_iterator_.find(key);
-    if (it != key_to_iterator_.end()) {
-        access_order_.erase(it->second);
+// A body shared by several entries here is charged once
+void Cache::chargeBody(const BlobRef& body) {
+    if (body.get() && body_refs_[body.get()]++ == 0) {
+        body_bytes_ += body.size();
+    }
+}
+
+void Cache::unchargeBody(const BlobRef& body) {
+    auto it = body.get() ? body_refs_.find(body.get()) : body_refs_.end();
+    if (it != body_refs_.end() && --it->second == 0) {
+        body_bytes_ -= body.size();
+        body_refs_.erase(it);
+    }
+}
+
+// Forget a variant; the Vary record goes once its last variant is gone
+void Cache::releaseVariant(const CacheKey& key, const CacheEntry& entry) {
+    if (key == entry.primary_key) {
+        return;
+    }
+    auto it = vary_index_.find(entry.primary_key);
+    if (it != vary_index_.end() && --it->second.variants == 0) {
+        vary_index_.erase(it);
     }
-    
-    access_order_.push_front(key);
-    key_to_iterator_[key] = access_order_.begin();
 }
 
 // Thread-safe cache read
-std::optional<CacheEntry> Cache::get(const std::string& key) const {
-    utils::ReaderLock lock(cache_mutex_);
-    auto it = cache_map_.find(key);
-    if (it != cache_map_.end()) {
-        // TODO: update access order
-        return it->second;
+CacheRef Cache::get(const CacheKey& key) const {
+    utils::ReaderLock lock(cache_mutex_, read_site);
+    CacheNode* node = slots_[findSlot(key)];
+    if (!node) {
+        return CacheRef();
     }
-    return std::nullopt;
+    // Hits must not queue behind each other just to reorder the list
+    std::unique_lock<std::mutex> lru_lock(lru_mutex_, std::try_to_lock);
+    if (lru_lock.owns_lock() && lru_head_ != node) {
+        lruUnlink(node);
+        lruPushFront(node);
+    }
+    return CacheRef(node);
+}
+
+// Thread-safe Vary lookup
+std::vector<std::string> Cache::getVary(const CacheKey& primary) const {
+    utils::ReaderLock lock(cache_mutex_, read_site);
+    auto it = vary_index_.find(primary);
+    return it != vary_index_.end() ? it->second.names : std::vector<std::string>();
 }
 
 // Thread-safe cache write
-void Cache::put(const std::string& key, const CacheEntry& value) {
-    utils::WriterLock lock(cache_mutex_);
-    if (cache_map_.size() >= max_entries_) {
+bool Cache::put(const CacheKey& key, CacheEntry&& value, const std::vector<std::string>& vary) {
+    size_t charge = value.footprint() + sizeof(CacheNode) - sizeof(CacheEntry);
+    if (charge + value.data.size() > max_bytes_) {
+        return false;
+    }
+
+    // Build the node outside the lock; readers may still hold the one it replaces
+    CacheNode* node = new CacheNode;
+    node->key = key;
+    node->charge = charge;
+    node->entry = std::move(value);
+
+    utils::WriterLock lock(cache_mutex_, write_site);
+    size_t slot = findSlot(key);
+    if (slots_[slot]) {
+        unlinkNode(slot);
+    }
+    while (count_ > 0 && (count_ >= max_entries_ || usedBytes() + charge + newBodyBytes(node->entry.data) > max_bytes_)) {
         evictOldest();
     }
-    cache_map_[key] = value;
-    updateAccessOrder(key);
+
+    if (vary.empty()) {
+        // The response no longer varies; stale variants age out through LRU,
+        // and the record keeps counting them until the last one goes
+        auto it = vary_index_.find(node->entry.primary_key);
+        if (it != vary_index_.end() && it->second.variants > 0) {
+            it->second.names.clear();
+        } else if (it != vary_index_.end()) {
+            vary_index_.erase(it);
+        }
+    } else {
+        VaryRecord& record = vary_index_[node->entry.primary_key];
+        record.names = vary;
+        ++record.variants;
+    }
+
+    // Keep the load factor at or below 3/4
+    if ((count_ + 1) * 4 > slots_.size() * 3) {
+        grow(slots_.size() * 2);
+    }
+    slots_[findSlot(key)] = node;
+    ++count_;
+    bytes_ += charge;
+    chargeBody(node->entry.data);
+
+    utils::ScopedLock<std::mutex> lru_lock(lru_mutex_, lru_site);
+    lruPushFront(node);
+    return true;
 }
 
 // Thread-safe cache remove
-void Cache::remove(const std::string& key) {
-    utils::WriterLock lock(cache_mutex_);
-    auto it = cache_map_.find(key);
-    if (it != cache_map_.end()) {
-        cache_map_.erase(it);
-        auto order_it = key_to_iterator_.find(key);
-        if (order_it != key_to_iterator_.end()) {
-            access_order_.erase(order_it->second);
-            key_to_iterator_.erase(order_it);
-        }
+void Cache::remove(const CacheKey& key) {
+    utils::WriterLock lock(cache_mutex_, write_site);
+    size_t slot = findSlot(key);
+    if (slots_[slot]) {
+        unlinkNode(slot);
     }
 }
 
 // Thread-safe cache clear
 void Cache::clear() {
-    utils::WriterLock lock(cache_mutex_);
-    cache_map_.clear();
-    access_order_.clear();
-    key_to_iterator_.clear();
+    utils::WriterLock lock(cache_mutex_, write_site);
+    for (CacheNode*& node : slots_) {
+        if (node) {
+            node->release();
+            node = nullptr;
+        }
+    }
+    slots_.assign(MIN_SLOTS, nullptr);
+    slots_.shrink_to_fit();
+    count_ = 0;
+    bytes_ = 0;
+    body_bytes_ = 0;
+    body_refs_.clear();
+    vary_index_.clear();
+
+    utils::ScopedLock<std::mutex> lru_lock(lru_mutex_, lru_site);
+    lru_head_ = lru_tail_ = nullptr;
 }
 
 // Check if an entry is in cache and not expired
-bool Cache::isValid(const std::string& key) const {
+bool Cache::isValid(const CacheKey& key) const {
     auto entry = get(key);
     if (!entry) return false;
     return !entry->isExpired();
@@ -76,6 +253,19 @@ bool Cache::isValid(const std::string& key) const {
 
 // Get cache size
 size_t Cache::size() const {
-    utils::ReaderLock lock(cache_mutex_);
-    return cache_map_.size();
+    utils::ReaderLock lock(cache_mutex_, read_site);
+    return count_;
+}
+
+// Index overhead: one pointer per slot plus each node's key, refcount and links
+size_t Cache::indexBytes() const {
+    utils::ReaderLock lock(cache_mutex_, read_site);
+    return slots_.capacity() * sizeof(CacheNode*) +
+           count_ * (sizeof(CacheNode) - sizeof(CacheEntry));
+}
+
+// Budgeted bytes
+size_t Cache::bytes() const {
+    utils::ReaderLock lock(cache_mutex_, read_site);
+    return usedBytes();
 }
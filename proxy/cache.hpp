@@ -1,27 +1,41 @@
 #ifndef CACHE_HPP
 #define CACHE_HPP
 
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <string>
-#include <list>
-#include <optional>
 #include <chrono>
 #include <shared_mutex>
 #include <vector>
 #include "utils/locks.hpp"
+#include "http_date.hpp"
+#include "cache_key.hpp"
+#include "slab_allocator.hpp"
+#include "blob_store.hpp"
+#include "compression.hpp"
 
 /**
  * Stores complete HTTP response data with caching metadata
  */
 struct CacheEntry {
-    std::vector<uint8_t> data;                          // Raw response body
+    BlobRef data;                                       // Raw response body, shared by identical bodies
     std::string response_line;                          // HTTP status line
-    std::unordered_map<std::string, std::string> headers; // Response headers
-    std::chrono::system_clock::time_point creation_time;  // When cached
+    SlabBuffer header_block;                            // Stored headers as "Name: value\r\n" lines
+    std::chrono::system_clock::time_point creation_time;  // When cached (response_time)
     std::chrono::system_clock::time_point expires_time;   // When expires
+    time_t initial_age = 0;                              // Corrected initial age at creation
     bool requires_validation;                            // Needs revalidation
     std::string etag;                                   // Entity tag
     std::string last_modified;                          // Modification time
+    int status_code = 200;                              // Origin status
+    CacheKey primary_key;                               // URL key this variant belongs to
+    std::string key_text;                               // CacheKeyBuilder::keyText() of its key
+    bool is_negative = false;                           // Cached origin error (short TTL)
+    compression::Coding coding = compression::Coding::Identity;  // Coding of the stored body
+    size_t identity_length = 0;                         // Body length before compression
+    bool adds_vary = false;                             // Send "Vary: Accept-Encoding" with it
+    bool has_length = false;                            // Complete body framed by Content-Length
     
     /**
      * Determines if this entry is no longer fresh according to HTTP caching rules
@@ -31,50 +45,194 @@ struct CacheEntry {
     bool isExpired() const {
         return requires_validation || 
                (expires_time != std::chrono::system_clock::time_point() && 
-                std::chrono::system_clock::now() > expires_time);
+                std::chrono::system_clock::from_time_t(CoarseClock::now()) > expires_time);
+    }
+
+    /**
+     * Bytes this entry holds in the slab allocator and on the heap, body
+     * excluded (bodies are accounted once per distinct content by BlobStore)
+     */
+    size_t footprint() const {
+        return header_block.footprint() + response_line.capacity() +
+               etag.capacity() + last_modified.capacity() + key_text.capacity() + sizeof(CacheEntry);
+    }
+
+    /**
+     * Current age in seconds, for the Age header of a response served from cache
+     */
+    time_t currentAge() const {
+        time_t resident = CoarseClock::now() - std::chrono::system_clock::to_time_t(creation_time);
+        return initial_age + (resident > 0 ? resident : 0);
+    }
+};
+
+/**
+ * One cached response with its index bookkeeping, allocated once per entry
+ *
+ * The key doubles as the table hash (it is already a 128-bit digest), and the
+ * LRU links are intrusive, so an entry costs one allocation and no copies of
+ * its key. The node outlives its removal from the cache while any CacheRef
+ * still points at it.
+ */
+struct CacheNode {
+    CacheKey key;
+    std::atomic<uint32_t> refs{1};  // The cache's own reference plus handles
+    size_t charge = 0;              // Bytes counted against the cache budget
+    CacheNode* lru_prev = nullptr;  // Towards most recently used
+    CacheNode* lru_next = nullptr;  // Towards least recently used
+    CacheEntry entry;
+
+    void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
     }
 };
 
+/**
+ * Reference-counted read handle to a cached entry
+ *
+ * Keeps the entry alive (and unchanged) after the lookup's lock is released,
+ * without copying the response body out of the cache.
+ */
+class CacheRef {
+private:
+    CacheNode* node_ = nullptr;
+
+public:
+    CacheRef() = default;
+    explicit CacheRef(CacheNode* node) : node_(node) {
+        if (node_) node_->retain();
+    }
+    CacheRef(const CacheRef& other) : CacheRef(other.node_) {}
+    CacheRef(CacheRef&& other) noexcept : node_(other.node_) { other.node_ = nullptr; }
+    CacheRef& operator=(CacheRef other) noexcept {
+        std::swap(node_, other.node_);
+        return *this;
+    }
+    ~CacheRef() {
+        if (node_) node_->release();
+    }
+
+    const CacheEntry& operator*() const { return node_->entry; }
+    const CacheEntry* operator->() const { return &node_->entry; }
+    explicit operator bool() const { return node_ != nullptr; }
+};
+
 /**
  * Thread-safe HTTP response cache with LRU eviction policy
+ *
+ * Entries live in an open-addressing table (linear probing, backward-shift
+ * deletion) of CacheNode pointers threaded on an intrusive LRU list. Lookups
+ * share cache_mutex_; the LRU list has its own mutex so hits can reorder it
+ * without excluding each other from the table.
+ *
+ * Eviction keeps both the entry count and the memory footprint within their
+ * limits. The footprint is every entry's header block and bookkeeping plus
+ * each distinct body in BlobStore::global() once.
  */
 class Cache {
 private:
-    mutable std::shared_mutex cache_mutex_;  // Thread synchronization
-    std::unordered_map<std::string, CacheEntry> cache_map_;  // Main storage
-    std::list<std::string> access_order_;    // LRU tracking list
-    std::unordered_map<std::string, std::list<std::string>::iterator> key_to_iterator_;  // For O(1) LRU updates
+    mutable std::shared_mutex cache_mutex_;  // Guards the table and vary_index_
+    mutable std::mutex lru_mutex_;           // Guards the LRU links
+    std::vector<CacheNode*> slots_;          // Power-of-two open-addressing table
+    size_t count_ = 0;                       // Live entries
+    size_t bytes_ = 0;                       // Sum of node charges (bodies excluded)
+    size_t body_bytes_ = 0;                  // Distinct bodies referenced by this cache's entries
+    std::unordered_map<const Blob*, size_t> body_refs_;  // Entries per body, guarded like the table
+    mutable CacheNode* lru_head_ = nullptr;  // Most recently used
+    mutable CacheNode* lru_tail_ = nullptr;  // Least recently used
     size_t max_entries_;  // Maximum capacity
+    size_t max_bytes_;    // Memory budget for entries
 
     /**
-     * Removes the least recently used entry when cache reaches capacity
+     * Vary header names of the responses stored under a primary key,
+     * with the number of variant entries still cached for it. Names are
+     * empty while variants outlive a later response that doesn't vary.
      */
-    void evictOldest();
-    
+    struct VaryRecord {
+        std::vector<std::string> names;
+        size_t variants = 0;
+    };
+    std::unordered_map<CacheKey, VaryRecord> vary_index_;
+
+    size_t mask() const { return slots_.size() - 1; }
+    size_t usedBytes() const { return bytes_ + body_bytes_; }
+
     /**
-     * Updates the access tracking data structures when an entry is accessed
-     * 
-     * @param key The URL key being accessed
+     * Bytes a body would add to this cache: nothing if an entry here already holds it
+     */
+    size_t newBodyBytes(const BlobRef& body) const {
+        return body.get() && body_refs_.count(body.get()) == 0 ? body.size() : 0;
+    }
+
+    // Count an entry's body in or out of body_bytes_; caller holds the writer lock
+    void chargeBody(const BlobRef& body);
+    void unchargeBody(const BlobRef& body);
+
+    /**
+     * Finds the slot holding key, or the empty slot where it would go
+     */
+    size_t findSlot(const CacheKey& key) const;
+
+    /**
+     * Rehashes into a table of new_size slots; caller holds the writer lock
+     */
+    void grow(size_t new_size);
+
+    /**
+     * Empties a slot and shifts later members of its probe run back
+     */
+    void eraseSlot(size_t slot);
+
+    /**
+     * Unlinks a node from table, LRU list and Vary bookkeeping and drops the
+     * cache's reference; caller holds the writer lock
      */
-    void updateAccessOrder(const std::string& key);
+    void unlinkNode(size_t slot);
+
+    /**
+     * Drops an entry's variant bookkeeping; caller holds the writer lock
+     *
+     * @param key The key being removed
+     * @param entry The entry stored under it
+     */
+    void releaseVariant(const CacheKey& key, const CacheEntry& entry);
+
+    /**
+     * Removes the least recently used entry when cache reaches capacity
+     */
+    void evictOldest();
+
+    // LRU list primitives; caller holds lru_mutex_
+    void lruUnlink(CacheNode* node) const;
+    void lruPushFront(CacheNode* node) const;
 
 public:
     /**
      * Creates a new cache with specified capacity
      * 
      * @param max_entries Maximum number of responses to store before eviction
+     * @param max_bytes Memory budget for stored responses
      */
-    explicit Cache(size_t max_entries = 1000);
+    explicit Cache(size_t max_entries = 1000, size_t max_bytes = 256 << 20);
+    ~Cache();
+
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
     
     /**
      * Retrieves a cached response if available
      * 
      * Thread-safe read operation that allows multiple concurrent readers.
+     * A hit moves the entry to the front of the LRU list unless another
+     * thread is reordering it at that moment (recency is then approximate).
      * 
-     * @param key The URL to look up
-     * @return The cached entry if found, or nullopt if not in cache
+     * @param key The variant key to look up
+     * @return Handle to the cached entry, or an empty handle if not in cache
      */
-    std::optional<CacheEntry> get(const std::string& key) const;
+    CacheRef get(const CacheKey& key) const;
     
     /**
      * Stores a response in the cache
@@ -82,19 +240,31 @@ public:
      * Thread-safe write operation that ensures exclusive access.
      * Handles eviction if needed when at capacity.
      * 
-     * @param key The URL to store
-     * @param value The response data to cache
+     * @param key The variant key to store under
+     * @param value The response data to cache; value.primary_key must be set
+     * @param vary Lowercased Vary header names of the response (empty if it doesn't vary)
+     * @return False if the entry alone exceeds the memory budget (nothing is stored)
      */
-    void put(const std::string& key, const CacheEntry& value);
+    bool put(const CacheKey& key, CacheEntry&& value, const std::vector<std::string>& vary = {});
+
+    /**
+     * Looks up the Vary header names recorded for a primary key
+     * 
+     * Thread-safe read operation.
+     * 
+     * @param primary The normalized URL key
+     * @return Names to build the variant key from; empty if responses don't vary
+     */
+    std::vector<std::string> getVary(const CacheKey& primary) const;
     
     /**
      * Explicitly removes an entry from the cache
      * 
      * Thread-safe write operation that ensures exclusive access.
      * 
-     * @param key The URL to remove
+     * @param key The key to remove
      */
-    void remove(const std::string& key);
+    void remove(const CacheKey& key);
     
     /**
      * Empties the entire cache
@@ -108,10 +278,10 @@ public:
      * 
      * Thread-safe read operation that combines lookup and expiration check.
      * 
-     * @param key The URL to check
+     * @param key The key to check
      * @return True if entry exists and is not expired
      */
-    bool isValid(const std::string& key) const;
+    bool isValid(const CacheKey& key) const;
     
     /**
      * Reports current number of entries in the cache
@@ -121,6 +291,24 @@ public:
      * @return Number of cached responses
      */
     size_t size() const;
+
+    /**
+     * Bytes spent on indexing (table slots plus per-node bookkeeping),
+     * excluding the entries themselves
+     *
+     * Thread-safe read operation.
+     */
+    size_t indexBytes() const;
+
+    /**
+     * Bytes charged against the memory budget: this cache's entries plus the
+     * distinct bodies they hold
+     *
+     * Thread-safe read operation.
+     */
+    size_t bytes() const;
+
+    size_t maxBytes() const { return max_bytes_; }
 };
 
-#endif // CACHE_HPP
\ No newline at end of file
+#endif // CACHE_HPP
@@ -0,0 +1,172 @@
+#include "cache_control.hpp"
+#include <cctype>
+#include <climits>
+#include <strings.h>
+
+namespace {
+
+bool is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+
+bool iequals(std::string_view a, const char* b) {
+    size_t n = std::char_traits<char>::length(b);
+    return a.size() == n && strncasecmp(a.data(), b, n) == 0;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && is_ows(s.front())) s.remove_prefix(1);
+    while (!s.empty() && is_ows(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+/**
+ * delta-seconds; values too large to represent saturate at 2^31 (RFC 9111 section 1.2.2)
+ */
+long parse_delta(std::string_view s) {
+    if (s.empty()) {
+        return CacheControl::UNSET;
+    }
+    long value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return CacheControl::UNSET;
+        }
+        if (value < 2147483648L) {
+            value = value * 10 + (c - '0');
+        }
+    }
+    return value < 2147483648L ? value : 2147483648L;
+}
+
+// Keeps the smaller (more restrictive) of two delta-seconds values
+void merge_delta(long& slot, long value) {
+    if (value != CacheControl::UNSET && (slot == CacheControl::UNSET || value < slot)) {
+        slot = value;
+    }
+}
+
+void split_fields(std::string_view list, std::vector<std::string>& out) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view field = trim(list.substr(0, comma));
+        if (!field.empty()) {
+            // Field names are case-insensitive; keep them lowercase for lookups
+            std::string name(field);
+            for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            out.push_back(std::move(name));
+        }
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+/**
+ * Walks "directive [= token / quoted-string]" items separated by commas
+ *
+ * Commas inside quoted strings do not split items, and quoted-pair escapes are
+ * removed from the value handed to the callback.
+ */
+template <typename Fn>
+void for_each_directive(std::string_view header, Fn&& fn) {
+    size_t i = 0;
+    const size_t n = header.size();
+    while (i < n) {
+        while (i < n && (is_ows(header[i]) || header[i] == ',')) ++i;
+        size_t name_start = i;
+        while (i < n && header[i] != '=' && header[i] != ',' && !is_ows(header[i])) ++i;
+        std::string_view name = header.substr(name_start, i - name_start);
+        while (i < n && is_ows(header[i])) ++i;
+
+        std::string value;
+        bool has_value = false;
+        if (i < n && header[i] == '=') {
+            has_value = true;
+            ++i;
+            while (i < n && is_ows(header[i])) ++i;
+            if (i < n && header[i] == '"') {
+                ++i;
+                while (i < n && header[i] != '"') {
+                    if (header[i] == '\\' && i + 1 < n) ++i;
+                    value.push_back(header[i++]);
+                }
+                if (i < n) ++i;  // closing quote
+            } else {
+                size_t value_start = i;
+                while (i < n && header[i] != ',' && !is_ows(header[i])) ++i;
+                value.assign(header.substr(value_start, i - value_start));
+            }
+        }
+        // Skip anything malformed up to the next comma
+        while (i < n && header[i] != ',') ++i;
+
+        if (!name.empty()) {
+            fn(name, has_value, value);
+        }
+    }
+}
+
+} // namespace
+
+void CacheControl::parse(std::string_view value) {
+    seen_ = true;
+    if (pragma_no_cache_) {
+        // Pragma only stands in for a missing Cache-Control
+        pragma_no_cache_ = false;
+        no_cache = false;
+    }
+    for_each_directive(value, [this](std::string_view name, bool has_value, const std::string& arg) {
+        if (iequals(name, "no-store")) {
+            no_store = true;
+        } else if (iequals(name, "no-cache")) {
+            if (has_value) {
+                split_fields(arg, no_cache_fields);
+            } else {
+                no_cache = true;
+            }
+        } else if (iequals(name, "private")) {
+            if (has_value) {
+                split_fields(arg, private_fields);
+            } else {
+                is_private = true;
+            }
+        } else if (iequals(name, "public")) {
+            is_public = true;
+        } else if (iequals(name, "must-revalidate")) {
+            must_revalidate = true;
+        } else if (iequals(name, "proxy-revalidate")) {
+            proxy_revalidate = true;
+        } else if (iequals(name, "no-transform")) {
+            no_transform = true;
+        } else if (iequals(name, "immutable")) {
+            immutable = true;
+        } else if (iequals(name, "only-if-cached")) {
+            only_if_cached = true;
+        } else if (iequals(name, "max-age")) {
+            merge_delta(max_age, parse_delta(arg));
+        } else if (iequals(name, "s-maxage")) {
+            merge_delta(s_maxage, parse_delta(arg));
+        } else if (iequals(name, "max-stale")) {
+            merge_delta(max_stale, has_value ? parse_delta(arg) : LONG_MAX);
+        } else if (iequals(name, "min-fresh")) {
+            merge_delta(min_fresh, parse_delta(arg));
+        } else if (iequals(name, "stale-while-revalidate")) {
+            merge_delta(stale_while_revalidate, parse_delta(arg));
+        } else if (iequals(name, "stale-if-error")) {
+            merge_delta(stale_if_error, parse_delta(arg));
+        }
+        // Unknown extension directives are ignored
+    });
+}
+
+void CacheControl::parse_pragma(std::string_view value) {
+    if (seen_) {
+        return;
+    }
+    for_each_directive(value, [this](std::string_view name, bool, const std::string&) {
+        if (iequals(name, "no-cache")) {
+            pragma_no_cache_ = true;
+            no_cache = true;
+        }
+    });
+}
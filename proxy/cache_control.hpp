@@ -0,0 +1,59 @@
+#ifndef CACHE_CONTROL_HPP
+#define CACHE_CONTROL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Parsed Cache-Control (RFC 9111 section 5.2) and Pragma directives
+ *
+ * Directives are matched as whole, case-insensitive tokens, so "max-age" no
+ * longer matches inside "s-maxage" and the qualified form no-cache="Set-Cookie"
+ * is kept apart from an unqualified no-cache.
+ */
+struct CacheControl {
+    static constexpr long UNSET = -1;
+
+    bool no_store = false;
+    bool no_cache = false;           // Unqualified: every use needs revalidation
+    bool is_private = false;         // Unqualified: a shared cache must not store it
+    bool is_public = false;
+    bool must_revalidate = false;
+    bool proxy_revalidate = false;
+    bool no_transform = false;
+    bool immutable = false;
+    bool only_if_cached = false;     // Request directive
+
+    long max_age = UNSET;
+    long s_maxage = UNSET;
+    long max_stale = UNSET;          // Request directive; LONG_MAX when given without a value
+    long min_fresh = UNSET;          // Request directive
+    long stale_while_revalidate = UNSET;
+    long stale_if_error = UNSET;
+
+    // Lowercased field names from the qualified no-cache="..." and private="..." forms
+    std::vector<std::string> no_cache_fields;
+    std::vector<std::string> private_fields;
+
+    /**
+     * Adds the directives of one Cache-Control field value
+     *
+     * May be called once per header line; repeated directives keep the most
+     * restrictive value.
+     */
+    void parse(std::string_view value);
+
+    /**
+     * Applies a Pragma field value; "no-cache" counts only when no Cache-Control was seen
+     */
+    void parse_pragma(std::string_view value);
+
+    bool empty() const { return !seen_; }
+
+private:
+    bool seen_ = false;
+    bool pragma_no_cache_ = false;
+};
+
+#endif // CACHE_CONTROL_HPP
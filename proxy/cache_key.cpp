@@ -0,0 +1,236 @@
+#include "cache_key.hpp"
+#include <algorithm>
+#include <cctype>
+#include <random>
+
+namespace {
+
+bool is_unreserved(unsigned char c) {
+    return std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string lower(std::string_view s) {
+    std::string out(s);
+    for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+/**
+ * Decodes %XX escapes of unreserved characters and uppercases the others
+ */
+std::string normalize_percent(std::string_view s) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size()) {
+            int hi = hex_value(s[i + 1]);
+            int lo = hex_value(s[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                unsigned char decoded = static_cast<unsigned char>(hi * 16 + lo);
+                if (is_unreserved(decoded)) {
+                    out.push_back(static_cast<char>(decoded));
+                } else {
+                    out.push_back('%');
+                    out.push_back(digits[hi]);
+                    out.push_back(digits[lo]);
+                }
+                i += 2;
+                continue;
+            }
+        }
+        out.push_back(s[i]);
+    }
+    return out;
+}
+
+/**
+ * remove_dot_segments from RFC 3986 section 5.2.4
+ */
+std::string remove_dot_segments(std::string_view in) {
+    std::string out;
+    while (!in.empty()) {
+        if (in.substr(0, 3) == "../") {
+            in.remove_prefix(3);
+        } else if (in.substr(0, 2) == "./") {
+            in.remove_prefix(2);
+        } else if (in.substr(0, 3) == "/./") {
+            in.remove_prefix(2);
+        } else if (in == "/.") {
+            in = "/";
+        } else if (in.substr(0, 4) == "/../" || in == "/..") {
+            in = (in.size() == 3) ? std::string_view("/") : in.substr(3);
+            size_t slash = out.rfind('/');
+            out.erase(slash == std::string::npos ? 0 : slash);
+        } else if (in == "." || in == "..") {
+            in = std::string_view();
+        } else {
+            size_t next = in.find('/', 1);
+            if (next == std::string_view::npos) next = in.size();
+            out.append(in.substr(0, next));
+            in.remove_prefix(next);
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+std::string CacheKeyBuilder::normalizeUrl(std::string_view scheme, std::string_view host,
+                                          std::string_view port, std::string_view target) {
+    std::string norm_scheme = lower(scheme.empty() ? std::string_view("http") : scheme);
+
+    // Absolute-form targets carry their own scheme and authority
+    size_t sep = target.find("://");
+    if (sep != std::string_view::npos && target.find('/') > sep) {
+        norm_scheme = lower(target.substr(0, sep));
+        std::string_view rest = target.substr(sep + 3);
+        size_t path_start = rest.find_first_of("/?#");
+        std::string_view authority = rest.substr(0, path_start);
+        target = (path_start == std::string_view::npos) ? std::string_view() : rest.substr(path_start);
+
+        size_t at = authority.rfind('@');
+        if (at != std::string_view::npos) authority.remove_prefix(at + 1);  // Drop userinfo
+        size_t colon = authority.rfind(':');
+        if (colon != std::string_view::npos && authority.find(']', colon) == std::string_view::npos) {
+            host = authority.substr(0, colon);
+            port = authority.substr(colon + 1);
+        } else {
+            host = authority;
+            port = std::string_view();
+        }
+    }
+
+    std::string url = norm_scheme + "://" + lower(host);
+    std::string default_port = (norm_scheme == "https") ? "443" : "80";
+    if (!port.empty() && port != default_port) {
+        url += ":";
+        url += std::string(port);
+    }
+
+    size_t fragment = target.find('#');
+    if (fragment != std::string_view::npos) target = target.substr(0, fragment);
+    size_t query_start = target.find('?');
+    std::string_view path = target.substr(0, query_start);
+    std::string_view query = (query_start == std::string_view::npos) ? std::string_view() : target.substr(query_start);
+
+    std::string norm_path = remove_dot_segments(normalize_percent(path));
+    url += norm_path.empty() ? "/" : norm_path;
+    url += normalize_percent(query);
+    return url;
+}
+
+std::string CacheKeyBuilder::normalizeUrl(const Request& request) {
+    return normalizeUrl(request.get_scheme(), request.get_hostname(), request.get_port(), request.get_uri());
+}
+
+uint64_t CacheKeyBuilder::seed() {
+    static const uint64_t value = [] {
+        std::random_device random;
+        return (static_cast<uint64_t>(random()) << 32) | random();
+    }();
+    return value;
+}
+
+CacheKey CacheKeyBuilder::primary(const Request& request) {
+    return primary(request.get_method(), normalizeUrl(request));
+}
+
+CacheKey CacheKeyBuilder::primary(std::string_view method, std::string_view url) {
+    return utils::Hasher128(seed()).field(method).field(url).finish();
+}
+
+std::string CacheKeyBuilder::keyText(std::string_view method, std::string_view url,
+                                     const std::vector<std::string>& vary, const Request& request) {
+    std::string text;
+    text.reserve(method.size() + url.size() + 1);
+    text.append(method).append(" ").append(url);
+    for (const std::string& name : vary) {
+        text.append("\n").append(name).append(": ").append(normalizeHeaderValue(name, request.get_header(name)));
+    }
+    return text;
+}
+
+CacheKey CacheKeyBuilder::variant(const CacheKey& primary, const std::vector<std::string>& vary,
+                                  const Request& request) {
+    if (vary.empty()) {
+        return primary;
+    }
+    utils::Hasher128 hasher(seed());
+    hasher.update(&primary, sizeof(primary));
+    for (const std::string& name : vary) {
+        hasher.field(name);
+        hasher.field(normalizeHeaderValue(name, request.get_header(name)));
+    }
+    return hasher.finish();
+}
+
+bool CacheKeyBuilder::parseVary(std::string_view value, std::vector<std::string>& names) {
+    names.clear();
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = trim(value.substr(0, comma));
+        if (item == "*") {
+            names.clear();
+            return false;
+        }
+        if (!item.empty()) {
+            names.push_back(lower(item));
+        }
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return true;
+}
+
+std::string CacheKeyBuilder::normalizeHeaderValue(std::string_view name, std::string_view value) {
+    // Accept-* lists are case-insensitive and order-independent (each member carries its own q)
+    bool is_accept_list = name.substr(0, 7) == "accept-" || name == "accept";
+
+    std::vector<std::string> members;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = trim(value.substr(0, comma));
+        if (!item.empty()) {
+            // Accept-* members drop their whitespace ("gzip ; q=1" -> "gzip;q=1");
+            // other values only collapse runs of it to one space
+            std::string member;
+            for (char c : item) {
+                bool space = (c == ' ' || c == '\t');
+                if (!space) {
+                    member.push_back(c);
+                } else if (!is_accept_list && member.back() != ' ') {
+                    member.push_back(' ');
+                }
+            }
+            members.push_back(is_accept_list ? lower(member) : member);
+        }
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    if (is_accept_list) {
+        std::sort(members.begin(), members.end());
+    }
+
+    std::string out;
+    for (size_t i = 0; i < members.size(); ++i) {
+        if (i > 0) out.push_back(',');
+        out += members[i];
+    }
+    return out;
+}
@@ -0,0 +1,78 @@
+#ifndef CACHE_KEY_HPP
+#define CACHE_KEY_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "request.hpp"
+#include "utils/hash.hpp"
+
+/**
+ * 128-bit digest identifying a cached response
+ *
+ * The primary key covers the normalized URL; a variant key additionally covers
+ * the request headers selected by the stored response's Vary header. Keys are
+ * hashed with a random per-process seed, so they cannot be predicted from
+ * outside, and an entry also keeps its keyText() for checking a hit.
+ */
+using CacheKey = utils::Hash128;
+
+class CacheKeyBuilder {
+public:
+    /**
+     * Normalizes a request URL per RFC 3986 section 6
+     *
+     * Lowercases scheme and host, drops the scheme's default port, decodes
+     * percent-encoded unreserved characters, uppercases remaining escapes,
+     * removes dot segments and the fragment, and defaults an empty path to "/".
+     *
+     * @return "scheme://host[:port]/path[?query]"
+     */
+    static std::string normalizeUrl(std::string_view scheme, std::string_view host,
+                                    std::string_view port, std::string_view target);
+    static std::string normalizeUrl(const Request& request);
+
+    /**
+     * Key for the normalized URL alone
+     */
+    static CacheKey primary(const Request& request);
+    static CacheKey primary(std::string_view method, std::string_view url);
+
+    /**
+     * Key for one variant of a primary key
+     *
+     * @param vary Lowercased header names from the response's Vary, as returned by parseVary()
+     * @return The primary key itself when vary is empty
+     */
+    static CacheKey variant(const CacheKey& primary, const std::vector<std::string>& vary,
+                            const Request& request);
+
+    /**
+     * What a variant key stands for, as text: method, normalized URL and the
+     * selected request header values. Equal keys with unequal text are a
+     * hash collision.
+     */
+    static std::string keyText(std::string_view method, std::string_view url,
+                               const std::vector<std::string>& vary, const Request& request);
+
+    /**
+     * Parses a Vary field value into sorted, lowercased, de-duplicated header names
+     *
+     * @return False for "Vary: *", which can never be matched by a cache
+     */
+    static bool parseVary(std::string_view value, std::vector<std::string>& names);
+
+    /**
+     * Canonical form of a request header value for variant matching
+     */
+    static std::string normalizeHeaderValue(std::string_view name, std::string_view value);
+
+private:
+    /**
+     * Hash seed drawn from std::random_device on first use
+     */
+    static uint64_t seed();
+};
+
+#endif // CACHE_KEY_HPP
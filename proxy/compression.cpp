@@ -0,0 +1,285 @@
+#include "compression.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <strings.h>
+
+namespace {
+
+const size_t OUT_PIECE = 16 * 1024;
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool ends_with(std::string_view s, std::string_view suffix) {
+    return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+}
+
+bool gzip_compress(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    z_stream zs = {};
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, size));
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = out.data();
+    zs.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+bool gzip_decompress(const std::function<std::string_view()>& next_piece,
+                     const std::function<bool(const char*, size_t)>& sink) {
+    z_stream zs = {};
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return false;
+    }
+    unsigned char out[OUT_PIECE];
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        std::string_view piece = next_piece();
+        if (piece.empty()) {
+            break;
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece.data()));
+        zs.avail_in = static_cast<uInt>(piece.size());
+        while (zs.avail_in > 0 && rc != Z_STREAM_END) {
+            zs.next_out = out;
+            zs.avail_out = sizeof(out);
+            rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END) {
+                inflateEnd(&zs);
+                return false;
+            }
+            size_t produced = sizeof(out) - zs.avail_out;
+            if (produced > 0 && !sink(reinterpret_cast<const char*>(out), produced)) {
+                inflateEnd(&zs);
+                return false;
+            }
+        }
+    }
+    // Drain output still buffered inside zlib after the last input piece
+    while (rc == Z_OK) {
+        zs.next_out = out;
+        zs.avail_out = sizeof(out);
+        rc = inflate(&zs, Z_FINISH);
+        size_t produced = sizeof(out) - zs.avail_out;
+        if (produced == 0) {
+            break;
+        }
+        if (!sink(reinterpret_cast<const char*>(out), produced)) {
+            inflateEnd(&zs);
+            return false;
+        }
+    }
+    inflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+#ifdef HAVE_ZSTD
+bool zstd_compress(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    out.resize(ZSTD_compressBound(size));
+    size_t n = ZSTD_compress(out.data(), out.size(), data, size, level);
+    if (ZSTD_isError(n)) {
+        return false;
+    }
+    out.resize(n);
+    return true;
+}
+
+bool zstd_decompress(const std::function<std::string_view()>& next_piece,
+                     const std::function<bool(const char*, size_t)>& sink) {
+    ZSTD_DStream* ds = ZSTD_createDStream();
+    if (!ds) {
+        return false;
+    }
+    ZSTD_initDStream(ds);
+    char out[OUT_PIECE];
+    size_t rc = 1;
+    for (std::string_view piece = next_piece(); !piece.empty(); piece = next_piece()) {
+        ZSTD_inBuffer in = {piece.data(), piece.size(), 0};
+        while (in.pos < in.size) {
+            ZSTD_outBuffer ob = {out, sizeof(out), 0};
+            rc = ZSTD_decompressStream(ds, &ob, &in);
+            if (ZSTD_isError(rc) || (ob.pos > 0 && !sink(out, ob.pos))) {
+                ZSTD_freeDStream(ds);
+                return false;
+            }
+        }
+    }
+    ZSTD_freeDStream(ds);
+    return rc == 0;  // 0 once a frame is fully decoded and flushed
+}
+#endif
+
+struct StatsRegistry {
+    std::mutex mutex;
+    std::map<std::string, compression::TypeStats> by_type;
+};
+
+StatsRegistry& registry() {
+    static StatsRegistry* instance = new StatsRegistry();
+    return *instance;
+}
+
+} // namespace
+
+namespace compression {
+
+const char* name(Coding coding) {
+    switch (coding) {
+        case Coding::Gzip: return "gzip";
+        case Coding::Zstd: return "zstd";
+        default: return "identity";
+    }
+}
+
+bool available(Coding coding) {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return coding != Coding::Zstd;
+#endif
+}
+
+Policy Policy::from_config() {
+    Policy policy;
+    std::string coding = Config::get_string("PROXY_COMPRESSION", "gzip");
+    if (coding == "off" || coding == "identity" || coding == "none") {
+        policy.coding = Coding::Identity;
+    } else if (coding == "zstd" && available(Coding::Zstd)) {
+        policy.coding = Coding::Zstd;
+    } else {
+        policy.coding = Coding::Gzip;  // Also the fallback when zstd isn't built in
+    }
+    policy.level = static_cast<int>(Config::get_long("PROXY_COMPRESSION_LEVEL", policy.level));
+    policy.min_size = static_cast<size_t>(Config::get_long("PROXY_COMPRESSION_MIN_SIZE", policy.min_size));
+    return policy;
+}
+
+const Policy& Policy::global() {
+    static const Policy policy = from_config();
+    return policy;
+}
+
+bool compressible_type(std::string_view content_type) {
+    std::string type(trim(content_type.substr(0, content_type.find(';'))));
+    for (char& c : type) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    if (type.compare(0, 5, "text/") == 0) {
+        return type != "text/event-stream";  // Streamed; never complete enough to store compressed
+    }
+    static const char* const types[] = {
+        "application/javascript", "application/x-javascript", "application/ecmascript",
+        "application/json", "application/xml", "application/wasm", "image/svg+xml",
+        "image/x-icon", "image/vnd.microsoft.icon", "font/ttf", "font/otf",
+    };
+    for (const char* t : types) {
+        if (type == t) return true;
+    }
+    return ends_with(type, "+json") || ends_with(type, "+xml");
+}
+
+bool accepts(std::string_view accept_encoding, Coding coding) {
+    if (coding == Coding::Identity) {
+        return true;
+    }
+    std::string_view wanted = name(coding);
+    double explicit_q = -1, wildcard_q = -1;
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = trim(accept_encoding.substr(0, comma));
+        size_t semi = item.find(';');
+        std::string_view token = trim(item.substr(0, semi));
+        double q = 1;
+        if (semi != std::string_view::npos) {
+            std::string_view param = trim(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                q = std::atof(std::string(param.substr(2)).c_str());
+            }
+        }
+        if (iequals(token, wanted) || (coding == Coding::Gzip && iequals(token, "x-gzip"))) {
+            explicit_q = q;
+        } else if (token == "*") {
+            wildcard_q = q;
+        }
+        if (comma == std::string_view::npos) break;
+        accept_encoding.remove_prefix(comma + 1);
+    }
+    return explicit_q >= 0 ? explicit_q > 0 : wildcard_q > 0;
+}
+
+bool compress(Coding coding, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    bool ok = false;
+    if (coding == Coding::Gzip) {
+        ok = gzip_compress(level, data, size, out);
+    }
+#ifdef HAVE_ZSTD
+    if (coding == Coding::Zstd) {
+        ok = zstd_compress(level, data, size, out);
+    }
+#endif
+    return ok && out.size() < size;
+}
+
+bool decompress(Coding coding, const std::function<std::string_view()>& next_piece,
+                const std::function<bool(const char*, size_t)>& sink) {
+    if (coding == Coding::Gzip) {
+        return gzip_decompress(next_piece, sink);
+    }
+#ifdef HAVE_ZSTD
+    if (coding == Coding::Zstd) {
+        return zstd_decompress(next_piece, sink);
+    }
+#endif
+    return false;
+}
+
+void record_stored(std::string_view content_type, size_t original, size_t stored) {
+    std::string type(trim(content_type.substr(0, content_type.find(';'))));
+    for (char& c : type) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    TypeStats& entry = stats.by_type[type];
+    entry.content_type = type;
+    ++entry.bodies;
+    entry.original_bytes += original;
+    entry.stored_bytes += stored;
+}
+
+void record_served(bool compressed, size_t sent, size_t identity) {
+    (compressed ? metrics::compression_hits_compressed : metrics::compression_hits_inflated).inc();
+    metrics::compression_sent_bytes.inc(static_cast<int64_t>(sent));
+    metrics::compression_identity_bytes.inc(static_cast<int64_t>(identity));
+}
+
+std::vector<TypeStats> type_stats() {
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    std::vector<TypeStats> out;
+    for (const auto& entry : stats.by_type) {
+        out.push_back(entry.second);
+    }
+    return out;
+}
+
+} // namespace compression
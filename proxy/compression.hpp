@@ -0,0 +1,97 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Cache-side body compression
+ *
+ * Eligible text bodies are compressed once when stored. A hit is served in
+ * the stored coding to clients whose Accept-Encoding allows it and is
+ * inflated on the fly for the rest. gzip uses zlib; zstd is available when
+ * the proxy is built with HAVE_ZSTD.
+ */
+namespace compression {
+
+enum class Coding { Identity, Gzip, Zstd };
+
+/**
+ * Content-coding token ("gzip", "zstd"; "identity" for none)
+ */
+const char* name(Coding coding);
+
+/**
+ * Whether this build can produce and decode the coding
+ */
+bool available(Coding coding);
+
+/**
+ * Settings read once from PROXY_COMPRESSION, PROXY_COMPRESSION_LEVEL and
+ * PROXY_COMPRESSION_MIN_SIZE
+ */
+struct Policy {
+    Coding coding = Coding::Gzip;  // Identity disables compression
+    int level = 6;                 // zlib 1..9; zstd 1..19
+    size_t min_size = 256;         // Smaller bodies gain too little to bother
+
+    static Policy from_config();
+    static const Policy& global();
+};
+
+/**
+ * Text media types worth compressing (HTML, CSS, JavaScript, JSON, XML, SVG, ...)
+ *
+ * @param content_type Content-Type field value; parameters are ignored
+ */
+bool compressible_type(std::string_view content_type);
+
+/**
+ * Whether an Accept-Encoding field value allows the coding (q > 0, directly or via "*")
+ */
+bool accepts(std::string_view accept_encoding, Coding coding);
+
+/**
+ * Compresses a whole body
+ *
+ * @return False on codec failure or if the result is not smaller than the input
+ */
+bool compress(Coding coding, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+/**
+ * Decompresses a body given as a sequence of pieces, streaming the output
+ *
+ * @param next_piece Returns the next input piece; an empty view ends the input
+ * @param sink Receives output pieces; returning false aborts
+ * @return False on corrupt input, truncated input or an aborted sink
+ */
+bool decompress(Coding coding, const std::function<std::string_view()>& next_piece,
+                const std::function<bool(const char*, size_t)>& sink);
+
+/**
+ * Running totals for one media type
+ */
+struct TypeStats {
+    std::string content_type;
+    size_t bodies = 0;
+    size_t original_bytes = 0;
+    size_t stored_bytes = 0;
+
+    double ratio() const { return original_bytes ? double(stored_bytes) / original_bytes : 1.0; }
+};
+
+/**
+ * Thread-safe. record_served runs on every hit on a compressed entry and
+ * only bumps metrics counters; record_stored locks the per-type table.
+ */
+void record_stored(std::string_view content_type, size_t original, size_t stored);
+void record_served(bool compressed, size_t sent, size_t identity);
+std::vector<TypeStats> type_stats();
+
+} // namespace compression
+
+#endif // COMPRESSION_HPP
@@ -0,0 +1,70 @@
+#include "config.hpp"
+#include <cstdlib>
+#include <cerrno>
+#include <strings.h>
+
+std::string Config::get_string(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return (value != nullptr && *value != '\0') ? std::string(value) : fallback;
+}
+
+long Config::get_long(const char* name, long fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(value, &end, 10);
+    return (errno == 0 && *end == '\0') ? parsed : fallback;
+}
+
+double Config::get_double(const char* name, double fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    char* end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(value, &end);
+    return (errno == 0 && *end == '\0') ? parsed : fallback;
+}
+
+bool Config::get_bool(const char* name, bool fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    if (strcasecmp(value, "1") == 0 || strcasecmp(value, "true") == 0 ||
+        strcasecmp(value, "yes") == 0 || strcasecmp(value, "on") == 0) {
+        return true;
+    }
+    if (strcasecmp(value, "0") == 0 || strcasecmp(value, "false") == 0 ||
+        strcasecmp(value, "no") == 0 || strcasecmp(value, "off") == 0) {
+        return false;
+    }
+    return fallback;
+}
+
+std::unordered_map<long, long> Config::get_long_map(const char* name) {
+    std::unordered_map<long, long> result;
+    std::string list = get_string(name, "");
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        size_t eq = item.find('=');
+        if (eq != std::string::npos) {
+            char* end = nullptr;
+            long key = std::strtol(item.c_str(), &end, 10);
+            bool key_ok = (end == item.c_str() + eq);
+            long value = std::strtol(item.c_str() + eq + 1, &end, 10);
+            if (key_ok && *end == '\0') {
+                result[key] = value;
+            }
+        }
+        pos = comma + 1;
+    }
+    return result;
+}
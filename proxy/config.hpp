@@ -0,0 +1,26 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * Startup configuration read from PROXY_* environment variables
+ *
+ * Every setting has a built-in default, so the proxy runs unconfigured.
+ * Malformed values are ignored in favour of the default.
+ */
+class Config {
+public:
+    static std::string get_string(const char* name, const std::string& fallback);
+    static long get_long(const char* name, long fallback);
+    static double get_double(const char* name, double fallback);
+    static bool get_bool(const char* name, bool fallback);
+
+    /**
+     * Parses a "key=value,key=value" list of integers, e.g. PROXY_DEFAULT_TTL="404=60,301=86400"
+     */
+    static std::unordered_map<long, long> get_long_map(const char* name);
+};
+
+#endif // CONFIG_HPP
@@ -0,0 +1,80 @@
+#include "freshness.hpp"
+#include "config.hpp"
+#include <algorithm>
+
+FreshnessPolicy FreshnessPolicy::from_config() {
+    FreshnessPolicy policy;
+    policy.heuristic_fraction = Config::get_double("PROXY_HEURISTIC_FRACTION", policy.heuristic_fraction);
+    policy.heuristic_max = Config::get_long("PROXY_HEURISTIC_MAX", policy.heuristic_max);
+    policy.default_ttl = Config::get_long_map("PROXY_DEFAULT_TTL");
+    return policy;
+}
+
+const FreshnessPolicy& FreshnessPolicy::global() {
+    static const FreshnessPolicy policy = from_config();
+    return policy;
+}
+
+namespace freshness {
+
+bool heuristically_cacheable(int status) {
+    switch (status) {
+        case 200: case 203: case 204: case 206:
+        case 300: case 301: case 308:
+        case 404: case 405: case 410: case 414:
+        case 501:
+            return true;
+        default:
+            return false;
+    }
+}
+
+time_t corrected_initial_age(const FreshnessInputs& in) {
+    time_t date = in.date != 0 ? in.date : in.response_time;
+    time_t apparent_age = std::max<time_t>(0, in.response_time - date);
+    time_t response_delay = std::max<time_t>(0, in.response_time - in.request_time);
+    time_t corrected_age_value = in.age + response_delay;
+    return std::max(apparent_age, corrected_age_value);
+}
+
+long lifetime(const FreshnessInputs& in, const CacheControl& cc, const FreshnessPolicy& policy,
+              bool& heuristic) {
+    heuristic = false;
+
+    // Explicit expiration: s-maxage applies to shared caches only, then max-age, then Expires
+    if (cc.s_maxage != CacheControl::UNSET) {
+        return cc.s_maxage;
+    }
+    if (cc.max_age != CacheControl::UNSET) {
+        return cc.max_age;
+    }
+    if (in.has_expires) {
+        // An invalid Expires value (e.g. "0") means already expired
+        if (in.expires == 0) {
+            return 0;
+        }
+        time_t date = in.date != 0 ? in.date : in.response_time;
+        return std::max<long>(0, static_cast<long>(in.expires - date));
+    }
+
+    // Heuristic freshness is only allowed for these statuses, or when marked public
+    if (!heuristically_cacheable(in.status) && !cc.is_public) {
+        return 0;
+    }
+    heuristic = true;
+    if (in.last_modified != 0) {
+        time_t date = in.date != 0 ? in.date : in.response_time;
+        if (date > in.last_modified) {
+            long estimate = static_cast<long>((date - in.last_modified) * policy.heuristic_fraction);
+            return std::min(estimate, policy.heuristic_max);
+        }
+    }
+    auto it = policy.default_ttl.find(in.status);
+    if (it != policy.default_ttl.end()) {
+        return std::max<long>(0, it->second);
+    }
+    heuristic = false;
+    return 0;
+}
+
+} // namespace freshness
@@ -0,0 +1,67 @@
+#ifndef FRESHNESS_HPP
+#define FRESHNESS_HPP
+
+#include <ctime>
+#include <unordered_map>
+#include "cache_control.hpp"
+
+/**
+ * Tunables used when a response carries no explicit expiration time
+ */
+struct FreshnessPolicy {
+    double heuristic_fraction = 0.1;  // Share of (Date - Last-Modified) granted as lifetime
+    long heuristic_max = 86400;       // Upper bound on a heuristic lifetime, in seconds
+    std::unordered_map<long, long> default_ttl;  // Per-status lifetime when nothing else applies
+
+    /**
+     * Loads PROXY_HEURISTIC_FRACTION, PROXY_HEURISTIC_MAX and PROXY_DEFAULT_TTL
+     */
+    static FreshnessPolicy from_config();
+
+    /**
+     * Process-wide policy, loaded from the environment on first use
+     */
+    static const FreshnessPolicy& global();
+};
+
+/**
+ * Inputs for one response, gathered while parsing it
+ */
+struct FreshnessInputs {
+    int status = 0;
+    time_t request_time = 0;   // When the request was sent upstream
+    time_t response_time = 0;  // When the response headers arrived
+    time_t date = 0;           // Date header (0 if absent)
+    time_t age = 0;            // Age header (0 if absent)
+    bool has_expires = false;
+    time_t expires = 0;        // Expires header (0 if present but invalid)
+    time_t last_modified = 0;  // Last-Modified header (0 if absent)
+};
+
+/**
+ * RFC 9111 section 4.2 freshness calculations for a shared cache
+ */
+namespace freshness {
+
+/**
+ * Status codes a cache may store and reuse with a heuristic lifetime (RFC 9110 section 15.1)
+ */
+bool heuristically_cacheable(int status);
+
+/**
+ * corrected_initial_age from section 4.2.3
+ */
+time_t corrected_initial_age(const FreshnessInputs& in);
+
+/**
+ * freshness_lifetime from sections 4.2.1 and 4.2.2
+ *
+ * @param heuristic Set when the lifetime came from Last-Modified or a default TTL
+ * @return Lifetime in seconds; 0 means stale on arrival
+ */
+long lifetime(const FreshnessInputs& in, const CacheControl& cc, const FreshnessPolicy& policy,
+              bool& heuristic);
+
+} // namespace freshness
+
+#endif // FRESHNESS_HPP
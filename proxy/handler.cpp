@@ -1,9 +1,23 @@
 #include "handler.hpp"
 #include "log.hpp"
+#include "http_scanner.hpp"
+#include "http_date.hpp"
+#include "freshness.hpp"
+#include "compression.hpp"
+#include "range.hpp"
+#include "config.hpp"
+#include "access_log.hpp"
+#include "metrics.hpp"
+#include "lingering.hpp"
+#include "timeouts.hpp"
+#include <optional>
+#include <charconv>
+#include <strings.h>
 #include <iostream>
 #include <unistd.h>
 #include <sstream>
 #include <cstring>
+#include <cctype>
 #include <iomanip>
 #include <poll.h>
 #include <algorithm>
@@ -11,14 +25,23 @@
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 #include <thread>
+#include <mutex>
+#include <unordered_set>
+#include <climits>
+#include <cmath>
+#include <sys/socket.h>
 
 using namespace std;
 
 extern boost::asio::thread_pool * global_thread_pool;
 
 // Initialize the global logger and cache
-Log* proxy_logger = nullptr; 
 Cache* proxy_cache = nullptr;
+NegativeCache* proxy_negative_cache = nullptr;
+AdmissionControl* proxy_admission = nullptr;
+RateLimiter* proxy_client_limiter = nullptr;
+RateLimiter* proxy_origin_limiter = nullptr;
+UpstreamScheduler* proxy_upstream = nullptr;
 
 // Generate a unique request ID
 string Handler::generateUniqueID() {
@@ -28,11 +51,7 @@ string Handler::generateUniqueID() {
 
 // Get current time string in UTC format
 string Handler::getCurrentTimeStr() {
-    auto now = chrono::system_clock::now();
-    time_t now_time = chrono::system_clock::to_time_t(now);
-    string time_str = asctime(gmtime(&now_time));
-    time_str.erase(time_str.find('\n')); // Remove trailing newline
-    return time_str;
+    return string(CoarseClock::log_time_str().view());
 }
 
 /**
@@ -57,21 +76,35 @@ string Handler::getCurrentTimeStr() {
             return false;  // Error occurred
         }
         total_sent += sent;
+        access_log::Current::sent(fd, static_cast<size_t>(sent));
     }
     return true;
 }
 
 bool Handler::create_connection_thread(std::shared_ptr<ISocket> client_socket, string id) {
+    // Past what admission could ever process or queue, shed before starting a thread
+    if (proxy_admission && !proxy_admission->enter()) {
+        metrics::admission_shed_connections.inc();
+        sendOverloaded(client_socket->getSocketFd(), id);
+        lingering::close(client_socket);
+        return false;
+    }
+
     ThreadData *thread_data = new ThreadData();
     thread_data->client_socket = client_socket;  // Store the shared_ptr directly
     thread_data->id = id;
+    thread_data->accepted = std::chrono::steady_clock::now();
+    thread_data->claimed = proxy_admission != nullptr;
 
     pthread_t thread;
     if (pthread_create(&thread, NULL, handle_connection, thread_data) != 0) {
-        cerr << "[Error] failed to create thread" << endl;
-        proxy_logger->write("(no-id): ERROR failed to create thread");
+        LOG_ERROR("(no-id)", "failed to create thread");
+        if (thread_data->claimed) proxy_admission->leave();
         delete thread_data;
-        // No need to manually close the socket - shared_ptr will handle it
+        // Out of threads is overload too; answer rather than just drop the socket
+        metrics::admission_shed_no_thread.inc();
+        sendOverloaded(client_socket->getSocketFd(), id);
+        lingering::close(client_socket);
         return false;
     }
     pthread_detach(thread);
@@ -80,14 +113,14 @@ bool Handler::create_connection_thread(std::shared_ptr<ISocket> client_socket, s
 
 bool Handler::post_thread_pool(std::shared_ptr<ISocket> client_socket, string id) {
     if (global_thread_pool == nullptr) {
-        cerr << "[Error] Thread pool not initialized" << endl;
-        if (proxy_logger) proxy_logger->write("(no-id): ERROR Thread pool not initialized");
+        LOG_ERROR("(no-id)", "Thread pool not initialized");
         return false;
     }
     
     ThreadData *thread_data = new ThreadData();
     thread_data->client_socket = client_socket;
     thread_data->id = id;
+    thread_data->accepted = std::chrono::steady_clock::now();
 
     boost::asio::post(*global_thread_pool, [thread_data]() {
         handle_connection(thread_data);
@@ -97,117 +130,191 @@ bool Handler::post_thread_pool(std::shared_ptr<ISocket> client_socket, string id
 }
 
 void* Handler::handle_connection(void* arg) {
-    cerr << "[DEBUG] Starting handle_connection" << endl;
     // 1. Convert argument type
     ThreadData* data = (ThreadData*)arg;
     string id = data->id;
 
     std::shared_ptr<ISocket> client_socket = data->client_socket;
     int client_fd = client_socket->getSocketFd(); // Get FD only when needed
-    
-    cerr << "[Note] handling connection " << id << endl;
+    access_log::Scope access(id, client_fd, data->accepted);
+    metrics::ScopedGauge connection(metrics::active_connections);
+    ConnectionClaim claim(data->claimed ? proxy_admission : nullptr);
+    // Bounds everything below, including waits on the origin
+    timeouts::Deadline request_deadline(client_fd, timeouts::Kind::Request);
+    LOG_TRACE(id, "handling connection");
     
     try {
-        // 2. Read data from client
-        vector<uint8_t> buffer(BUFFER_SIZE);
-        
-        ssize_t bytes_read = recv(client_fd, buffer.data(), buffer.size(), 0);
-        
-        if (bytes_read < 0) {
-            cerr << "[Error] recv() failed: " << strerror(errno) << " (errno: " << errno << ")" << endl;
-            proxy_logger->write(id + ": ERROR Failed to read from client");
-            close(client_fd);
+        // 2. Read data from client until the end of the headers, so a client
+        // trickling them in is cut off by the header deadline
+        string request_str;
+        ssize_t bytes_read = 0;
+        bool header_timeout = false;
+        {
+            timeouts::Deadline header_deadline(client_fd, timeouts::Kind::HeaderRead);
+            char buffer[BUFFER_SIZE];
+            size_t scan_from = 0;
+            while (request_str.size() < MAX_REQUEST_HEADER_BYTES) {
+                bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
+                if (bytes_read <= 0) {
+                    break;
+                }
+                access_log::Current::received(static_cast<size_t>(bytes_read));
+                request_str.append(buffer, static_cast<size_t>(bytes_read));
+                if (http_scan::find_header_end(request_str.data(), request_str.size(), scan_from) != http_scan::npos) {
+                    break;
+                }
+            }
+            header_timeout = header_deadline.expired();
+        }
+
+        if (header_timeout) {
+            LOG_WARNING(id, "Client sent no complete request headers in time");
+            sendErrorResponse(client_fd, 408, "Request Timeout", id);
+            request_deadline.cancel();
+            lingering::close(client_socket);
+            delete data;
+            return NULL;
+        } else if (request_str.empty() && bytes_read < 0) {
+            LOG_ERROR(id, "Failed to read from client: " + string(strerror(errno)));
+            request_deadline.cancel();
+            lingering::close(client_socket);
             delete data;
             return NULL;
-        } else if (bytes_read == 0) {
-            proxy_logger->write(id + ": Client closed connection");
-            close(client_fd);
+        } else if (request_str.empty()) {
+            LOG_INFO(id, "Client closed connection");
+            request_deadline.cancel();
+            lingering::close(client_socket);
             delete data;
             return NULL;
         }
         
-        // Convert received data to string for request parsing
-        string request_str(buffer.begin(), buffer.begin() + bytes_read);
-        
         // 3. Parse the HTTP request
         Request request;
         try {
             request = Request(request_str);
             request.parse();
         } catch (const InvalidRequest& e) {
-            proxy_logger->write(id + ": ERROR Invalid request format");
+            LOG_ERROR(id, "Invalid request format");
             sendErrorResponse(client_fd, 400, "Bad Request", id);
-            close(client_fd);
+            request_deadline.cancel();
+            lingering::close(client_socket);
             delete data;
             return NULL;
         }
         
+        access_log::Current::mark(access_log::PARSED);
+        access_log::Current::request(request.get_method(), request.get_hostname());
+
         // 4. Log the received request
         string client_ip = client_socket->getRemoteAddress();
-        string log_entry = id + ": \"" + request.get_line() + "\" from " + client_ip + " @ " + getCurrentTimeStr();
-        proxy_logger->write(log_entry);
+        LOG_INFO(id, "\"" + request.get_line() + "\" from " + client_ip + " @ " + getCurrentTimeStr());
         
-        // 5. Process the request based on its method
+        // 5. Per-client and per-origin limits, then a processing slot.
+        // CONNECT tunnels last as long as the client likes, so they take no slot
         bool success = false;
         string method = request.get_method();
-        
-        if (method == "GET") {
-            success = processGetRequest(client_fd, request, id);
+        RateLimiter::Permit client_permit, origin_permit;
+        bool admitted = checkRateLimit(client_fd, proxy_client_limiter, client_ip, client_permit, id) &&
+                        checkRateLimit(client_fd, proxy_origin_limiter, request.get_hostname(), origin_permit, id);
+        bool limited = !admitted;
+        CacheLookup lookup;
+        if (admitted && method == "GET") {
+            lookup = lookupCache(request);
+        }
+        std::optional<AdmissionTicket> slot;
+        if (admitted && proxy_admission && method != "CONNECT") {
+            AdmissionControl::Result admission = proxy_admission->acquire(admissionPriority(lookup));
+            if (admission == AdmissionControl::Result::Admitted) {
+                slot.emplace(proxy_admission);
+            } else {
+                admitted = false;
+                (admission == AdmissionControl::Result::QueueFull ? metrics::admission_shed_queue_full
+                                                                  : metrics::admission_shed_timeout).inc();
+            }
+        }
+
+        // 6. Process the request based on its method
+        if (limited) {
+            success = true;  // Already answered 429
+        } else if (!admitted) {
+            sendOverloaded(client_fd, id);
+            success = true;
+        } else if (method == "GET") {
+            metrics::requests_get.inc();
+            success = processGetRequest(client_fd, request, lookup, id);
         } else if (method == "POST") {
+            metrics::requests_post.inc();
             success = processPostRequest(client_fd, request, id);
         } else if (method == "CONNECT") {
+            metrics::requests_connect.inc();
+            request_deadline.cancel();  // A tunnel lasts while there is traffic; it has its own idle timeout
+            claim.leave();  // Tunnels are not admission controlled
             success = processConnectRequest(client_fd, request, id);
         } else {
+            metrics::requests_other.inc();
             // Unsupported method
-            proxy_logger->write(id + ": WARNING Unsupported method: " + method);
+            LOG_WARNING(id, "Unsupported method: " + method);
             sendErrorResponse(client_fd, 501, "Not Implemented", id);
         }
         
         if (!success) {
-            proxy_logger->write(id + ": ERROR Request handling failed");
+            LOG_ERROR(id, "Request handling failed");
         }
+        client_permit.charge(access_log::Current::bytes_out());
+        origin_permit.charge(access_log::Current::bytes_out());
     } catch (const exception& e) {
-        proxy_logger->write(id + ": ERROR Exception: " + string(e.what()));
+        LOG_ERROR(id, "Exception: " + string(e.what()));
         sendErrorResponse(client_fd, 500, "Internal Server Error", id);
     }
+    if (request_deadline.expired()) {
+        LOG_WARNING(id, "Request ran past its deadline, cut off");
+    }
+    request_deadline.cancel();
     
-    // 6. Cleanup
-    cout << "[Note] closing connection " << id << endl;
+    // 7. Cleanup
+    LOG_TRACE(id, "closing connection");
+    access_log::Current::mark(access_log::FINISHED);  // Before the lingering close below
+    metrics::request_duration.record(std::chrono::steady_clock::now() - data->accepted);
 
-    // Use the object method instead of raw file descriptor
-    client_socket->shutdownWrite();  // Uses RAII approach
+    // The closer thread drains whatever the client still sends, then closes
+    lingering::close(client_socket);
 
-    // Set a longer timeout to ensure data is flushed
-    usleep(300000);  // 300ms delay
-
-    // No need to call close() - the shared_ptr will handle this
-    
     delete data;
     return NULL;
 }
 
-bool Handler::processGetRequest(int client_fd, const Request& request, const string& id) {
-    std::cerr << "[DEBUG] Starting processGetRequest: " << id << std::endl;
-    string url = request.get_hostname() + request.get_uri();
+bool Handler::processGetRequest(int client_fd, const Request& request, const CacheLookup& lookup, const string& id) {
+    const CacheKey& primary_key = lookup.primary_key;
+    const CacheKey& key = lookup.key;
+    access_log::Current::object(key.lo);
+    bool is_range = !request.get_header("range").empty();
     
-    // Check if the request is in cache
-    auto cached_entry = proxy_cache->get(url);
+    // Found before admission
+    const CacheRef& cached_entry = lookup.entry;
     
     if (!cached_entry) {
-        proxy_logger->write(id + ": not in cache");
+        LOG_INFO(id, "not in cache");
+        access_log::Current::cache(access_log::CacheResult::Miss);
+        metrics::cache_misses.inc();
+        if (is_range) {
+            scheduleFullFetch(request, primary_key, id);
+        }
         return forwardRequest(client_fd, request, id);
     } else if (cached_entry->isExpired()) {
         // Fix: Convert time_point to time_t using to_time_t
         time_t expired_time = chrono::system_clock::to_time_t(cached_entry->expires_time);
-        tm* tm_expired = gmtime(&expired_time);
-        string expired_time_str = asctime(tm_expired);
-        expired_time_str.erase(expired_time_str.find('\n'));
+        string expired_time_str = http_date::format_asctime(expired_time);
         
-        proxy_logger->write(id + ": in cache, but expired at " + expired_time_str);
+        LOG_INFO(id, "in cache, but expired at " + expired_time_str);
+        access_log::Current::cache(access_log::CacheResult::Stale);
+        metrics::cache_stale.inc();
+        if (is_range) {
+            scheduleFullFetch(request, primary_key, id);
+        }
         
         // Check if we can validate
         if (!cached_entry->etag.empty() || !cached_entry->last_modified.empty()) {
-            proxy_logger->write(id + ": in cache, requires validation");
+            LOG_INFO(id, "in cache, requires validation");
             // We should revalidate - implement conditional GET
             return forwardRequest(client_fd, request, id);
         } else {
@@ -215,49 +322,309 @@ bool Handler::processGetRequest(int client_fd, const Request& request, const str
             return forwardRequest(client_fd, request, id);
         }
     } else {
-        proxy_logger->write(id + ": in cache, valid");
+        LOG_INFO(id, cached_entry->is_negative ? "in cache, valid (negative)" : "in cache, valid");
+        access_log::Current::cache(access_log::CacheResult::Hit);
+        metrics::cache_hits.inc();
+        const CacheEntry& entry = *cached_entry;
+
+        // Ranges are served from complete, uncompressed 200 bodies; otherwise
+        // the Range header is ignored and the whole body sent
+        if (is_range && entry.status_code == 200 && entry.has_length &&
+            entry.coding == compression::Coding::Identity &&
+            http_range::if_range_matches(request.get_header("if-range"), entry.etag, entry.last_modified)) {
+            std::vector<http_range::Slice> slices;
+            http_range::Result range = http_range::parse(request.get_header("range"), entry.data.size(), slices);
+            if (range != http_range::Result::Ignore) {
+                return sendCachedRange(client_fd, entry, range, slices, id);
+            }
+        }
         
         // Serve from cache
-        string response_line = cached_entry->response_line;
-        proxy_logger->write(id + ": Responding \"" + response_line + "\"");
-        
-        // Build response from cache
-        stringstream response_stream;
-        response_stream << cached_entry->response_line << "\r\n";
+        string response_line = entry.response_line;
+        LOG_INFO(id, "Responding \"" + response_line + "\"");
+        access_log::Current::status(entry.status_code);
         
-        for (const auto& header : cached_entry->headers) {
-            response_stream << header.first << ": " << header.second << "\r\n";
+        // Build response from cache; a compressed entry goes out as stored
+        // to clients that accept its coding and is inflated for the rest
+        bool is_compressed = entry.coding != compression::Coding::Identity;
+        bool send_as_stored = !is_compressed ||
+            compression::accepts(request.get_header("accept-encoding"), entry.coding);
+        string headers = entry.response_line + "\r\n";
+        headers.reserve(headers.size() + entry.header_block.size() + 128);
+        for (size_t i = 0; i < entry.header_block.chunkCount(); ++i) {
+            headers.append(entry.header_block.chunk(i));
         }
-        
-        response_stream << "\r\n";
-        string headers = response_stream.str();
+        if (entry.has_length) {
+            size_t length = send_as_stored ? entry.data.size() : entry.identity_length;
+            headers += "Content-Length: " + to_string(length) + "\r\n";
+        }
+        if (is_compressed) {
+            if (send_as_stored) {
+                headers += string("Content-Encoding: ") + compression::name(entry.coding) + "\r\n";
+            }
+            if (!entry.etag.empty()) {
+                // The compressed form is a different representation, so only weakly equal
+                bool weak = send_as_stored && entry.etag.compare(0, 2, "W/") != 0;
+                headers += "ETag: " + string(weak ? "W/" : "") + entry.etag + "\r\n";
+            }
+            if (entry.adds_vary) {
+                headers += "Vary: Accept-Encoding\r\n";
+            }
+        }
+        headers += "Age: " + to_string(entry.currentAge()) + "\r\n\r\n";
         
         // Send headers
         if (!sendAll(client_fd, headers.c_str(), headers.size())) {
-            proxy_logger->write(id + ": ERROR Failed to send cache response headers");
+            LOG_ERROR(id, "Failed to send cache response headers");
             return false;
         }
         
-        // Send body
-        if (!cached_entry->data.empty()) {
-            if (!sendAll(client_fd, cached_entry->data.data(), cached_entry->data.size())) {
-                proxy_logger->write(id + ": ERROR Failed to send cache response body");
+        // Send body straight from its slab chunks
+        if (!entry.data.empty()) {
+            bool sent;
+            if (send_as_stored) {
+                std::vector<iovec> iov;
+                appendSlices(entry.data, 0, entry.data.size(), iov);
+                sent = sendVector(client_fd, iov);
+            } else {
+                size_t next = 0;
+                sent = compression::decompress(entry.coding,
+                    [&]() { return next < entry.data.chunkCount() ? entry.data.chunk(next++) : std::string_view(); },
+                    [&](const char* data, size_t size) { return sendAll(client_fd, data, size); });
+            }
+            if (is_compressed) {
+                compression::record_served(send_as_stored, send_as_stored ? entry.data.size() : entry.identity_length,
+                                           entry.identity_length);
+            }
+            if (!sent) {
+                LOG_ERROR(id, "Failed to send cache response body");
                 return false;
             }
-            
-            // Add a brief pause to ensure data is completely transmitted
-            usleep(50000);  // 50ms delay, adjust if needed
         }
         
-        proxy_logger->write(id + ": DEBUG Sent " + std::to_string(cached_entry->data.size()) + 
-                   " bytes of cache data before closing");
+        LOG_SAMPLED(LogLevel::Debug, "sent", id, "Sent " + std::to_string(entry.data.size()) +
+                    " bytes of cache data before closing");
         
         return true;
     }
 }
 
+/**
+ * Answers a Range request from a cached entry
+ *
+ * One slice is sent as a plain 206 with Content-Range; several as
+ * multipart/byteranges; none that fits as 416. The body parts are written
+ * with one gathered send straight from the slab chunks.
+ */
+bool Handler::sendCachedRange(int client_fd, const CacheEntry& entry, http_range::Result range,
+                              const std::vector<http_range::Slice>& slices, const string& id) {
+    size_t length = entry.data.size();
+    string version = entry.response_line.substr(0, entry.response_line.find(' '));
+
+    if (range == http_range::Result::Unsatisfiable) {
+        string status_line = version + " 416 Range Not Satisfiable";
+        LOG_INFO(id, "Responding \"" + status_line + "\"");
+        access_log::Current::status(416);
+        string response = status_line + "\r\n"
+                          "Content-Range: bytes */" + to_string(length) + "\r\n"
+                          "Content-Length: 0\r\n\r\n";
+        return sendAll(client_fd, response.data(), response.size());
+    }
+
+    string status_line = version + " 206 Partial Content";
+    LOG_INFO(id, "in cache, serving " + to_string(slices.size()) + " range(s)");
+    LOG_INFO(id, "Responding \"" + status_line + "\"");
+    access_log::Current::status(206);
+
+    // Stored headers, minus Content-Type when the parts carry their own
+    string block;
+    for (size_t i = 0; i < entry.header_block.chunkCount(); ++i) {
+        block.append(entry.header_block.chunk(i));
+    }
+    string content_type;
+    string headers = status_line + "\r\n";
+    for (size_t pos = 0; pos < block.size();) {
+        size_t end = block.find("\r\n", pos);
+        end = (end == string::npos) ? block.size() : end + 2;
+        std::string_view line(block.data() + pos, end - pos);
+        if (line.substr(0, 13) == "Content-Type:") {
+            content_type = string(line.substr(13, line.size() - 15));
+            if (slices.size() > 1) {
+                pos = end;
+                continue;
+            }
+        }
+        headers.append(line);
+        pos = end;
+    }
+
+    std::vector<string> part_headers;  // Must outlive iov
+    std::vector<iovec> iov;
+    size_t body_length = 0;
+    string closing;
+    if (slices.size() == 1) {
+        headers += "Content-Range: " + http_range::content_range(slices[0], length) + "\r\n";
+        body_length = slices[0].length();
+        appendSlices(entry.data, slices[0].first, slices[0].length(), iov);
+    } else {
+        uintptr_t entry_address = reinterpret_cast<uintptr_t>(&entry);
+        string boundary = utils::hash128(&entry_address, sizeof(entry_address), static_cast<uint64_t>(CoarseClock::now())).toHex();
+        headers += "Content-Type: multipart/byteranges; boundary=" + boundary + "\r\n";
+        part_headers.reserve(slices.size());
+        for (const http_range::Slice& slice : slices) {
+            part_headers.push_back("\r\n--" + boundary + "\r\n" +
+                                   (content_type.empty() ? string() : "Content-Type:" + content_type + "\r\n") +
+                                   "Content-Range: " + http_range::content_range(slice, length) + "\r\n\r\n");
+            body_length += part_headers.back().size() + slice.length();
+        }
+        closing = "\r\n--" + boundary + "--\r\n";
+        body_length += closing.size();
+        for (size_t i = 0; i < slices.size(); ++i) {
+            iov.push_back(iovec{const_cast<char*>(part_headers[i].data()), part_headers[i].size()});
+            appendSlices(entry.data, slices[i].first, slices[i].length(), iov);
+        }
+        iov.push_back(iovec{const_cast<char*>(closing.data()), closing.size()});
+    }
+    headers += "Content-Length: " + to_string(body_length) + "\r\n";
+    headers += "Age: " + to_string(entry.currentAge()) + "\r\n\r\n";
+
+    iov.insert(iov.begin(), iovec{const_cast<char*>(headers.data()), headers.size()});
+    if (!sendVector(client_fd, iov)) {
+        LOG_ERROR(id, "Failed to send cached range");
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Range misses whose full object is being fetched, by primary key
+std::mutex full_fetch_mutex;
+std::unordered_set<CacheKey> full_fetches;
+
+/**
+ * Copies a raw request without the named header fields (lowercase names)
+ */
+string strip_headers(const string& raw, std::initializer_list<const char*> names) {
+    size_t header_end = raw.find("\r\n\r\n");
+    if (header_end == string::npos) {
+        return raw;
+    }
+    string out;
+    out.reserve(raw.size());
+    size_t pos = 0;
+    while (pos < header_end + 2) {
+        size_t end = raw.find("\r\n", pos) + 2;
+        std::string_view line(raw.data() + pos, end - pos);
+        size_t colon = line.find(':');
+        bool drop = false;
+        for (const char* name : names) {
+            drop = drop || (colon == strlen(name) && strncasecmp(line.data(), name, colon) == 0);
+        }
+        if (!drop) {
+            out.append(line);
+        }
+        pos = end;
+    }
+    out.append(raw, header_end + 2, string::npos);
+    return out;
+}
+
+} // namespace
+
+/**
+ * Fetches the whole object behind a range miss into the cache, in the background
+ *
+ * Players seek with Range requests, which are forwarded as-is and return
+ * uncacheable 206s. Fetching the full object once lets later seeks be
+ * answered from the cache. One fill runs per URL, and at most
+ * PROXY_RANGE_FILL_MAX at a time.
+ */
+void Handler::scheduleFullFetch(const Request& request, const CacheKey& primary_key, const string& id) {
+    static const size_t max_fills = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_RANGE_FILL_MAX", 4)));
+    if (max_fills == 0 || global_thread_pool == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(full_fetch_mutex);
+        if (full_fetches.size() >= max_fills || !full_fetches.insert(primary_key).second) {
+            return;
+        }
+    }
+    LOG_NOTE(id, "range miss, fetching the full object in the background");
+
+    string raw = strip_headers(request.get_request(), {"range", "if-range"});
+    string fill_id = id + "-fill";
+    boost::asio::post(*global_thread_pool, [raw, primary_key, fill_id]() {
+        try {
+            Request full(raw);
+            full.parse();
+            forwardRequest(-1, full, fill_id);
+        } catch (const exception& e) {
+            LOG_WARNING(fill_id, "Background fetch failed: " + string(e.what()));
+        }
+        std::lock_guard<std::mutex> lock(full_fetch_mutex);
+        full_fetches.erase(primary_key);
+    });
+}
+
+bool Handler::prefetch(const Request& request, const string& id) {
+    try {
+        return forwardRequest(-1, request, id);
+    } catch (const exception& e) {
+        LOG_WARNING(id, "Background fetch failed: " + string(e.what()));
+        return false;
+    }
+}
+
+/**
+ * Appends iovecs covering [offset, offset + size) of a stored body
+ */
+void Handler::appendSlices(const BlobRef& data, size_t offset, size_t size, std::vector<iovec>& iov) {
+    size_t index = offset / SlabAllocator::MAX_CHUNK;
+    size_t skip = offset % SlabAllocator::MAX_CHUNK;
+    while (size > 0 && index < data.chunkCount()) {
+        std::string_view chunk = data.chunk(index++).substr(skip);
+        size_t take = std::min(size, chunk.size());
+        iov.push_back(iovec{const_cast<char*>(chunk.data()), take});
+        size -= take;
+        skip = 0;
+    }
+}
+
+/**
+ * Gathered send of every iovec, resuming after partial writes
+ */
+bool Handler::sendVector(int fd, std::vector<iovec>& iov) {
+    size_t next = 0;
+    while (next < iov.size()) {
+        msghdr msg = {};
+        msg.msg_iov = &iov[next];
+        msg.msg_iovlen = std::min<size_t>(iov.size() - next, IOV_MAX);
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        access_log::Current::sent(fd, static_cast<size_t>(sent));
+        // Drop fully written iovecs and trim a partially written one
+        size_t left = static_cast<size_t>(sent);
+        while (next < iov.size() && left >= iov[next].iov_len) {
+            left -= iov[next].iov_len;
+            ++next;
+        }
+        if (left > 0) {
+            iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + left;
+            iov[next].iov_len -= left;
+        }
+    }
+    return true;
+}
+
 bool Handler::processPostRequest(int client_fd, const Request& request, const string& id) {
-    proxy_logger->write(id + ": NOTE Processing POST request");
+    LOG_NOTE(id, "Processing POST request");
     return forwardRequest(client_fd, request, id);
 }
 
@@ -265,30 +632,51 @@ bool Handler::processConnectRequest(int client_fd, const Request& request, const
     string hostname = request.get_hostname();
     string port = request.get_port();
     
-    proxy_logger->write(id + ": NOTE Processing CONNECT to " + hostname + ":" + port);
-    proxy_logger->write(id + ": Requesting \"" + request.get_line() + "\" from " + hostname);
+    LOG_NOTE(id, "Processing CONNECT to " + hostname + ":" + port);
+    LOG_INFO(id, "Requesting \"" + request.get_line() + "\" from " + hostname);
+    
+    if (proxy_negative_cache && proxy_negative_cache->isFailed(hostname, port)) {
+        LOG_NOTE(id, hostname + ":" + port + " recently unreachable, not retrying");
+        sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+        return false;
+    }
     
     // Create a connection to the destination server
     auto server_socket = std::make_shared<TcpSocket>();
-    if (!server_socket->connect(hostname, stoi(port))) {
-        proxy_logger->write(id + ": ERROR Failed to connect to " + hostname + ":" + port);
-        sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+    auto connect_start = std::chrono::steady_clock::now();
+    timeouts::Deadline connect_deadline(timeouts::Kind::Connect);
+    bool connected = server_socket->connect(hostname, stoi(port), connect_deadline.due());
+    connect_deadline.cancel();
+    if (!connected) {
+        if (proxy_negative_cache) proxy_negative_cache->markFailed(hostname, port);
+        if (connect_deadline.expired()) {
+            LOG_ERROR(id, "Timed out connecting to " + hostname + ":" + port);
+            sendErrorResponse(client_fd, 504, "Gateway Timeout", id);
+        } else {
+            LOG_ERROR(id, "Failed to connect to " + hostname + ":" + port);
+            sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+        }
         return false;
     }
     
+    metrics::upstream_connect.record(std::chrono::steady_clock::now() - connect_start);
+    access_log::Current::mark(access_log::CONNECTED);
+
     // Send 200 OK to client to establish tunnel
     string ok_response = "HTTP/1.1 200 Connection Established\r\n\r\n";
-    proxy_logger->write(id + ": Responding \"HTTP/1.1 200 Connection Established\"");
+    LOG_INFO(id, "Responding \"HTTP/1.1 200 Connection Established\"");
+    access_log::Current::status(200);
     
     if (!sendAll(client_fd, ok_response.c_str(), ok_response.size())) {
-        proxy_logger->write(id + ": ERROR Failed to send 200 OK for CONNECT");
+        LOG_ERROR(id, "Failed to send 200 OK for CONNECT");
         return false;
     }
     
-    // Tunnel traffic between client and server
-    proxy_logger->write(id + ": NOTE Tunnel established, beginning data transfer");
+    // Tunnel traffic between client and server; only the idle timeout applies from here
+    LOG_NOTE(id, "Tunnel established, beginning data transfer");
+    metrics::ScopedGauge tunnel(metrics::active_tunnels);
     bool tunnel_result = tunnelTraffic(client_fd, server_socket->getSocketFd(), id);
-    proxy_logger->write(id + ": Tunnel closed");
+    LOG_INFO(id, "Tunnel closed");
     
     return tunnel_result;
 }
@@ -296,13 +684,12 @@ bool Handler::processConnectRequest(int client_fd, const Request& request, const
 bool Handler::forwardRequest(int client_fd, const Request& request, const string& id) {
     // Add this at the beginning of the method
     if (!proxy_logger || !proxy_cache) {
-        std::cerr << "Logger or cache not initialized" << std::endl;
         return false;
     }
     
     string hostname = request.get_hostname();
     if (hostname.empty()) {
-        if (proxy_logger) proxy_logger->write(id + ": ERROR Empty hostname in request");
+        LOG_ERROR(id, "Empty hostname in request");
         sendErrorResponse(client_fd, 400, "Bad Request", id);
         return false;
     }
@@ -311,31 +698,67 @@ bool Handler::forwardRequest(int client_fd, const Request& request, const string
     string port = request.get_port();
     
     // Add null checks and better error handling
+    // Opened by connect() in the family of the address that answers first
     auto server_socket = std::make_shared<TcpSocket>();
-    if (!server_socket || !server_socket->getSocketFd()) {
-        proxy_logger->write(id + ": ERROR Failed to create server socket");
-        sendErrorResponse(client_fd, 500, "Internal Server Error", id);
+    
+    // Fail fast while the origin is remembered as unreachable
+    if (proxy_negative_cache && proxy_negative_cache->isFailed(hostname, port)) {
+        LOG_NOTE(id, hostname + ":" + port + " recently unreachable, not retrying");
+        sendErrorResponse(client_fd, 502, "Bad Gateway", id);
         return false;
     }
     
-    proxy_logger->write(id + ": Requesting \"" + request.get_line() + "\" from " + hostname);
+    // Wait for an upstream slot; held until the response has been relayed
+    UpstreamScheduler::Slot upstream;
+    if (proxy_upstream) {
+        double retry_after = 0;
+        UpstreamScheduler::Result result = proxy_upstream->acquire(hostname + ":" + port, upstream, retry_after);
+        if (result != UpstreamScheduler::Result::Admitted) {
+            LOG_WARNING(id, hostname + ":" + port + (result == UpstreamScheduler::Result::CircuitOpen
+                                                         ? " failing, circuit open"
+                                                         : " busy, no upstream slot in time"));
+            long seconds = std::max(1L, static_cast<long>(std::ceil(retry_after)));
+            sendErrorResponse(client_fd, 503, "Service Unavailable", id, "Retry-After: " + to_string(seconds) + "\r\n");
+            return false;
+        }
+    }
+
+    LOG_INFO(id, "Requesting \"" + request.get_line() + "\" from " + hostname);
     
     // Connect to origin server
-    if (!server_socket->connect(hostname, stoi(port))) {
-        proxy_logger->write(id + ": ERROR Failed to connect to " + hostname + ":" + port);
-        sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+    auto connect_start = std::chrono::steady_clock::now();
+    timeouts::Deadline connect_deadline(timeouts::Kind::Connect);
+    bool connected = server_socket->connect(hostname, stoi(port), connect_deadline.due());
+    connect_deadline.cancel();
+    if (!connected) {
+        upstream.finish(false);
+        if (proxy_negative_cache) proxy_negative_cache->markFailed(hostname, port);
+        if (connect_deadline.expired()) {
+            LOG_ERROR(id, "Timed out connecting to " + hostname + ":" + port + " (" +
+                      timeouts::name(connect_deadline.cause()) + ")");
+            sendErrorResponse(client_fd, 504, "Gateway Timeout", id);
+        } else {
+            LOG_ERROR(id, "Failed to connect to " + hostname + ":" + port);
+            sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+        }
         return false;
     }
+    metrics::upstream_connect.record(std::chrono::steady_clock::now() - connect_start);
+    access_log::Current::mark(access_log::CONNECTED);
     
     // Forward the request to the origin server
+    time_t request_time = CoarseClock::now();
     if (!sendAll(server_socket->getSocketFd(), request.get_request().c_str(), request.get_request().size())) {
-        proxy_logger->write(id + ": ERROR Failed to send request to origin server");
+        LOG_ERROR(id, "Failed to send request to origin server");
+        upstream.finish(false);
         sendErrorResponse(client_fd, 502, "Bad Gateway", id);
         return false;
     }
+    auto request_sent = std::chrono::steady_clock::now();
     
     // Receive response from origin server
     vector<uint8_t> response_buffer;
+    utils::Hasher128 body_hasher;  // Content key for the blob store, fed as the body arrives
     size_t total_bytes_read = 0;
     bool keep_reading = true;
     
@@ -343,103 +766,167 @@ bool Handler::forwardRequest(int client_fd, const Request& request, const string
     string response_str;
     char buf[BUFFER_SIZE];
     ssize_t bytes_read;
+    size_t header_end = string::npos;
+    size_t header_scan_from = 0;  // Resume point so each recv only scans new bytes
     
-    proxy_logger->write(id + ": NOTE Beginning to receive response from origin server");
+    LOG_NOTE(id, "Beginning to receive response from origin server");
     
+    timeouts::Deadline first_byte_deadline(server_socket->getSocketFd(), timeouts::Kind::FirstByte);
     while (keep_reading) {
         bytes_read = recv(server_socket->getSocketFd(), buf, BUFFER_SIZE, 0);
         
         if (bytes_read <= 0) {
             if (bytes_read < 0) {
-                proxy_logger->write(id + ": ERROR Failed to read from origin server: " + std::string(strerror(errno)));
+                LOG_ERROR(id, "Failed to read from origin server: " + std::string(strerror(errno)));
             } else {
-                proxy_logger->write(id + ": NOTE Origin server closed connection during header read");
+                LOG_NOTE(id, "Origin server closed connection during header read");
             }
             break;
         }
         
+        if (total_bytes_read == 0) {
+            metrics::upstream_ttfb.record(std::chrono::steady_clock::now() - request_sent);
+            access_log::Current::mark(access_log::ORIGIN_FIRST_BYTE);
+        }
         response_str.append(buf, bytes_read);
         total_bytes_read += bytes_read;
         
         // Check if we've reached the end of headers
-        size_t header_end = response_str.find("\r\n\r\n");
-        if (header_end != string::npos) {
+        header_end = http_scan::find_header_end(response_str.data(), response_str.size(), header_scan_from);
+        if (header_end != http_scan::npos) {
             break;
         }
     }
     
+    time_t response_time = CoarseClock::now();
+    if (first_byte_deadline.expired() && header_end == http_scan::npos) {
+        LOG_ERROR(id, "Timed out waiting for the response headers from " + hostname + " (" +
+                  timeouts::name(first_byte_deadline.cause()) + ")");
+        upstream.finish(false);
+        sendErrorResponse(client_fd, 504, "Gateway Timeout", id);
+        return false;
+    }
+    first_byte_deadline.cancel();
     if (total_bytes_read == 0) {
-        proxy_logger->write(id + ": ERROR No response from origin server");
+        LOG_ERROR(id, "No response from origin server");
+        upstream.finish(false);
+        if (proxy_negative_cache) proxy_negative_cache->markFailed(hostname, port);
         sendErrorResponse(client_fd, 502, "Bad Gateway", id);
         return false;
     }
     
     // Parse the response to extract the response line
-    size_t line_end = response_str.find("\r\n");
+    size_t line_end = http_scan::find_crlf(response_str.data(), response_str.size());
     string response_line = response_str.substr(0, line_end);
-    proxy_logger->write(id + ": Received \"" + response_line + "\" from " + hostname);
+    LOG_INFO(id, "Received \"" + response_line + "\" from " + hostname);
+    int status = std::atoi(response_line.c_str() + std::min<size_t>(response_line.find(' '), response_line.size()));
+
+    // Parse the headers once: framing for every method, storability for GET
+    std::optional<Response> response;
+    try {
+        response.emplace(response_str, request_time, response_time);
+    } catch (const exception& e) {
+        LOG_WARNING(id, "Failed to parse response headers: " + string(e.what()));
+    }
+
+    // A Content-Length that is not a number leaves the body's end unknown,
+    // so the response is not relayed. Chunked framing overrides it.
+    if (response && response->has_bad_content_length() && !response->is_chunked()) {
+        LOG_ERROR(id, "Invalid Content-Length from " + hostname);
+        upstream.finish(false);
+        sendErrorResponse(client_fd, 502, "Bad Gateway", id);
+        return false;
+    }
+    bool is_chunked = response && response->is_chunked();
+    bool has_length = response && !is_chunked && response->get_content_length() >= 0;
+    size_t content_length = has_length ? static_cast<size_t>(response->get_content_length()) : 0;
+    upstream.finish(status > 0 && status < 500, std::chrono::steady_clock::now() - connect_start);
+    if (client_fd >= 0) {
+        access_log::Current::status(status);
+    }
     
-    // Check if it's a 200 OK response to a GET request for caching
-    bool is_cacheable = (request.get_method() == "GET" && response_str.find("HTTP/1.1 200") == 0);
+    // Decide from the status and headers whether a GET response may be stored
+    bool is_negative = false;
+    bool is_cacheable = false;
+    if (request.get_method() == "GET" && response) {
+        try {
+            is_cacheable = isStorable(request, *response, is_negative, id);
+        } catch (const exception& e) {
+            LOG_WARNING(id, "Failed to process response for caching: " + string(e.what()));
+        }
+    }
     
+    // A background fill (no client) has nothing to do with an unstorable response
+    if (client_fd < 0 && !is_cacheable) {
+        LOG_NOTE(id, "background fetch not cacheable, abandoned");
+        return true;
+    }
+
     // Send the response headers to the client
-    if (!sendAll(client_fd, response_str.c_str(), response_str.size())) {
-        proxy_logger->write(id + ": ERROR Failed to forward response to client");
+    if (client_fd >= 0 && !sendAll(client_fd, response_str.c_str(), response_str.size())) {
+        LOG_ERROR(id, "Failed to forward response to client");
         return false;
     }
     
-    // Parse Content-Length and check for chunked encoding
-    size_t content_length = 0;
-    bool is_chunked = false;
-
-    // Find Content-Length header if present
-    size_t content_length_pos = response_str.find("Content-Length: ");
-    if (content_length_pos != string::npos) {
-        size_t start = content_length_pos + 16; // Length of "Content-Length: "
-        size_t end = response_str.find("\r\n", start);
-        content_length = std::stoi(response_str.substr(start, end - start));
+    if (is_cacheable && content_length > proxy_cache->maxBytes()) {
+        LOG_INFO(id, "not cacheable because it exceeds the cache memory budget");
+        is_cacheable = false;
+        if (client_fd < 0) {
+            return true;
+        }
     }
 
-    // Check for chunked encoding
-    is_chunked = (response_str.find("Transfer-Encoding: chunked") != string::npos);
-
     // Calculate how much of the body we already read in the initial headers read
-    size_t header_end = response_str.find("\r\n\r\n");
     size_t body_received = 0;
     if (header_end != string::npos) {
         body_received = response_str.length() - (header_end + 4);
     }
+    if (has_length && body_received >= content_length) {
+        keep_reading = false;  // The first read already held the whole body
+    }
+    if (is_chunked && body_received >= 5 && response_str.compare(response_str.size() - 5, 5, "0\r\n\r\n") == 0) {
+        keep_reading = false;  // Likewise up to the last chunk
+    }
 
     if (header_end != string::npos && is_cacheable) {
         // Add body data from initial response to response_buffer
         response_buffer.insert(response_buffer.end(), 
                               response_str.begin() + header_end + 4,
                               response_str.end());
+        body_hasher.update(response_str.data() + header_end + 4, body_received);
     }
 
     // Continue reading the response body until we've received all data
+    timeouts::Deadline body_deadline(server_socket->getSocketFd(), timeouts::Kind::BodyIdle);
     while (keep_reading) {
         bytes_read = recv(server_socket->getSocketFd(), buf, BUFFER_SIZE, 0);
         
         if (bytes_read <= 0) {
             // Server closed connection or error
             keep_reading = false;
+            if (body_deadline.expired()) {
+                LOG_ERROR(id, string("Response body from ") + hostname + " cut off (" +
+                          timeouts::name(body_deadline.cause()) + ")");
+                return false;  // Truncated; neither relayed further nor stored
+            }
         } else {
+            body_deadline.rearm();
             // Forward data to client
-            if (!sendAll(client_fd, buf, bytes_read)) {
-                proxy_logger->write(id + ": ERROR Failed to forward response body to client");
+            if (client_fd >= 0 && !sendAll(client_fd, buf, bytes_read)) {
+                LOG_ERROR(id, "Failed to forward response body to client");
                 return false;
             }
             
             // Cache data if needed
             if (is_cacheable) {
                 response_buffer.insert(response_buffer.end(), buf, buf + bytes_read);
+                body_hasher.update(buf, bytes_read);
             }
             
             body_received += bytes_read;
             
             // Check if we have received the complete response body
-            if (content_length > 0 && !is_chunked && body_received >= content_length) {
+            if (has_length && body_received >= content_length) {
                 // We've received all the data based on Content-Length
                 keep_reading = false;
             }
@@ -454,77 +941,331 @@ bool Handler::forwardRequest(int client_fd, const Request& request, const string
         }
     }
     
-    // Process for caching if it's a 200 OK GET response
+    // A chunked body is stored de-chunked; hits frame it with Content-Length
+    if (is_cacheable && is_chunked && !dechunk(response_buffer)) {
+        LOG_WARNING(id, "not cacheable because its chunked framing is malformed");
+        is_cacheable = false;
+    }
+
+    // Store the response if it was judged cacheable above
     if (is_cacheable) {
         try {
-            Response response(response_str);
+            const CacheControl& directives = response->get_directives();
+
+            // Create a cache entry
+            CacheEntry entry;
+            entry.response_line = response_line;
+            entry.status_code = std::atoi(response->get_status_code().c_str());
+
+            // Parse Vary up front: a compressed entry must announce it varies on Accept-Encoding
+            std::vector<std::string> vary;
+            CacheKeyBuilder::parseVary(response->get_header("Vary"), vary);
+
+            // Compress eligible text bodies once, here, rather than per hit
+            const compression::Policy& policy = compression::Policy::global();
+            std::vector<uint8_t> compressed;
+            bool is_compressed = isCompressible(*response, response_buffer.size()) &&
+                compression::compress(policy.coding, policy.level, response_buffer.data(),
+                                      response_buffer.size(), compressed);
+            // The streamed hash saw the chunk framing, so a de-chunked body is hashed afresh
+            utils::Hash128 body_key = is_chunked ? utils::hash128(response_buffer.data(), response_buffer.size())
+                                                 : body_hasher.finish();
+            if (is_compressed) {
+                // Equal originals compress to equal bytes, so the coding extends the content key
+                body_key = utils::Hasher128().update(&body_key, sizeof(body_key)).field(compression::name(policy.coding)).finish();
+                entry.coding = policy.coding;
+                entry.identity_length = response_buffer.size();
+                entry.adds_vary = std::find(vary.begin(), vary.end(), "accept-encoding") == vary.end();
+                compression::record_stored(response->get_header("Content-Type"), response_buffer.size(), compressed.size());
+                LOG_NOTE(id, string("stored ") + compression::name(policy.coding) + "-compressed, " +
+                         to_string(response_buffer.size()) + " -> " + to_string(compressed.size()) + " bytes (" +
+                         to_string(compressed.size() * 100 / response_buffer.size()) + "%)");
+            }
+            const vector<uint8_t>& stored_body = is_compressed ? compressed : response_buffer;
+            // Only a body exactly as long as announced can be sliced into ranges
+            entry.has_length = is_chunked ||
+                               response->get_header("Content-Length") == to_string(response_buffer.size());
+
+            bool shared_body = false;
+            entry.data = BlobStore::global().intern(body_key, stored_body.data(), stored_body.size(), &shared_body);
+            if (shared_body) {
+                LOG_NOTE(id, "body identical to a cached one, sharing " +
+                         to_string(stored_body.size()) + " bytes");
+            }
             
-            // Check if the response is cacheable
-            if (response.is_no_store()) {
-                proxy_logger->write(id + ": not cacheable because Cache-Control: no-store");
-            } else {
-                // Create a cache entry
-                CacheEntry entry;
-                entry.response_line = response_line;
-                entry.data = response_buffer;
-                
-                // Copy headers one by one using the existing get_header method
-                // Instead of using get_headers() which doesn't exist
-                const std::vector<std::string> header_names = {
-                    "Content-Type", "Content-Length", "ETag", "Last-Modified", 
-                    "Expires", "Cache-Control", "Date"
-                };
-
-                for (const auto& header_name : header_names) {
-                    std::string value = response.get_header(header_name);
-                    if (!value.empty()) {
-                        entry.headers[header_name] = value;
-                    }
+            // Keep end-to-end headers, serialized as they are sent on a hit.
+            // Hop-by-hop ones and fields named by no-cache="..." or
+            // private="..." must not be served from cache. The body is stored
+            // de-chunked and maybe compressed, so the origin's framing never
+            // applies: Content-Length is written per hit for entries that
+            // know it, and a compressed entry gets its validator per hit too.
+            string header_block;
+            for (const auto& header : response->get_headers()) {
+                const string& name = header.first;
+                string lower_name = name;
+                for (char& c : lower_name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                if (isUnstoredHeader(name) || lower_name == "content-length" || (is_compressed && lower_name == "etag") ||
+                    std::find(directives.no_cache_fields.begin(), directives.no_cache_fields.end(), lower_name) != directives.no_cache_fields.end() ||
+                    std::find(directives.private_fields.begin(), directives.private_fields.end(), lower_name) != directives.private_fields.end()) {
+                    continue;
                 }
-                
-                // Set expiration info
-                entry.creation_time = chrono::system_clock::now();
-                entry.expires_time = chrono::system_clock::from_time_t(response.get_expire_time());
-                entry.requires_validation = response.needs_validation();
-                entry.etag = response.get_etag();
-                entry.last_modified = response.get_header("Last-Modified");
-                
-                // Add to cache
-                string url = request.get_hostname() + request.get_uri();
-                proxy_cache->put(url, entry);
-                
-                if (response.needs_validation()) {
-                    proxy_logger->write(id + ": cached, but requires re-validation");
-                } else if (response.get_expire_time() > 0) {
-                    time_t expire_time = response.get_expire_time();
-                    tm* tm_expire = gmtime(&expire_time);
-                    string expire_time_str = asctime(tm_expire);
-                    expire_time_str.erase(expire_time_str.find('\n'));
-                    
-                    proxy_logger->write(id + ": cached, expires at " + expire_time_str);
+                header_block += name + ": " + header.second + "\r\n";
+            }
+            entry.header_block = SlabBuffer(header_block);
+            
+            // Set expiration info
+            entry.creation_time = chrono::system_clock::from_time_t(response_time);
+            entry.initial_age = response->get_current_age();
+            entry.etag = response->get_etag();
+            entry.last_modified = response->get_header("Last-Modified");
+            entry.is_negative = is_negative;
+            if (is_negative) {
+                // Origin errors are damped for a few seconds, never revalidated
+                entry.expires_time = chrono::system_clock::from_time_t(response_time + proxy_negative_cache->ttl());
+                entry.requires_validation = false;
+            } else {
+                entry.expires_time = chrono::system_clock::from_time_t(response->get_expire_time());
+                entry.requires_validation = response->needs_validation();
+            }
+            
+            // Add to cache under the variant selected by the response's Vary header
+            string url = CacheKeyBuilder::normalizeUrl(request);
+            entry.primary_key = CacheKeyBuilder::primary(request.get_method(), url);
+            entry.key_text = CacheKeyBuilder::keyText(request.get_method(), url, vary, request);
+            CacheKey key = CacheKeyBuilder::variant(entry.primary_key, vary, request);
+            size_t stored_size = entry.data.size();
+            bool stored = stored_size == stored_body.size() && entry.header_block.valid() &&
+                          proxy_cache->put(key, std::move(entry), vary);
+            if (!stored) {
+                LOG_INFO(id, "not cacheable because it exceeds the cache memory budget");
+            } else {
+                metrics::cache_stored_bytes.inc(static_cast<int64_t>(stored_size));
+                if (is_negative) {
+                    LOG_INFO(id, "cached origin error for " + to_string(proxy_negative_cache->ttl()) + "s");
+                } else if (response->needs_validation()) {
+                    LOG_INFO(id, "cached, but requires re-validation");
+                } else if (response->get_expire_time() > 0) {
+                    string expire_time_str = http_date::format_asctime(response->get_expire_time());
+
+                    LOG_INFO(id, "cached, expires at " + expire_time_str);
                 }
             }
         } catch (const exception& e) {
-            proxy_logger->write(id + ": WARNING Failed to process response for caching: " + string(e.what()));
+            LOG_WARNING(id, "Failed to process response for caching: " + string(e.what()));
         }
     }
     
-    proxy_logger->write(id + ": Responding \"" + response_line + "\"");
+    if (client_fd >= 0) {
+        LOG_INFO(id, "Responding \"" + response_line + "\"");
+    }
+    return true;
+}
+
+/**
+ * Decides whether a GET response may be stored (RFC 9111 section 3)
+ *
+ * Statuses that are heuristically cacheable are stored, as is any final
+ * status with explicit freshness. Origin 5xx errors without explicit
+ * freshness are stored as short-lived negative entries. A response to a
+ * request with Authorization is stored only when the origin allows sharing
+ * it (section 3.5).
+ *
+ * @param is_negative Set when the entry should use the negative-cache TTL
+ * @return True if the response should be cached
+ */
+bool Handler::isStorable(const Request& request, const Response& response, bool& is_negative, const string& id) {
+    is_negative = false;
+    int status = std::atoi(response.get_status_code().c_str());
+    const CacheControl& directives = response.get_directives();
+
+    if (response.is_no_store()) {
+        LOG_INFO(id, "not cacheable because Cache-Control: no-store");
+        return false;
+    }
+    if (response.is_private()) {
+        LOG_INFO(id, "not cacheable because Cache-Control: private");
+        return false;
+    }
+    if (!request.get_header("Authorization").empty() && !directives.is_public &&
+        directives.s_maxage == CacheControl::UNSET && !directives.must_revalidate) {
+        LOG_INFO(id, "not cacheable because the request carries Authorization");
+        return false;
+    }
+    std::vector<std::string> vary;
+    if (!CacheKeyBuilder::parseVary(response.get_header("Vary"), vary)) {
+        LOG_INFO(id, "not cacheable because Vary: *");
+        return false;
+    }
+    // Partial content and interim/validation responses are never stored as full objects
+    if (status < 200 || status == 206 || status == 304) {
+        return false;
+    }
+
+    bool explicit_freshness = directives.max_age != CacheControl::UNSET ||
+                              directives.s_maxage != CacheControl::UNSET ||
+                              !response.get_header("Expires").empty();
+    if (explicit_freshness || directives.is_public || freshness::heuristically_cacheable(status)) {
+        return true;
+    }
+    if (status >= 500 && proxy_negative_cache && proxy_negative_cache->ttl() > 0) {
+        is_negative = true;
+        return true;
+    }
+    LOG_INFO(id, "not cacheable because of status " + to_string(status));
+    return false;
+}
+
+/**
+ * Decodes a complete chunked body in place (RFC 9112 section 7.1), dropping
+ * chunk extensions and trailers. Returns false when the framing is malformed
+ * or the last chunk is missing, leaving the body unusable.
+ */
+bool Handler::dechunk(std::vector<uint8_t>& body) {
+    size_t in = 0, out = 0;
+    while (true) {
+        auto line_end = std::search(body.begin() + in, body.end(), "\r\n", "\r\n" + 2);
+        if (line_end == body.end()) {
+            return false;
+        }
+        size_t size = 0, digits = 0;
+        for (size_t i = in; i < static_cast<size_t>(line_end - body.begin()) && std::isxdigit(body[i]); ++i, ++digits) {
+            if (size > (SIZE_MAX >> 4)) {
+                return false;
+            }
+            size = (size << 4) | static_cast<size_t>(std::isdigit(body[i]) ? body[i] - '0' : (body[i] | 0x20) - 'a' + 10);
+        }
+        if (digits == 0) {
+            return false;
+        }
+        in = line_end - body.begin() + 2;
+        if (size == 0) {
+            break;  // Trailer fields, if any, are not kept
+        }
+        if (body.size() - in < size + 2 || body[in + size] != '\r' || body[in + size + 1] != '\n') {
+            return false;
+        }
+        std::memmove(body.data() + out, body.data() + in, size);
+        out += size;
+        in += size + 2;
+    }
+    body.resize(out);
     return true;
 }
 
-void Handler::sendErrorResponse(int client_fd, int status_code, const string& message, const string& id) {
+/**
+ * Headers never replayed from storage: hop-by-hop fields (RFC 9110 section 7.6.1),
+ * Set-Cookie, and Age, which is regenerated on every hit
+ */
+bool Handler::isUnstoredHeader(const string& name) {
+    static const char* const unstored[] = {
+        "Connection", "Keep-Alive", "Proxy-Authenticate", "Proxy-Authorization",
+        "Proxy-Connection", "TE", "Trailer", "Transfer-Encoding", "Upgrade", "Set-Cookie", "Age",
+    };
+    for (const char* header : unstored) {
+        if (strcasecmp(name.c_str(), header) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Whether a body to be stored should be compressed first
+ *
+ * Only complete, identity-coded 200 bodies of text media types qualify,
+ * and never when the origin forbids transformation (no-transform).
+ */
+bool Handler::isCompressible(const Response& response, size_t body_size) {
+    const compression::Policy& policy = compression::Policy::global();
+    if (policy.coding == compression::Coding::Identity || body_size < policy.min_size) {
+        return false;
+    }
+    if (response.get_status_code() != "200" || response.get_directives().no_transform) {
+        return false;
+    }
+    if (!response.get_header("Content-Encoding").empty() || !response.get_header("Transfer-Encoding").empty()) {
+        return false;
+    }
+    // The body must be exactly what Content-Length announced
+    if (response.get_header("Content-Length") != to_string(body_size)) {
+        return false;
+    }
+    return compression::compressible_type(response.get_header("Content-Type"));
+}
+
+// Generated answers carry a Date, as the proxy has a clock (RFC 9110 section 6.6.1)
+void Handler::sendErrorResponse(int client_fd, int status_code, const string& message, const string& id,
+                                const string& extra_headers) {
+    if (client_fd < 0) {
+        return;  // Background fetch; nobody to answer
+    }
     string status_line = "HTTP/1.1 " + to_string(status_code) + " " + message;
     string response = status_line + "\r\n"
-                     "Content-Type: text/plain\r\n"
+                     "Date: " + string(CoarseClock::date_str().view()) + "\r\n"
+                     "Content-Type: text/plain\r\n" +
+                     extra_headers +
                      "Connection: close\r\n"
                      "\r\n"
                      "Error: " + message;
     
-    proxy_logger->write(id + ": Responding \"" + status_line + "\"");
+    LOG_INFO(id, "Responding \"" + status_line + "\"");
+    access_log::Current::status(status_code);
     sendAll(client_fd, response.c_str(), response.size());
 }
 
+/**
+ * Cache hits are admitted ahead of misses, so overload costs misses first
+ */
+AdmissionControl::Priority Handler::admissionPriority(const CacheLookup& lookup) {
+    return lookup.entry && !lookup.entry->isExpired() ? AdmissionControl::Priority::Hit
+                                                      : AdmissionControl::Priority::Miss;
+}
+
+CacheLookup Handler::lookupCache(const Request& request) {
+    // Look up the variant selected by the stored response's Vary header
+    CacheLookup lookup;
+    string url = CacheKeyBuilder::normalizeUrl(request);
+    lookup.primary_key = CacheKeyBuilder::primary(request.get_method(), url);
+    std::vector<std::string> vary = proxy_cache->getVary(lookup.primary_key);
+    lookup.key = CacheKeyBuilder::variant(lookup.primary_key, vary, request);
+    lookup.entry = proxy_cache->get(lookup.key);
+    // Keys are digests; an entry stored for other text is a collision, not a hit
+    if (lookup.entry && lookup.entry->key_text != CacheKeyBuilder::keyText(request.get_method(), url, vary, request)) {
+        LOG_WARNING("(cache)", "cache key collision for " + url + ", treated as a miss");
+        lookup.entry = CacheRef();
+    }
+    return lookup;
+}
+
+void Handler::sendOverloaded(int client_fd, const string& id) {
+    static const long retry_after = std::max(0L, Config::get_long("PROXY_ADMISSION_RETRY_AFTER", 1));
+    LOG_WARNING(id, "overloaded, shedding request");
+    sendErrorResponse(client_fd, 503, "Service Unavailable", id, "Retry-After: " + to_string(retry_after) + "\r\n");
+}
+
+/**
+ * Answers 429 when key is over one of the limiter's limits
+ *
+ * @return True if the request may go on
+ */
+bool Handler::checkRateLimit(int client_fd, RateLimiter* limiter, std::string_view key,
+                             RateLimiter::Permit& permit, const string& id) {
+    if (limiter == nullptr) {
+        return true;
+    }
+    double retry_after = 0;
+    RateLimiter::Verdict verdict = limiter->acquire(key, permit, retry_after);
+    if (verdict == RateLimiter::Verdict::Allowed) {
+        return true;
+    }
+    static const char* const LIMITS[] = {"", "requests", "connections", "bytes"};
+    LOG_WARNING(id, string(limiter->kind()) + " " + string(key) + " over its " +
+                LIMITS[static_cast<int>(verdict)] + " limit");
+    long seconds = std::max(1L, static_cast<long>(std::ceil(retry_after)));
+    sendErrorResponse(client_fd, 429, "Too Many Requests", id, "Retry-After: " + to_string(seconds) + "\r\n");
+    return false;
+}
+
 bool Handler::tunnelTraffic(int client_fd, int server_fd, const string& id) {
     // Set both sockets to non-blocking mode
     int client_flags = fcntl(client_fd, F_GETFL, 0);
@@ -544,24 +1285,24 @@ bool Handler::tunnelTraffic(int client_fd, int server_fd, const string& id) {
     poll_fds[1].fd = server_fd;
     poll_fds[1].events = POLLIN; // 监听POLLIN事件，即监听server_fd的可读事件
     
+    // An idle tunnel is shut down by its deadline, which ends the poll below
+    timeouts::Deadline idle_deadline(client_fd, timeouts::Kind::TunnelIdle);
     while (!client_closed && !server_closed) {
-        int res = poll(poll_fds, 2, 30000); // 30s timeout
+        int res = poll(poll_fds, 2, -1);
         
         if (res < 0) {
-            proxy_logger->write(id + ": ERROR Poll failed in tunnel");
+            if (errno == EINTR) continue;
+            LOG_ERROR(id, "Poll failed in tunnel");
             return false;
         }
-        
-        if (res == 0) {
-            // Timeout
-            continue;
-        }
+        idle_deadline.rearm();
         
         // Check client -> server
         if (poll_fds[0].revents & POLLIN) { // 如果client_fd可读
             ssize_t bytes_read = recv(client_fd, buffer, BUFFER_SIZE, 0); // 读取client_fd的数据
             
             if (bytes_read > 0) {
+                access_log::Current::received(static_cast<size_t>(bytes_read));
                 if (!sendAll(server_fd, buffer, bytes_read)) { // 发送数据到server_fd
                     server_closed = true;
                 }
@@ -586,11 +1327,16 @@ bool Handler::tunnelTraffic(int client_fd, int server_fd, const string& id) {
         // Check for other events (errors or hangups)
         if ((poll_fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) || 
             (poll_fds[1].revents & (POLLERR | POLLHUP | POLLNVAL))) {
-            proxy_logger->write(id + ": NOTE Tunnel connection terminated by peer");
+            LOG_NOTE(id, "Tunnel connection terminated by peer");
             break;
         }
     }
     
+    if (idle_deadline.expired()) {
+        LOG_NOTE(id, "Tunnel idle too long, closed");
+    }
+    idle_deadline.cancel();
+
     // Restore socket flags
     fcntl(client_fd, F_SETFL, client_flags);
     fcntl(server_fd, F_SETFL, server_flags);
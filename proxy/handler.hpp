@@ -11,19 +11,43 @@
 #include "request.hpp"
 #include "response.hpp"
 #include "cache.hpp"
+#include "negative_cache.hpp"
 #include "log.hpp"
+#include "range.hpp"
+#include "admission.hpp"
+#include "rate_limit.hpp"
+#include "upstream.hpp"
+#include <sys/uio.h>
 
 using namespace std;
 
-// Singleton logger for the proxy
-extern Log* proxy_logger;
 // Singleton cache for the proxy
 extern Cache* proxy_cache;
+// Recently unreachable origins
+extern NegativeCache* proxy_negative_cache;
+// Bound on requests processed at once
+extern AdmissionControl* proxy_admission;
+// Limits per client address and per origin host
+extern RateLimiter* proxy_client_limiter;
+extern RateLimiter* proxy_origin_limiter;
+// Upstream slots per origin, with circuit breakers
+extern UpstreamScheduler* proxy_upstream;
 
 struct ThreadData {
     std::shared_ptr<ISocket> client_socket;
     string id;
-    
+    std::chrono::steady_clock::time_point accepted;
+    bool claimed = false;  // Holds an AdmissionControl connection claim
+};
+
+/**
+ * A GET's cache lookup, done once to pick its admission priority and then
+ * reused to serve it
+ */
+struct CacheLookup {
+    CacheKey primary_key;
+    CacheKey key;
+    CacheRef entry;
 };
 
 class Handler {
@@ -31,13 +55,27 @@ private:
     // Helper methods for request processing
     static string generateUniqueID();
     static string getCurrentTimeStr();
-    static bool processGetRequest(int client_fd, const Request& request, const string& id);
+    static CacheLookup lookupCache(const Request& request);
+    static bool processGetRequest(int client_fd, const Request& request, const CacheLookup& lookup, const string& id);
     static bool processPostRequest(int client_fd, const Request& request, const string& id);
     static bool processConnectRequest(int client_fd, const Request& request, const string& id);
     static bool forwardRequest(int client_fd, const Request& request, const string& id);
-    static void sendErrorResponse(int client_fd, int status_code, const string& message, const string& id);
+    static void sendErrorResponse(int client_fd, int status_code, const string& message, const string& id,
+                                  const string& extra_headers = "");
+    static AdmissionControl::Priority admissionPriority(const CacheLookup& lookup);
+    static void sendOverloaded(int client_fd, const string& id);
+    static bool checkRateLimit(int client_fd, RateLimiter* limiter, std::string_view key,
+                               RateLimiter::Permit& permit, const string& id);
     static bool tunnelTraffic(int client_fd, int server_fd, const string& id);
-    static bool sendAll(int fd, const void* data, size_t size);
+    static bool isStorable(const Request& request, const Response& response, bool& is_negative, const string& id);
+    static bool isUnstoredHeader(const string& name);
+    static bool dechunk(std::vector<uint8_t>& body);
+    static bool isCompressible(const Response& response, size_t body_size);
+    static bool sendVector(int fd, std::vector<iovec>& iov);
+    static void appendSlices(const BlobRef& data, size_t offset, size_t size, std::vector<iovec>& iov);
+    static bool sendCachedRange(int client_fd, const CacheEntry& entry, http_range::Result range,
+                                const std::vector<http_range::Slice>& slices, const string& id);
+    static void scheduleFullFetch(const Request& request, const CacheKey& primary_key, const string& id);
 public:
     // Create and detach a new thread for handling connection
     static bool create_connection_thread(std::shared_ptr<ISocket> client_socket, string id);
@@ -45,6 +83,12 @@ public:
 
     // Handle client connection in a thread
     static void* handle_connection(void* arg);
+
+    // Send a whole buffer, retrying short writes (also used by bench/microbench)
+    static bool sendAll(int fd, const void* data, size_t size);
+
+    // Fetch a request from the origin into the cache with no client (used by warm-up)
+    static bool prefetch(const Request& request, const string& id);
 };
 
 #endif // HANDLER_HPP
\ No newline at end of file
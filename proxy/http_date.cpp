@@ -0,0 +1,315 @@
+#include "http_date.hpp"
+#include <chrono>
+#include <cstring>
+
+namespace http_date {
+
+namespace {
+
+const char* const kDays[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+const char* const kMonths[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/**
+ * Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant's algorithm)
+ */
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+void civil_from_days(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+struct Fields {
+    int64_t year;
+    unsigned month, day, hour, minute, second, weekday;
+};
+
+Fields split(time_t t) {
+    int64_t days = t / 86400;
+    int64_t secs = t % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        --days;
+    }
+    Fields f;
+    civil_from_days(days, f.year, f.month, f.day);
+    f.hour = static_cast<unsigned>(secs / 3600);
+    f.minute = static_cast<unsigned>(secs / 60 % 60);
+    f.second = static_cast<unsigned>(secs % 60);
+    f.weekday = static_cast<unsigned>(((days % 7) + 11) % 7);  // 1970-01-01 was a Thursday
+    return f;
+}
+
+inline void put2(char* p, unsigned v) {
+    p[0] = static_cast<char>('0' + v / 10);
+    p[1] = static_cast<char>('0' + v % 10);
+}
+
+inline void put4(char* p, int64_t v) {
+    unsigned u = static_cast<unsigned>(v < 0 ? 0 : v % 10000);
+    put2(p, u / 100);
+    put2(p + 2, u % 100);
+}
+
+/**
+ * Minimal cursor over the header value; every helper returns false on mismatch
+ */
+struct Cursor {
+    const char* p;
+    const char* end;
+
+    bool lit(char c) {
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    bool digits(unsigned count, unsigned& out) {
+        out = 0;
+        for (unsigned i = 0; i < count; ++i) {
+            if (p >= end || *p < '0' || *p > '9') return false;
+            out = out * 10 + static_cast<unsigned>(*p++ - '0');
+        }
+        return true;
+    }
+
+    // Month abbreviations are case-sensitive per RFC 9110
+    bool month(unsigned& out) {
+        if (end - p < 3) return false;
+        for (unsigned i = 0; i < 12; ++i) {
+            if (memcmp(p, kMonths[i], 3) == 0) {
+                out = i + 1;
+                p += 3;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Skips a day name, short ("Sun") or long ("Sunday")
+    bool day_name() {
+        const char* start = p;
+        while (p < end && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) ++p;
+        return p - start >= 3;
+    }
+
+    bool clock(unsigned& h, unsigned& m, unsigned& s) {
+        return digits(2, h) && lit(':') && digits(2, m) && lit(':') && digits(2, s);
+    }
+};
+
+unsigned days_in_month(int64_t year, unsigned month) {
+    static const unsigned kDays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    return month == 2 && leap ? 29 : kDays[month - 1];
+}
+
+bool to_time(int64_t year, unsigned month, unsigned day, unsigned h, unsigned m, unsigned s, time_t& out) {
+    if (day < 1 || day > days_in_month(year, month) || h > 23 || m > 59 || s > 60) {
+        return false;
+    }
+    out = static_cast<time_t>(days_from_civil(year, month, day) * 86400 + h * 3600 + m * 60 + s);
+    return true;
+}
+
+} // namespace
+
+bool parse(std::string_view str, time_t& out) {
+    Cursor c{str.data(), str.data() + str.size()};
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t')) ++c.p;
+
+    unsigned day = 0, month = 0, year = 0, h = 0, m = 0, s = 0;
+    if (!c.day_name()) {
+        return false;
+    }
+
+    if (c.lit(',')) {
+        if (!c.lit(' ')) return false;
+        if (c.end - c.p >= 3 && c.p[2] == '-') {
+            // RFC 850: Sunday, 06-Nov-94 08:49:37 GMT
+            if (!(c.digits(2, day) && c.lit('-') && c.month(month) && c.lit('-') &&
+                  c.digits(2, year) && c.lit(' ') && c.clock(h, m, s) && c.lit(' ') &&
+                  c.lit('G') && c.lit('M') && c.lit('T'))) {
+                return false;
+            }
+            // A two-digit year more than 50 years in the future belongs to the past century
+            int64_t now_year = split(CoarseClock::now()).year;
+            int64_t full = now_year - now_year % 100 + year;
+            if (full > now_year + 50) full -= 100;
+            return to_time(full, month, day, h, m, s, out);
+        }
+        // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+        if (!(c.digits(2, day) && c.lit(' ') && c.month(month) && c.lit(' ') &&
+              c.digits(4, year) && c.lit(' ') && c.clock(h, m, s) && c.lit(' ') &&
+              c.lit('G') && c.lit('M') && c.lit('T'))) {
+            return false;
+        }
+        return to_time(year, month, day, h, m, s, out);
+    }
+
+    // asctime: Sun Nov  6 08:49:37 1994
+    if (!(c.lit(' ') && c.month(month) && c.lit(' '))) {
+        return false;
+    }
+    if (!c.lit(' ')) {
+        if (!c.digits(2, day)) return false;
+    } else if (!c.digits(1, day)) {
+        return false;
+    }
+    if (!(c.lit(' ') && c.clock(h, m, s) && c.lit(' ') && c.digits(4, year))) {
+        return false;
+    }
+    return to_time(year, month, day, h, m, s, out);
+}
+
+void format_imf(time_t t, char* buf) {
+    Fields f = split(t);
+    memcpy(buf, kDays[f.weekday], 3);
+    buf[3] = ',';
+    buf[4] = ' ';
+    put2(buf + 5, f.day);
+    buf[7] = ' ';
+    memcpy(buf + 8, kMonths[f.month - 1], 3);
+    buf[11] = ' ';
+    put4(buf + 12, f.year);
+    buf[16] = ' ';
+    put2(buf + 17, f.hour);
+    buf[19] = ':';
+    put2(buf + 20, f.minute);
+    buf[22] = ':';
+    put2(buf + 23, f.second);
+    memcpy(buf + 25, " GMT", 4);
+}
+
+std::string format_imf(time_t t) {
+    char buf[IMF_LEN];
+    format_imf(t, buf);
+    return std::string(buf, IMF_LEN);
+}
+
+void format_asctime(time_t t, char* buf) {
+    Fields f = split(t);
+    memcpy(buf, kDays[f.weekday], 3);
+    buf[3] = ' ';
+    memcpy(buf + 4, kMonths[f.month - 1], 3);
+    buf[7] = ' ';
+    put2(buf + 8, f.day);
+    if (f.day < 10) buf[8] = ' ';
+    buf[10] = ' ';
+    put2(buf + 11, f.hour);
+    buf[13] = ':';
+    put2(buf + 14, f.minute);
+    buf[16] = ':';
+    put2(buf + 17, f.second);
+    buf[19] = ' ';
+    put4(buf + 20, f.year);
+}
+
+std::string format_asctime(time_t t) {
+    char buf[ASCTIME_LEN];
+    format_asctime(t, buf);
+    return std::string(buf, ASCTIME_LEN);
+}
+
+} // namespace http_date
+
+std::atomic<time_t> CoarseClock::now_{0};
+std::atomic<uint64_t> CoarseClock::seq_{0};
+std::atomic<uint64_t> CoarseClock::imf_[CoarseClock::WORDS];
+std::atomic<uint64_t> CoarseClock::asctime_[CoarseClock::WORDS];
+std::atomic<bool> CoarseClock::running_{false};
+std::thread CoarseClock::thread_;
+
+/**
+ * @brief Republishes the time and both preformatted strings under the seqlock
+ */
+void CoarseClock::publish(time_t t) {
+    char imf[WORDS * 8] = {};
+    char asc[WORDS * 8] = {};
+    http_date::format_imf(t, imf);
+    http_date::format_asctime(t, asc);
+
+    seq_.fetch_add(1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) {
+        uint64_t w;
+        memcpy(&w, imf + i * 8, 8);
+        imf_[i].store(w, std::memory_order_relaxed);
+        memcpy(&w, asc + i * 8, 8);
+        asctime_[i].store(w, std::memory_order_relaxed);
+    }
+    now_.store(t, std::memory_order_relaxed);
+    seq_.fetch_add(1, std::memory_order_release);  // even: stable
+}
+
+/**
+ * @brief Copies a consistent snapshot of one preformatted string
+ */
+CoarseClock::Text CoarseClock::read(const std::atomic<uint64_t>* words, size_t len, void (*fallback)(time_t, char*)) {
+    Text text;
+    text.size = len;
+    if (!running_.load(std::memory_order_relaxed)) {
+        fallback(::time(nullptr), text.data);
+        return text;
+    }
+    uint64_t before, after;
+    do {
+        before = seq_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < WORDS; ++i) {
+            uint64_t w = words[i].load(std::memory_order_relaxed);
+            memcpy(text.data + i * 8, &w, 8);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = seq_.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return text;
+}
+
+void CoarseClock::start() {
+    bool expected = false;
+    if (!running_.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    publish(::time(nullptr));
+    thread_ = std::thread([] {
+        using namespace std::chrono;
+        while (running_.load(std::memory_order_relaxed)) {
+            // Wake just after each second boundary so the published second is never stale
+            auto next = time_point_cast<seconds>(system_clock::now()) + seconds(1);
+            std::this_thread::sleep_until(next);
+            publish(system_clock::to_time_t(system_clock::now()));
+        }
+    });
+}
+
+void CoarseClock::stop() {
+    if (running_.exchange(false) && thread_.joinable()) {
+        thread_.join();
+    }
+    now_.store(0, std::memory_order_relaxed);
+}
+
+CoarseClock::Text CoarseClock::date_str() {
+    return read(imf_, http_date::IMF_LEN, http_date::format_imf);
+}
+
+CoarseClock::Text CoarseClock::log_time_str() {
+    return read(asctime_, http_date::ASCTIME_LEN, http_date::format_asctime);
+}
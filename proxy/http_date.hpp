@@ -0,0 +1,109 @@
+#ifndef HTTP_DATE_HPP
+#define HTTP_DATE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * Allocation-free HTTP-date parsing and formatting (RFC 9110 section 5.6.7)
+ *
+ * Nothing here goes through strptime/gmtime, so every function is reentrant.
+ */
+namespace http_date {
+
+constexpr size_t IMF_LEN = 29;      // "Sun, 06 Nov 1994 08:49:37 GMT"
+constexpr size_t ASCTIME_LEN = 24;  // "Sun Nov  6 08:49:37 1994"
+
+/**
+ * Parses an HTTP-date in IMF-fixdate, obsolete RFC 850 or asctime format
+ *
+ * @param str The header value
+ * @param out Seconds since the epoch (UTC) on success
+ * @return False if the value is not a valid HTTP-date
+ */
+bool parse(std::string_view str, time_t& out);
+
+/**
+ * Formats a time as IMF-fixdate; buf must hold at least IMF_LEN bytes (not NUL-terminated)
+ */
+void format_imf(time_t t, char* buf);
+std::string format_imf(time_t t);
+
+/**
+ * Formats a time like asctime() without the trailing newline; buf must hold ASCTIME_LEN bytes
+ */
+void format_asctime(time_t t, char* buf);
+std::string format_asctime(time_t t);
+
+} // namespace http_date
+
+/**
+ * Process-wide clock with one-second resolution
+ *
+ * A background thread republishes the current time and its preformatted
+ * representations once per second, so handler threads can read "now" with a
+ * single atomic load. Before start() (or after stop()) the calls fall back to
+ * reading the system clock directly.
+ */
+class CoarseClock {
+private:
+    // Seqlock-protected preformatted strings, stored as atomic words to stay race-free
+    static constexpr size_t WORDS = 4;
+    static std::atomic<time_t> now_;
+    static std::atomic<uint64_t> seq_;
+    static std::atomic<uint64_t> imf_[WORDS];
+    static std::atomic<uint64_t> asctime_[WORDS];
+    static std::atomic<bool> running_;
+    static std::thread thread_;
+
+public:
+    /**
+     * A preformatted time held inline, so reading one never allocates
+     */
+    struct Text {
+        char data[WORDS * 8];
+        size_t size;
+        std::string_view view() const { return std::string_view(data, size); }
+        operator std::string_view() const { return view(); }
+    };
+
+private:
+    static void publish(time_t t);
+    static Text read(const std::atomic<uint64_t>* words, size_t len, void (*fallback)(time_t, char*));
+
+public:
+    /**
+     * Starts the updater thread (idempotent)
+     */
+    static void start();
+
+    /**
+     * Stops and joins the updater thread
+     */
+    static void stop();
+
+    /**
+     * Current time in seconds since the epoch
+     */
+    static time_t now() {
+        time_t t = now_.load(std::memory_order_relaxed);
+        return t != 0 ? t : ::time(nullptr);
+    }
+
+    /**
+     * Current time as an IMF-fixdate, suitable for a Date header
+     */
+    static Text date_str();
+
+    /**
+     * Current time in asctime format, as written to the proxy log
+     */
+    static Text log_time_str();
+};
+
+#endif // HTTP_DATE_HPP
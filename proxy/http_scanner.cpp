@@ -0,0 +1,362 @@
+#include "http_scanner.hpp"
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+namespace http_scan {
+
+namespace {
+
+/**
+ * tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." /
+ *         "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+ */
+constexpr bool is_tchar(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '!' || c == '#' || c == '$' || c == '%' || c == '&' || c == '\'' ||
+           c == '*' || c == '+' || c == '-' || c == '.' || c == '^' || c == '_' ||
+           c == '`' || c == '|' || c == '~';
+}
+
+struct TokenTables {
+    bool scalar[256];
+    // Nibble bitmap for pshufb lookups: bit h of lo[l] is set when byte (h << 4 | l) is a tchar
+    alignas(16) uint8_t lo[16];
+    alignas(16) uint8_t hi[16];
+
+    constexpr TokenTables() : scalar(), lo(), hi() {
+        for (int c = 0; c < 256; ++c) {
+            scalar[c] = is_tchar(static_cast<unsigned char>(c));
+        }
+        for (int l = 0; l < 16; ++l) {
+            uint8_t bits = 0;
+            for (int h = 0; h < 8; ++h) {
+                if (is_tchar(static_cast<unsigned char>(h << 4 | l))) {
+                    bits |= static_cast<uint8_t>(1u << h);
+                }
+            }
+            lo[l] = bits;
+            hi[l] = l < 8 ? static_cast<uint8_t>(1u << l) : 0;
+        }
+    }
+};
+
+constexpr TokenTables kTokens;
+
+// ---------------------------------------------------------------------------
+// Scalar implementations
+
+size_t find_crlf_scalar(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        const char* cr = static_cast<const char*>(memchr(p, '\r', end - p));
+        if (cr == nullptr || cr + 1 >= end) {
+            return npos;
+        }
+        if (cr[1] == '\n') {
+            return cr - data;
+        }
+        p = cr + 1;
+    }
+    return npos;
+}
+
+size_t find_char_scalar(const char* data, size_t size, char c) {
+    const char* hit = static_cast<const char*>(memchr(data, c, size));
+    return hit ? static_cast<size_t>(hit - data) : npos;
+}
+
+bool is_token_scalar(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (!kTokens.scalar[static_cast<unsigned char>(data[i])]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t find_terminator_scalar(const char* data, size_t size, size_t from) {
+    for (size_t i = from; i + 4 <= size; ++i) {
+        const char* cr = static_cast<const char*>(memchr(data + i, '\r', size - 3 - i));
+        if (cr == nullptr) {
+            return npos;
+        }
+        i = cr - data;
+        if (memcmp(cr, "\r\n\r\n", 4) == 0) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+#ifdef HTTP_SCAN_X86
+
+// ---------------------------------------------------------------------------
+// SSE4.2 implementations (16 bytes per step)
+
+__attribute__((target("sse4.2")))
+size_t find_crlf_sse42(const char* data, size_t size) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 17 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    size_t rest = find_crlf_scalar(data + i, size - i);
+    return rest == npos ? npos : i + rest;
+}
+
+__attribute__((target("sse4.2")))
+size_t find_char_sse42(const char* data, size_t size, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    size_t rest = find_char_scalar(data + i, size - i, c);
+    return rest == npos ? npos : i + rest;
+}
+
+__attribute__((target("sse4.2")))
+bool is_token_sse42(const char* data, size_t size) {
+    const __m128i lo_table = _mm_load_si128(reinterpret_cast<const __m128i*>(kTokens.lo));
+    const __m128i hi_table = _mm_load_si128(reinterpret_cast<const __m128i*>(kTokens.hi));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo_bits = _mm_shuffle_epi8(lo_table, _mm_and_si128(v, nibble));
+        __m128i hi_bits = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i bad = _mm_cmpeq_epi8(_mm_and_si128(lo_bits, hi_bits), zero);
+        if (_mm_movemask_epi8(bad) != 0) {
+            return false;
+        }
+    }
+    return is_token_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse4.2")))
+size_t find_terminator_sse42(const char* data, size_t size, size_t from) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = from;
+    for (; i + 19 <= size; i += 16) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(data + i);
+        __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128(p), cr);
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1)), lf));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 2)), cr));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 3)), lf));
+        int mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return find_terminator_scalar(data, size, i);
+}
+
+// ---------------------------------------------------------------------------
+// AVX2 implementations (32 bytes per step)
+//
+// Tails fall back to scalar code rather than the SSE versions: calling legacy-encoded
+// SSE from a function with dirty upper YMM state costs a transition penalty.
+
+__attribute__((target("avx2")))
+size_t find_crlf_avx2(const char* data, size_t size) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 33 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf))));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    size_t rest = find_crlf_scalar(data + i, size - i);
+    return rest == npos ? npos : i + rest;
+}
+
+__attribute__((target("avx2")))
+size_t find_char_avx2(const char* data, size_t size, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    size_t rest = find_char_scalar(data + i, size - i, c);
+    return rest == npos ? npos : i + rest;
+}
+
+__attribute__((target("avx2")))
+bool is_token_avx2(const char* data, size_t size) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(kTokens.lo)));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(kTokens.hi)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i lo_bits = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble));
+        __m256i hi_bits = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i bad = _mm256_cmpeq_epi8(_mm256_and_si256(lo_bits, hi_bits), zero);
+        if (_mm256_movemask_epi8(bad) != 0) {
+            return false;
+        }
+    }
+    return is_token_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+size_t find_terminator_avx2(const char* data, size_t size, size_t from) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = from;
+    for (; i + 35 <= size; i += 32) {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), cr);
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1)), lf));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 2)), cr));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 3)), lf));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return find_terminator_scalar(data, size, i);
+}
+
+#endif // HTTP_SCAN_X86
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+
+struct Dispatch {
+    SimdLevel level;
+    size_t (*find_crlf)(const char*, size_t);
+    size_t (*find_char)(const char*, size_t, char);
+    bool (*is_token)(const char*, size_t);
+    size_t (*find_terminator)(const char*, size_t, size_t);
+};
+
+constexpr Dispatch kScalar = {SimdLevel::Scalar, find_crlf_scalar, find_char_scalar,
+                              is_token_scalar, find_terminator_scalar};
+#ifdef HTTP_SCAN_X86
+constexpr Dispatch kSse42 = {SimdLevel::SSE42, find_crlf_sse42, find_char_sse42,
+                             is_token_sse42, find_terminator_sse42};
+constexpr Dispatch kAvx2 = {SimdLevel::AVX2, find_crlf_avx2, find_char_avx2,
+                            is_token_avx2, find_terminator_avx2};
+#endif
+
+bool cpu_supports(SimdLevel level) {
+#ifdef HTTP_SCAN_X86
+    switch (level) {
+        case SimdLevel::AVX2:  return __builtin_cpu_supports("avx2");
+        case SimdLevel::SSE42: return __builtin_cpu_supports("sse4.2");
+        default:               return true;
+    }
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+const Dispatch& dispatch_for(SimdLevel level) {
+#ifdef HTTP_SCAN_X86
+    if (level == SimdLevel::AVX2) return kAvx2;
+    if (level == SimdLevel::SSE42) return kSse42;
+#endif
+    return kScalar;
+}
+
+SimdLevel best_level() {
+    if (cpu_supports(SimdLevel::AVX2)) return SimdLevel::AVX2;
+    if (cpu_supports(SimdLevel::SSE42)) return SimdLevel::SSE42;
+    return SimdLevel::Scalar;
+}
+
+// Starts out scalar so calls made during static initialization are still safe
+Dispatch g_dispatch = kScalar;
+const bool g_dispatch_ready = (g_dispatch = dispatch_for(best_level()), true);
+
+} // namespace
+
+SimdLevel active_level() {
+    return g_dispatch.level;
+}
+
+SimdLevel force_level(SimdLevel level) {
+    if (cpu_supports(level)) {
+        g_dispatch = dispatch_for(level);
+    }
+    return g_dispatch.level;
+}
+
+const char* level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:  return "avx2";
+        case SimdLevel::SSE42: return "sse4.2";
+        default:               return "scalar";
+    }
+}
+
+size_t find_crlf(const char* data, size_t size) {
+    return g_dispatch.find_crlf(data, size);
+}
+
+size_t find_char(const char* data, size_t size, char c) {
+    return g_dispatch.find_char(data, size, c);
+}
+
+bool is_token(const char* data, size_t size) {
+    return size > 0 && g_dispatch.is_token(data, size);
+}
+
+size_t find_header_end(const char* data, size_t size, size_t& scan_from) {
+    size_t pos = g_dispatch.find_terminator(data, size, scan_from);
+    if (pos == npos) {
+        // Keep the last three bytes: the terminator may straddle the next recv
+        size_t resume = size >= 3 ? size - 3 : 0;
+        if (resume > scan_from) {
+            scan_from = resume;
+        }
+    }
+    return pos;
+}
+
+bool split_header(std::string_view line, std::string_view& name, std::string_view& value) {
+    size_t colon = find_char(line.data(), line.size(), ':');
+    if (colon == npos || !is_token(line.data(), colon)) {
+        return false;
+    }
+    name = line.substr(0, colon);
+
+    size_t begin = colon + 1;
+    size_t end = line.size();
+    while (begin < end && (line[begin] == ' ' || line[begin] == '\t')) ++begin;
+    while (end > begin && (line[end - 1] == ' ' || line[end - 1] == '\t')) --end;
+    value = line.substr(begin, end - begin);
+    return true;
+}
+
+} // namespace http_scan
@@ -0,0 +1,74 @@
+#ifndef HTTP_SCANNER_HPP
+#define HTTP_SCANNER_HPP
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * Vectorized helpers for framing and splitting HTTP/1.x header blocks.
+ *
+ * Every routine has a scalar, an SSE4.2 and an AVX2 implementation; the
+ * widest one supported by the running CPU is picked once at startup.
+ */
+namespace http_scan {
+
+constexpr size_t npos = static_cast<size_t>(-1);
+
+enum class SimdLevel { Scalar, SSE42, AVX2 };
+
+/**
+ * Reports the implementation selected for this CPU
+ */
+SimdLevel active_level();
+
+/**
+ * Overrides the dispatch (benchmarks only). Levels the CPU cannot run are ignored.
+ *
+ * @return The level actually in effect afterwards
+ */
+SimdLevel force_level(SimdLevel level);
+
+const char* level_name(SimdLevel level);
+
+/**
+ * Finds the first "\r\n" in [data, data + size)
+ *
+ * @return Offset of the '\r', or npos
+ */
+size_t find_crlf(const char* data, size_t size);
+
+/**
+ * Finds the first occurrence of a byte in [data, data + size)
+ *
+ * @return Offset of the byte, or npos
+ */
+size_t find_char(const char* data, size_t size, char c);
+
+/**
+ * Checks that every byte is an RFC 9110 tchar (valid in header names and methods)
+ */
+bool is_token(const char* data, size_t size);
+
+/**
+ * Incremental search for the "\r\n\r\n" header terminator
+ *
+ * @param data Accumulated bytes received so far
+ * @param size Number of accumulated bytes
+ * @param scan_from In: offset to resume from (0 on the first call).
+ *                  Out: where the next call should resume when not found.
+ * @return Offset of the terminator, or npos if not yet present
+ */
+size_t find_header_end(const char* data, size_t size, size_t& scan_from);
+
+/**
+ * Splits one header line (without its CRLF) into name and value
+ *
+ * The name must be a valid token; surrounding whitespace is trimmed from the value.
+ *
+ * @return False if the line has no colon or the name is not a token
+ */
+bool split_header(std::string_view line, std::string_view& name, std::string_view& value);
+
+} // namespace http_scan
+
+#endif // HTTP_SCANNER_HPP
@@ -0,0 +1,158 @@
+#include "lingering.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace lingering {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int MAX_WAIT_MS = 100;           // Accuracy of the linger deadline
+const size_t MAX_DRAIN = 1024 * 1024;  // A client still sending this much after the response is cut off
+
+struct Lingering {
+    std::shared_ptr<ISocket> socket;
+    Clock::time_point until;
+    size_t drained = 0;
+};
+
+Clock::duration linger_for;
+size_t max_sockets = 0;
+int epoll_fd = -1;
+
+std::mutex mutex;
+std::unordered_map<int, Lingering> sockets;
+// Every socket lingers equally long, so arrival order is deadline order
+std::deque<std::pair<Clock::time_point, int>> order;
+
+const char* HELP = "Client connections closed after lingering, by how the linger ended";
+metrics::Counter ended_eof("proxy_linger_closed_total", HELP, "end=\"eof\"");
+metrics::Counter ended_timeout("proxy_linger_closed_total", HELP, "end=\"timeout\"");
+metrics::Counter ended_drain_limit("proxy_linger_closed_total", HELP, "end=\"drain_limit\"");
+metrics::Counter ended_full("proxy_linger_closed_total", HELP, "end=\"full\"");
+
+/**
+ * Drops the socket, closing it unless someone else still holds it; caller holds the lock
+ */
+void finish(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    sockets.erase(fd);
+}
+
+/**
+ * Discards what the client sent
+ *
+ * @return False once the client has closed, failed or sent too much
+ */
+bool drain(int fd, Lingering& entry) {
+    char buffer[BUFFER_SIZE];
+    while (true) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            entry.drained += static_cast<size_t>(n);
+            if (entry.drained >= MAX_DRAIN) {
+                ended_drain_limit.inc();
+                return false;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        ended_eof.inc();
+        return false;
+    }
+}
+
+void run() {
+    epoll_event events[64];
+    while (true) {
+        int wait_ms = MAX_WAIT_MS;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!order.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(order.front().first - Clock::now());
+                wait_ms = static_cast<int>(std::clamp<int64_t>(left.count() + 1, 0, MAX_WAIT_MS));
+            }
+        }
+        int ready = epoll_wait(epoll_fd, events, 64, wait_ms);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            auto it = sockets.find(fd);
+            if (it != sockets.end() && !drain(fd, it->second)) {
+                finish(fd);
+            }
+        }
+        Clock::time_point now = Clock::now();
+        while (!order.empty() && order.front().first <= now) {
+            auto [until, fd] = order.front();
+            order.pop_front();
+            auto it = sockets.find(fd);
+            // Already gone, or the descriptor now belongs to a later connection
+            if (it == sockets.end() || it->second.until != until) {
+                continue;
+            }
+            ended_timeout.inc();
+            finish(fd);
+        }
+    }
+}
+
+} // namespace
+
+void close(std::shared_ptr<ISocket> socket) {
+    socket->shutdownWrite();
+    int fd = socket->getSocketFd();
+    if (epoll_fd < 0 || fd < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sockets.size() >= max_sockets) {
+        ended_full.inc();
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Clock::time_point until = Clock::now() + linger_for;
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        return;
+    }
+    sockets[fd] = Lingering{std::move(socket), until};
+    order.emplace_back(until, fd);
+}
+
+size_t pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sockets.size();
+}
+
+void start() {
+    long ms = Config::get_long("PROXY_LINGER_MS", 2000);
+    max_sockets = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_LINGER_MAX", 4096)));
+    if (ms <= 0 || max_sockets == 0) {
+        return;
+    }
+    linger_for = std::chrono::milliseconds(ms);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOG_ERROR("(no-id)", "Failed to create epoll instance for lingering close; closing at once");
+        return;
+    }
+    std::thread(run).detach();
+}
+
+} // namespace lingering
@@ -0,0 +1,39 @@
+#ifndef LINGERING_HPP
+#define LINGERING_HPP
+
+#include "socket.hpp"
+#include <cstddef>
+#include <memory>
+
+/**
+ * Lingering close of client connections
+ *
+ * Closing a socket that still has unread input makes the kernel send a
+ * reset, and the client may then lose the end of a response it has not read
+ * yet. So a finished connection is half-closed instead. Then one background
+ * thread reads and discards whatever the client still sends, until the
+ * client closes its side or the linger time runs out, and only then closes
+ * the socket. The handler thread goes back to work at once.
+ */
+namespace lingering {
+
+/**
+ * Half-closes socket and hands it to the closer thread
+ *
+ * Closes it at once when lingering is disabled or too many sockets linger.
+ */
+void close(std::shared_ptr<ISocket> socket);
+
+/**
+ * Sockets waiting to be closed
+ */
+size_t pending();
+
+/**
+ * Reads the settings and starts the closer thread
+ */
+void start();
+
+} // namespace lingering
+
+#endif // LINGERING_HPP
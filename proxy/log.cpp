@@ -1,3 +1,394 @@
 #include "log.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sched.h>
+#include <stdexcept>
+#include <unistd.h>
 
-const char* LOG_FILE = "./logs/proxy.log";
\ No newline at end of file
+const char* LOG_FILE = "./logs/proxy.log";
+
+Log* proxy_logger = nullptr;
+
+namespace {
+
+// The writer appends once its batch reaches this size, even mid-pass
+const size_t BATCH_BYTES = 256 * 1024;
+
+// Longest a blocked producer waits for room before dropping its line
+const std::chrono::seconds BLOCK_LIMIT(1);
+
+std::atomic<Log*> signal_log{nullptr};
+
+const char* const LEVEL_NAMES[] = {"trace", "debug", "info", "note", "warning", "error"};
+const char* const LEVEL_TAGS[] = {"TRACE ", "DEBUG ", "", "NOTE ", "WARNING ", "ERROR "};
+
+int level_from_config() {
+    std::string name = Config::get_string("PROXY_LOG_LEVEL", "info");
+    for (int i = 0; i < 6; ++i) {
+        if (name == LEVEL_NAMES[i]) {
+            return i;
+        }
+    }
+    return static_cast<int>(LogLevel::Info);
+}
+
+size_t round_up_pow2(size_t n) {
+    size_t p = 4096;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+bool write_fully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Single-producer single-consumer byte ring. head and tail count bytes ever
+ * written and read, so head - tail is the fill level.
+ */
+struct Log::Ring {
+    explicit Ring(size_t bytes) : data(new char[bytes]), mask(bytes - 1) {}
+
+    size_t capacity() const { return mask + 1; }
+
+    std::unique_ptr<char[]> data;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};  // Advanced by the owning thread
+    alignas(64) std::atomic<size_t> tail{0};  // Advanced by the drainer
+    std::atomic<bool> retired{false};         // Owner exited; recycle once empty
+    bool free = false;                        // On free_rings_, under rings_mutex_
+};
+
+/**
+ * The calling thread's ring, handed back when the thread exits
+ */
+struct LogThreadSlot {
+    Log* log = nullptr;
+    Log::Ring* ring = nullptr;
+
+    ~LogThreadSlot() {
+        if (ring) {
+            log->releaseRing(ring);
+        }
+    }
+};
+
+namespace {
+
+// One slot per kind of stream, so the text log and the binary access log
+// each keep a ring on threads that write to both
+thread_local LogThreadSlot log_slot;
+thread_local LogThreadSlot binary_slot;
+
+} // namespace
+
+Log::Log(const std::string& path, bool text)
+    : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666)), text_(text), level_(level_from_config()) {
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    ring_bytes_ = round_up_pow2(static_cast<size_t>(std::max(0L, Config::get_long("PROXY_LOG_BUFFER", 64 * 1024))));
+    overflow_ = Config::get_string("PROXY_LOG_OVERFLOW", "block") == "drop" ? Overflow::Drop : Overflow::Block;
+    interval_ = std::chrono::milliseconds(std::max(1L, Config::get_long("PROXY_LOG_FLUSH_MS", 100)));
+    writer_ = std::thread(&Log::writerLoop, this);
+}
+
+Log::~Log() {
+    Log* self = this;
+    signal_log.compare_exchange_strong(self, nullptr);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    for (size_t i = 0; i < ring_count_.load(); ++i) {
+        delete rings_[i].load();
+    }
+    ::close(fd_);
+}
+
+void Log::write(std::string_view message) {
+    if (log_slot.log != this) {
+        if (log_slot.ring) {
+            log_slot.log->releaseRing(log_slot.ring);
+        }
+        log_slot.log = this;
+        log_slot.ring = acquireRing();
+    }
+    if (log_slot.ring) {
+        push(log_slot.ring, message, true);
+    } else {
+        writeDirect(message, true);
+    }
+}
+
+void Log::append(const void* data, size_t size) {
+    std::string_view bytes(static_cast<const char*>(data), size);
+    LogThreadSlot& slot = text_ ? log_slot : binary_slot;
+    if (slot.log != this) {
+        if (slot.ring) {
+            slot.log->releaseRing(slot.ring);
+        }
+        slot.log = this;
+        slot.ring = acquireRing();
+    }
+    if (slot.ring) {
+        push(slot.ring, bytes, false);
+    } else {
+        writeDirect(bytes, false);
+    }
+}
+
+void Log::write(LogLevel level, std::string_view id, std::string_view message) {
+    // Reused per thread, so formatting allocates only while lines keep growing
+    thread_local std::string line;
+    line.assign(id);
+    line += ": ";
+    line += LEVEL_TAGS[static_cast<int>(level)];
+    line += message;
+    write(line);
+}
+
+void Log::push(Ring* ring, std::string_view message, bool newline) {
+    const size_t capacity = ring->capacity();
+    if (message.size() >= capacity) {
+        if (!newline) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);  // A cut record is garbage
+            return;
+        }
+        message = message.substr(0, capacity - 1);  // A line never outgrows one ring
+    }
+    const size_t needed = message.size() + (newline ? 1 : 0);
+    const size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+
+    if (capacity - (head - tail) < needed) {
+        if (overflow_ == Overflow::Drop) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            wakeWriter();
+            return;
+        }
+        auto deadline = std::chrono::steady_clock::now() + BLOCK_LIMIT;
+        do {
+            wakeWriter();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            if (std::chrono::steady_clock::now() > deadline) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            tail = ring->tail.load(std::memory_order_acquire);
+        } while (capacity - (head - tail) < needed);
+    }
+
+    size_t offset = head & ring->mask;
+    size_t first = std::min(message.size(), capacity - offset);
+    memcpy(ring->data.get() + offset, message.data(), first);
+    memcpy(ring->data.get(), message.data() + first, message.size() - first);
+    if (newline) {
+        ring->data[(head + message.size()) & ring->mask] = '\n';
+    }
+    ring->head.store(head + needed, std::memory_order_release);
+
+    // Size trigger: don't let a busy thread wait out the whole interval
+    if (head + needed - tail > capacity / 2) {
+        wakeWriter();
+    }
+}
+
+void Log::wakeWriter() {
+    if (!wake_pending_.exchange(true, std::memory_order_relaxed)) {
+        wake_.notify_one();
+    }
+}
+
+void Log::writeDirect(std::string_view message, bool newline) {
+    std::string line(message);
+    if (newline) {
+        line += '\n';
+    }
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    write_fully(fd_, line.data(), line.size());
+}
+
+Log::Ring* Log::acquireRing() {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    if (!free_rings_.empty()) {
+        Ring* ring = free_rings_.back();
+        free_rings_.pop_back();
+        ring->free = false;
+        return ring;
+    }
+    size_t count = ring_count_.load(std::memory_order_relaxed);
+    if (count == MAX_RINGS) {
+        return nullptr;
+    }
+    Ring* ring = new Ring(ring_bytes_);
+    rings_[count].store(ring, std::memory_order_release);
+    ring_count_.store(count + 1, std::memory_order_release);
+    return ring;
+}
+
+void Log::releaseRing(Ring* ring) {
+    ring->retired.store(true, std::memory_order_release);
+}
+
+void Log::flush() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    // The pass running now may have started before our lines; wait for the next
+    uint64_t target = passes_ + 2;
+    wake_pending_.store(true, std::memory_order_relaxed);
+    wake_.notify_one();
+    drained_.wait(lock, [&] { return passes_ >= target || stopping_; });
+}
+
+void Log::writeBatch(std::vector<char>& batch) {
+    if (!batch.empty()) {
+        write_fully(fd_, batch.data(), batch.size());
+        batch.clear();
+    }
+}
+
+void Log::writerLoop() {
+    std::vector<char> batch;
+    batch.reserve(BATCH_BYTES + ring_bytes_);
+    std::vector<Ring*> recycled;
+    bool stop = false;
+    while (!stop) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait_for(lock, interval_, [&] { return stopping_ || wake_pending_.load(std::memory_order_relaxed); });
+            stop = stopping_;
+        }
+        wake_pending_.store(false, std::memory_order_relaxed);
+
+        while (draining_.exchange(true, std::memory_order_acquire)) {
+            sched_yield();  // Only a signal handler competes for the rings
+        }
+        size_t count = ring_count_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            Ring* ring = rings_[i].load(std::memory_order_acquire);
+            // Read before draining: once retired, nothing more arrives
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            size_t tail = ring->tail.load(std::memory_order_relaxed);
+            size_t head = ring->head.load(std::memory_order_acquire);
+            size_t offset = tail & ring->mask;
+            size_t first = std::min(head - tail, ring->capacity() - offset);
+            batch.insert(batch.end(), ring->data.get() + offset, ring->data.get() + offset + first);
+            batch.insert(batch.end(), ring->data.get(), ring->data.get() + (head - tail - first));
+            ring->tail.store(head, std::memory_order_release);
+            if (retired) {
+                recycled.push_back(ring);
+            }
+            if (batch.size() >= BATCH_BYTES) {
+                writeBatch(batch);
+            }
+        }
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (text_ && dropped != reported_dropped_) {
+            std::string note = "(no-id): WARNING log buffer full, dropped " +
+                               std::to_string(dropped - reported_dropped_) + " line(s)\n";
+            batch.insert(batch.end(), note.begin(), note.end());
+            reported_dropped_ = dropped;
+        }
+        writeBatch(batch);
+        draining_.store(false, std::memory_order_release);
+
+        if (!recycled.empty()) {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            for (Ring* ring : recycled) {
+                if (!ring->free) {
+                    ring->retired.store(false, std::memory_order_relaxed);
+                    ring->free = true;
+                    free_rings_.push_back(ring);
+                }
+            }
+            recycled.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            ++passes_;
+        }
+        drained_.notify_all();
+    }
+}
+
+/**
+ * Empties the rings from inside a signal handler: no locks, no allocation,
+ * only write(). If the writer is mid-pass it gets a moment to finish; if it
+ * never does (the crash is in the writer itself) we drain anyway.
+ */
+void Log::drainForSignal() {
+    for (int spins = 0; draining_.exchange(true, std::memory_order_acquire) && spins < 1000; ++spins) {
+        usleep(100);
+    }
+    char buf[8192];
+    size_t count = ring_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        Ring* ring = rings_[i].load(std::memory_order_acquire);
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            size_t offset = tail & ring->mask;
+            size_t piece = std::min({head - tail, ring->capacity() - offset, sizeof(buf)});
+            memcpy(buf, ring->data.get() + offset, piece);
+            write_fully(fd_, buf, piece);
+            tail += piece;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+void Log::onSignal(int sig) {
+    Log* log = signal_log.load();
+    if (log) {
+        log->drainForSignal();
+    }
+    if (sig == SIGTERM || sig == SIGINT || sig == SIGHUP) {
+        _exit(128 + sig);  // Re-raising would be ignored when running as PID 1 in a container
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void Log::flushOnSignals() {
+    signal_log.store(this);
+    struct sigaction action = {};
+    action.sa_handler = &Log::onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+    for (int sig : {SIGTERM, SIGINT, SIGHUP, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        sigaction(sig, &action, nullptr);
+    }
+}
+
+LogSampler::LogSampler(const char* category) : every_(1) {
+    std::string config = Config::get_string("PROXY_LOG_SAMPLE", "");
+    std::string_view spec = config;
+    std::string_view name(category);
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        size_t eq = item.find('=');
+        if (eq != std::string_view::npos && item.substr(0, eq) == name) {
+            every_ = std::strtoull(std::string(item.substr(eq + 1)).c_str(), nullptr, 10);
+        }
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+    }
+}
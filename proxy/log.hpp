@@ -1,59 +1,189 @@
 #ifndef LOG_HPP
 #define LOG_HPP
 
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
-#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-extern const char* LOG_FILE; 
+extern const char* LOG_FILE;
 
-class FileRAII {
-private:
-    std::ofstream file_;
-    
+/**
+ * Severity of a log line. Info lines carry no tag; the others are written
+ * as "id: TAG message".
+ */
+enum class LogLevel { Trace, Debug, Info, Note, Warning, Error };
+
+// Lines below this level are compiled out: their arguments are never evaluated.
+// Build with "make LOG_LEVEL=Debug" to keep debug tracing.
+#ifndef PROXY_LOG_MIN_LEVEL
+#define PROXY_LOG_MIN_LEVEL LogLevel::Info
+#endif
+
+/**
+ * Asynchronous line logger
+ *
+ * write() copies the line into a ring buffer owned by the calling thread and
+ * returns; no lock is taken and nothing touches the file. A background
+ * writer drains every ring into one batch and appends it with a single
+ * write() call, either every PROXY_LOG_FLUSH_MS or as soon as some ring is
+ * half full. Lines from one thread stay in order; lines from different
+ * threads may interleave by batch rather than strictly by time.
+ *
+ * When a ring is full the PROXY_LOG_OVERFLOW policy applies: "block" waits
+ * for the writer (at most one second, then the line is dropped), "drop"
+ * discards the line at once. Dropped lines are counted and reported in the
+ * log. Rings of exited threads are drained and reused, so the thread per
+ * connection model costs one ring per concurrent connection, not per
+ * connection ever made.
+ *
+ * The logger lives for the whole process: rings are not freed while threads
+ * may still hold them.
+ */
+class Log {
 public:
-    FileRAII(const std::string& path, std::ios_base::openmode mode = std::ios_base::out) {
-        file_.open(path, mode);
-        if (!file_.is_open()) {
-            throw std::runtime_error("Failed to open file: " + path);
-        }
-    }
-    
-    ~FileRAII() {
-        if (file_.is_open()) {
-            file_.close();
-        }
-    }
-    
-    // Prevent copying
-    FileRAII(const FileRAII&) = delete;
-    FileRAII& operator=(const FileRAII&) = delete;
-    
-    // Allow access to the file
-    std::ofstream& get() {
-        return file_;
-    }
-    
-    // Check if file is open
-    bool is_open() const {
-        return file_.is_open();
+    enum class Overflow { Block, Drop };
+
+    /**
+     * @param path File appended to
+     * @param text False for a binary record stream: no notes are written into it
+     */
+    explicit Log(const std::string& path, bool text = true);
+    ~Log();
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    /**
+     * Appends one preformatted line
+     */
+    void write(std::string_view message);
+
+    /**
+     * Appends raw bytes with no line terminator, for binary record streams
+     */
+    void append(const void* data, size_t size);
+
+    /**
+     * Appends "id: TAG message"; use the LOG_* macros so disabled levels cost nothing
+     */
+    void write(LogLevel level, std::string_view id, std::string_view message);
+
+    /**
+     * Runtime filter on top of PROXY_LOG_MIN_LEVEL, from PROXY_LOG_LEVEL
+     */
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
     }
-};
+    void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+    /**
+     * Writes out everything logged so far before returning
+     */
+    void flush();
+
+    /**
+     * Lines discarded because a ring was full
+     */
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * Flushes the log on SIGTERM/SIGINT and on crash signals, then lets the
+     * signal take its default action
+     */
+    void flushOnSignals();
 
-class Log {
 private:
-    std::mutex log_mutex_;
-    FileRAII log_file_;
-    
+    struct Ring;
+    friend struct LogThreadSlot;
+
+    // Concurrent logging threads beyond this write synchronously
+    static const size_t MAX_RINGS = 4096;
+
+    Ring* acquireRing();
+    void releaseRing(Ring* ring);
+    void push(Ring* ring, std::string_view message, bool newline);
+    void wakeWriter();
+    void writeDirect(std::string_view message, bool newline);
+    void writeBatch(std::vector<char>& batch);
+    void writerLoop();
+    void drainForSignal();
+    static void onSignal(int sig);
+
+    int fd_;
+    bool text_;
+    std::atomic<int> level_;
+    size_t ring_bytes_;
+    Overflow overflow_;
+    std::chrono::milliseconds interval_;
+
+    // Fixed slots so a signal handler can walk the rings without locking
+    std::atomic<Ring*> rings_[MAX_RINGS] = {};
+    std::atomic<size_t> ring_count_{0};
+    std::mutex rings_mutex_;                // Guards ring creation and free_rings_
+    std::vector<Ring*> free_rings_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> wake_pending_{false};
+    std::condition_variable drained_;
+    uint64_t passes_ = 0;                   // Writer passes completed, under wake_mutex_
+    bool stopping_ = false;
+
+    std::atomic<bool> draining_{false};     // Held by whoever is emptying the rings
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_dropped_ = 0;
+    std::thread writer_;
+};
+
+/**
+ * Passes one in every N lines of a category, N from PROXY_LOG_SAMPLE
+ * ("category=N,..."; 0 mutes the category). Unlisted categories pass all.
+ */
+class LogSampler {
 public:
-    Log(const std::string& path) : log_file_(path, std::ios_base::app) {}
-    
-    void write(const std::string& message) {
-        std::lock_guard<std::mutex> lock(log_mutex_);
-        log_file_.get() << message << std::endl;
-        log_file_.get().flush();
+    explicit LogSampler(const char* category);
+
+    bool take() {
+        return every_ == 1 || (every_ != 0 && count_.fetch_add(1, std::memory_order_relaxed) % every_ == 0);
     }
+
+private:
+    uint64_t every_;
+    std::atomic<uint64_t> count_{0};
 };
 
-#endif // LOG_HPP
\ No newline at end of file
+extern Log* proxy_logger;
+
+#define LOG_AT(level, id, message)                                                        \
+    do {                                                                                  \
+        if ((level) >= PROXY_LOG_MIN_LEVEL && proxy_logger && proxy_logger->enabled(level)) { \
+            proxy_logger->write((level), (id), (message));                                \
+        }                                                                                 \
+    } while (0)
+
+// High-volume lines: filtered by level first, then sampled per call-site category
+#define LOG_SAMPLED(level, category, id, message)                                         \
+    do {                                                                                  \
+        if ((level) >= PROXY_LOG_MIN_LEVEL && proxy_logger && proxy_logger->enabled(level)) { \
+            static LogSampler log_sampler_(category);                                     \
+            if (log_sampler_.take()) {                                                    \
+                proxy_logger->write((level), (id), (message));                            \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define LOG_TRACE(id, message) LOG_AT(LogLevel::Trace, id, message)
+#define LOG_DEBUG(id, message) LOG_AT(LogLevel::Debug, id, message)
+#define LOG_INFO(id, message) LOG_AT(LogLevel::Info, id, message)
+#define LOG_NOTE(id, message) LOG_AT(LogLevel::Note, id, message)
+#define LOG_WARNING(id, message) LOG_AT(LogLevel::Warning, id, message)
+#define LOG_ERROR(id, message) LOG_AT(LogLevel::Error, id, message)
+
+#endif // LOG_HPP
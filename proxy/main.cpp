@@ -5,6 +5,13 @@
 #include "socket.hpp"
 #include "handler.hpp"
 #include "log.hpp"
+#include "http_date.hpp"
+#include "config.hpp"
+#include "access_log.hpp"
+#include "admin.hpp"
+#include "warmup.hpp"
+#include "timeouts.hpp"
+#include "lingering.hpp"
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 #include <thread>
@@ -17,37 +24,66 @@ int main() {
         system("mkdir -p ./");
         system("chmod 777 ./logs/");
         
+        // Start the shared one-second clock before anything logs
+        CoarseClock::start();
+
         // Initialize logger and cache
         proxy_logger = new Log(LOG_FILE);
-        proxy_cache = new Cache(1000);
+        proxy_logger->flushOnSignals();
+        access_log::open();
+        proxy_cache = new Cache(Config::get_long("PROXY_CACHE_MAX_ENTRIES", 1000),
+                                Config::get_long("PROXY_CACHE_MAX_BYTES", 256L << 20));
+        timeouts::start();
+        lingering::start();
+        proxy_negative_cache = new NegativeCache(Config::get_long("PROXY_NEGATIVE_TTL", 5));
+        proxy_admission = new AdmissionControl(
+            static_cast<size_t>(std::max(0L, Config::get_long("PROXY_MAX_CONCURRENCY", 256))),
+            static_cast<size_t>(std::max(0L, Config::get_long("PROXY_ADMISSION_QUEUE", 1024))),
+            std::chrono::milliseconds(Config::get_long("PROXY_ADMISSION_TARGET_MS", 10)),
+            std::chrono::milliseconds(Config::get_long("PROXY_ADMISSION_INTERVAL_MS", 100)));
+        UpstreamScheduler::Options upstream;
+        upstream.max_total = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_UPSTREAM_MAX", 128)));
+        upstream.max_per_origin = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_UPSTREAM_PER_ORIGIN", 32)));
+        upstream.queue_timeout = std::chrono::milliseconds(Config::get_long("PROXY_UPSTREAM_QUEUE_TIMEOUT_MS", 2000));
+        upstream.min_requests = static_cast<size_t>(std::max(1L, Config::get_long("PROXY_BREAKER_MIN_REQUESTS", 20)));
+        upstream.failure_ratio = Config::get_double("PROXY_BREAKER_FAILURE_RATIO", 0.5);
+        upstream.slow_after = std::chrono::milliseconds(Config::get_long("PROXY_BREAKER_SLOW_MS", 5000));
+        upstream.open_for = std::chrono::seconds(Config::get_long("PROXY_BREAKER_OPEN_SECONDS", 5));
+        proxy_upstream = new UpstreamScheduler(upstream);
+        size_t limiter_keys = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_RATE_LIMIT_KEYS", 4096)));
+        proxy_client_limiter = new RateLimiter("client", limiter_keys, {
+            Config::get_double("PROXY_CLIENT_RPS", 0), Config::get_double("PROXY_CLIENT_BURST", 20),
+            Config::get_long("PROXY_CLIENT_MAX_CONNECTIONS", 0), Config::get_double("PROXY_CLIENT_BYTES_PER_SEC", 0)});
+        proxy_origin_limiter = new RateLimiter("origin", limiter_keys, {
+            Config::get_double("PROXY_ORIGIN_RPS", 0), Config::get_double("PROXY_ORIGIN_BURST", 20),
+            Config::get_long("PROXY_ORIGIN_MAX_CONNECTIONS", 0), Config::get_double("PROXY_ORIGIN_BYTES_PER_SEC", 0)});
         
-        proxy_logger->write("(no-id): NOTE Proxy server started");
+        LOG_NOTE("(no-id)", "Proxy server started");
     } catch (const std::exception& e) {
         std::cerr << "Failed to initialize logger: " << e.what() << std::endl;
         return 1;
     }
     
     auto proxy_server = std::make_shared<TcpSocket>();
-    proxy_server->bind(12345);
+    proxy_server->bind(static_cast<int>(Config::get_long("PROXY_PORT", 12345)));
     proxy_server->listen(10);  // Allow up to 10 pending connections
     
 
-
-    std::shared_ptr<ISocket> client_socket = nullptr;
-    
-
     unsigned int thread_count = std::max(8u, 2u * std::thread::hardware_concurrency());
     global_thread_pool = new boost::asio::thread_pool(thread_count);    
     // global_thread_pool = new boost::asio::thread_pool(std::thread::hardware_concurrency());
-    proxy_logger->write("(no-id): NOTE Thread pool created with " + 
-                       std::to_string(std::thread::hardware_concurrency()) + " threads");
+    LOG_NOTE("(no-id)", "Thread pool created with " +
+             std::to_string(std::thread::hardware_concurrency()) + " threads");
+
+    admin::start();
+    warmup::start();
 
     while(true) {
-        cout << "[Note] waiting for connection..." << endl;
-        client_socket = proxy_server->accept();
+        LOG_TRACE("(no-id)", "waiting for connection");
+        // Scoped to the loop, so the handler and the lingering close own the socket
+        std::shared_ptr<ISocket> client_socket = proxy_server->accept();
         if (client_socket == nullptr) {
-            std::cerr << "Failed to accept connection" << std::endl;
-            proxy_logger->write("(no-id): ERROR Failed to accept connection");
+            LOG_ERROR("(no-id)", "Failed to accept connection");
             continue;
         }
         // generate unique id for each client
@@ -61,6 +97,7 @@ int main() {
 
     global_thread_pool->join();
     delete global_thread_pool;
+    CoarseClock::stop();
 
     return 0;
 }
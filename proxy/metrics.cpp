@@ -0,0 +1,231 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+std::string format_double(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.10g", value);
+    return buf;
+}
+
+} // namespace
+
+namespace metrics {
+
+size_t shard_index() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return index;
+}
+
+Metric::Metric(const char* name, const char* help, const char* type, std::string labels)
+    : name_(name), help_(help), type_(type), labels_(std::move(labels)) {
+    Registry::global().add(this);
+}
+
+Metric::~Metric() {
+    Registry::global().remove(this);
+}
+
+std::string Metric::sample_name(const char* suffix, const std::string& extra_label) const {
+    std::string out = std::string(name_) + suffix;
+    if (!labels_.empty() || !extra_label.empty()) {
+        out += '{';
+        out += labels_;
+        if (!labels_.empty() && !extra_label.empty()) out += ',';
+        out += extra_label;
+        out += '}';
+    }
+    return out;
+}
+
+int64_t Counter::value() const {
+    int64_t total = 0;
+    for (const Slot& slot : slots_) total += slot.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Counter::render(std::string& out) const {
+    out += sample_name() + " " + std::to_string(value()) + "\n";
+}
+
+int64_t Gauge::value() const {
+    int64_t total = 0;
+    for (const Slot& slot : slots_) total += slot.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Gauge::render(std::string& out) const {
+    out += sample_name() + " " + std::to_string(value()) + "\n";
+}
+
+void Callback::render(std::string& out) const {
+    out += sample_name() + " " + format_double(read_()) + "\n";
+}
+
+Histogram::Histogram(const char* name, const char* help, std::string labels)
+    : Metric(name, help, "histogram", std::move(labels)), shards_(new Shard[SHARDS]) {
+    for (size_t s = 0; s < SHARDS; ++s) {
+        for (auto& bucket : shards_[s].buckets) bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t Histogram::bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return static_cast<size_t>(ns);
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    if (msb > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    size_t group = static_cast<size_t>(msb - SUB_BITS + 1);
+    size_t sub = static_cast<size_t>(ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return group * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucket_upper(size_t bucket) {
+    size_t group = bucket / SUB_BUCKETS;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    if (group == 0) {
+        return sub + 1;
+    }
+    int msb = static_cast<int>(group) + SUB_BITS - 1;
+    uint64_t width = uint64_t(1) << (msb - SUB_BITS);
+    return (uint64_t(1) << msb) + (sub + 1) * width;
+}
+
+void Histogram::record(uint64_t ns) {
+    Shard& shard = shards_[shard_index()];
+    shard.buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void Histogram::totals(std::vector<uint64_t>& buckets, uint64_t& sum) const {
+    buckets.assign(BUCKETS, 0);
+    sum = 0;
+    for (size_t s = 0; s < SHARDS; ++s) {
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            buckets[b] += shards_[s].buckets[b].load(std::memory_order_relaxed);
+        }
+        sum += shards_[s].sum_ns.load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::count() const {
+    std::vector<uint64_t> buckets;
+    uint64_t sum;
+    totals(buckets, sum);
+    uint64_t total = 0;
+    for (uint64_t n : buckets) total += n;
+    return total;
+}
+
+uint64_t Histogram::quantile(double q) const {
+    std::vector<uint64_t> buckets;
+    uint64_t sum;
+    totals(buckets, sum);
+    uint64_t total = 0;
+    for (uint64_t n : buckets) total += n;
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen >= target) {
+            return bucket_upper(b);
+        }
+    }
+    return bucket_upper(BUCKETS - 1);
+}
+
+void Histogram::render(std::string& out) const {
+    std::vector<uint64_t> buckets;
+    uint64_t sum;
+    totals(buckets, sum);
+
+    // Every bucket of a lower power of two lies below 2^exponent, so the
+    // running total at each group boundary is an exact cumulative count
+    uint64_t cumulative = 0;
+    size_t b = 0;
+    for (int exponent = 10; exponent <= MAX_EXPONENT; ++exponent) {
+        size_t end = static_cast<size_t>(exponent - SUB_BITS + 1) * SUB_BUCKETS;
+        for (; b < end; ++b) cumulative += buckets[b];
+        std::string le = "le=\"" + format_double(std::ldexp(1.0, exponent) / 1e9) + "\"";
+        out += sample_name("_bucket", le) + " " + std::to_string(cumulative) + "\n";
+    }
+    for (; b < BUCKETS; ++b) cumulative += buckets[b];
+    out += sample_name("_bucket", "le=\"+Inf\"") + " " + std::to_string(cumulative) + "\n";
+    out += sample_name("_sum") + " " + format_double(sum / 1e9) + "\n";
+    out += sample_name("_count") + " " + std::to_string(cumulative) + "\n";
+}
+
+Registry& Registry::global() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+void Registry::add(Metric* metric) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_.push_back(metric);
+}
+
+void Registry::remove(Metric* metric) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_.erase(std::remove(metrics_.begin(), metrics_.end(), metric), metrics_.end());
+}
+
+std::string Registry::render() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+    std::vector<bool> done(metrics_.size(), false);
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+        if (done[i]) {
+            continue;
+        }
+        const Metric* first = metrics_[i];
+        out += std::string("# HELP ") + first->name_ + " " + first->help_ + "\n";
+        out += std::string("# TYPE ") + first->name_ + " " + first->type_ + "\n";
+        for (size_t j = i; j < metrics_.size(); ++j) {
+            if (!done[j] && std::string_view(metrics_[j]->name_) == first->name_) {
+                metrics_[j]->render(out);
+                done[j] = true;
+            }
+        }
+    }
+    return out;
+}
+
+Counter requests_get("proxy_requests_total", "Client requests by method", "method=\"GET\"");
+Counter requests_post("proxy_requests_total", "Client requests by method", "method=\"POST\"");
+Counter requests_connect("proxy_requests_total", "Client requests by method", "method=\"CONNECT\"");
+Counter requests_other("proxy_requests_total", "Client requests by method", "method=\"other\"");
+Counter cache_hits("proxy_cache_lookups_total", "GET lookups by result", "result=\"hit\"");
+Counter cache_misses("proxy_cache_lookups_total", "GET lookups by result", "result=\"miss\"");
+Counter cache_stale("proxy_cache_lookups_total", "GET lookups by result", "result=\"stale\"");
+Counter cache_evictions("proxy_cache_evictions_total", "Entries evicted to stay within the entry or byte budget");
+Counter cache_stored_bytes("proxy_cache_stored_bytes_total", "Body bytes written into the cache, after compression");
+Counter compression_hits_compressed("proxy_compression_hits_total", "Hits on compressed entries", "sent=\"compressed\"");
+Counter compression_hits_inflated("proxy_compression_hits_total", "Hits on compressed entries", "sent=\"inflated\"");
+Counter compression_sent_bytes("proxy_compression_hit_bytes_total", "Body bytes of hits on compressed entries", "as=\"sent\"");
+Counter compression_identity_bytes("proxy_compression_hit_bytes_total", "Body bytes of hits on compressed entries", "as=\"identity\"");
+Gauge active_connections("proxy_active_connections", "Client connections being handled");
+Gauge active_tunnels("proxy_active_tunnels", "CONNECT tunnels open");
+Histogram upstream_connect("proxy_upstream_connect_seconds", "Origin DNS lookup and TCP connect");
+Histogram upstream_ttfb("proxy_upstream_ttfb_seconds", "From sending a request to the origin until its first response byte");
+Histogram request_duration("proxy_request_duration_seconds", "From accept until the handler is done with the request");
+Counter admission_shed_queue_full("proxy_admission_shed_total", "Requests answered 503 under overload, by reason", "reason=\"queue_full\"");
+Counter admission_shed_timeout("proxy_admission_shed_total", "Requests answered 503 under overload, by reason", "reason=\"timeout\"");
+Counter admission_shed_no_thread("proxy_admission_shed_total", "Requests answered 503 under overload, by reason", "reason=\"no_thread\"");
+Counter admission_shed_connections("proxy_admission_shed_total", "Requests answered 503 under overload, by reason", "reason=\"connections\"");
+Counter upstream_queue_timeouts("proxy_upstream_rejected_total", "Origin requests not sent, by reason", "reason=\"queue_timeout\"");
+Counter upstream_circuit_rejected("proxy_upstream_rejected_total", "Origin requests not sent, by reason", "reason=\"circuit_open\"");
+Counter upstream_circuit_opens("proxy_upstream_circuit_opens_total", "Times an origin's circuit breaker opened");
+Histogram upstream_queue_wait("proxy_upstream_queue_wait_seconds", "Time origin requests waited for an upstream slot");
+Histogram admission_wait("proxy_admission_wait_seconds", "Time requests waited for a processing slot");
+
+} // namespace metrics
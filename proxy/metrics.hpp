@@ -0,0 +1,243 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * In-process metrics, exposed in Prometheus text format
+ *
+ * Instruments are updated on the request path with relaxed atomic adds on
+ * one of SHARDS cache-line-sized slots, picked per thread, so threads
+ * neither lock nor fight over a cache line. A scrape sums the shards; it
+ * may see an update on one shard and not yet another, which Prometheus
+ * tolerates. Instruments register themselves with the registry when
+ * constructed, which is the only place a lock is taken.
+ */
+namespace metrics {
+
+const size_t SHARDS = 16;
+
+/**
+ * This thread's shard, assigned round-robin on first use
+ */
+size_t shard_index();
+
+struct alignas(64) Slot {
+    std::atomic<int64_t> value{0};
+};
+
+class Metric {
+public:
+    Metric(const char* name, const char* help, const char* type, std::string labels = "");
+    virtual ~Metric();
+
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    const char* name() const { return name_; }
+
+    /**
+     * Appends this metric's samples in exposition format
+     */
+    virtual void render(std::string& out) const = 0;
+
+protected:
+    std::string sample_name(const char* suffix = "", const std::string& extra_label = "") const;
+
+    const char* name_;
+    const char* help_;
+    const char* type_;
+    std::string labels_;  // 'key="value"' pairs without braces, may be empty
+
+    friend class Registry;
+};
+
+/**
+ * Monotonic count
+ */
+class Counter : public Metric {
+public:
+    Counter(const char* name, const char* help, std::string labels = "")
+        : Metric(name, help, "counter", std::move(labels)) {}
+
+    void inc(int64_t n = 1) { slots_[shard_index()].value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const;
+    void render(std::string& out) const override;
+
+private:
+    std::array<Slot, SHARDS> slots_;
+};
+
+/**
+ * Level that goes up and down, e.g. open connections
+ */
+class Gauge : public Metric {
+public:
+    Gauge(const char* name, const char* help, std::string labels = "")
+        : Metric(name, help, "gauge", std::move(labels)) {}
+
+    void add(int64_t n) { slots_[shard_index()].value.fetch_add(n, std::memory_order_relaxed); }
+    void inc() { add(1); }
+    void dec() { add(-1); }
+    int64_t value() const;
+    void render(std::string& out) const override;
+
+private:
+    std::array<Slot, SHARDS> slots_;
+};
+
+/**
+ * Holds a gauge up for the lifetime of a scope
+ */
+class ScopedGauge {
+public:
+    explicit ScopedGauge(Gauge& gauge) : gauge_(gauge) { gauge_.inc(); }
+    ~ScopedGauge() { gauge_.dec(); }
+
+    ScopedGauge(const ScopedGauge&) = delete;
+    ScopedGauge& operator=(const ScopedGauge&) = delete;
+
+private:
+    Gauge& gauge_;
+};
+
+/**
+ * Value read from elsewhere at scrape time, for figures other modules
+ * already keep (cache bytes, slab and blob statistics)
+ *
+ * @param type "gauge" or "counter"
+ */
+class Callback : public Metric {
+public:
+    Callback(const char* name, const char* help, const char* type, std::function<double()> read,
+             std::string labels = "")
+        : Metric(name, help, type, std::move(labels)), read_(std::move(read)) {}
+
+    void render(std::string& out) const override;
+
+private:
+    std::function<double()> read_;
+};
+
+/**
+ * Latency histogram with HDR-style log-linear buckets
+ *
+ * Values are nanoseconds. Each power of two is split into SUB_BUCKETS
+ * linear buckets, so any recorded value is known to within 1/SUB_BUCKETS
+ * (12.5%) over the whole range, for a few KB per shard. The exposition
+ * uses the power-of-two boundaries, 1 us to about 69 s, as Prometheus
+ * "le" buckets, where the cumulative counts are exact.
+ */
+class Histogram : public Metric {
+public:
+    static const int SUB_BITS = 3;
+    static const size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static const int MAX_EXPONENT = 36;  // 2^36 ns, about 69 s; larger values land in the last bucket
+    static const size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+
+    Histogram(const char* name, const char* help, std::string labels = "");
+
+    void record(uint64_t ns);
+    void record(std::chrono::steady_clock::duration elapsed) {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    /**
+     * Upper bound of the bucket holding the q-quantile, in nanoseconds
+     */
+    uint64_t quantile(double q) const;
+    uint64_t count() const;
+
+    void render(std::string& out) const override;
+
+    static size_t bucket_of(uint64_t ns);
+    static uint64_t bucket_upper(size_t bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[BUCKETS];
+        std::atomic<uint64_t> sum_ns{0};
+    };
+
+    void totals(std::vector<uint64_t>& buckets, uint64_t& sum) const;
+
+    std::unique_ptr<Shard[]> shards_;
+};
+
+/**
+ * Times a scope into a histogram
+ */
+class Timer {
+public:
+    explicit Timer(Histogram& histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~Timer() { histogram_.record(std::chrono::steady_clock::now() - start_); }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * All registered metrics
+ */
+class Registry {
+public:
+    static Registry& global();
+
+    void add(Metric* metric);
+    void remove(Metric* metric);
+
+    /**
+     * Renders every metric; samples of one name are grouped under one HELP/TYPE
+     */
+    std::string render() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<Metric*> metrics_;
+};
+
+// Instruments updated on the request path
+extern Counter requests_get;
+extern Counter requests_post;
+extern Counter requests_connect;
+extern Counter requests_other;
+extern Counter cache_hits;
+extern Counter cache_misses;
+extern Counter cache_stale;
+extern Counter cache_evictions;
+extern Counter cache_stored_bytes;
+extern Counter compression_hits_compressed;
+extern Counter compression_hits_inflated;
+extern Counter compression_sent_bytes;
+extern Counter compression_identity_bytes;
+extern Gauge active_connections;
+extern Gauge active_tunnels;
+extern Histogram upstream_connect;
+extern Histogram upstream_ttfb;
+extern Histogram request_duration;
+extern Counter admission_shed_queue_full;
+extern Counter admission_shed_timeout;
+extern Counter admission_shed_no_thread;
+extern Counter admission_shed_connections;
+extern Histogram admission_wait;
+extern Counter upstream_queue_timeouts;
+extern Counter upstream_circuit_rejected;
+extern Counter upstream_circuit_opens;
+extern Histogram upstream_queue_wait;
+
+} // namespace metrics
+
+#endif // METRICS_HPP
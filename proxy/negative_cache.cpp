@@ -0,0 +1,50 @@
+#include "negative_cache.hpp"
+#include "http_date.hpp"
+
+namespace {
+
+// Lock sites; see utils::LockSite
+utils::LockSite read_site("negative_cache.read");
+utils::LockSite write_site("negative_cache.write");
+
+} // namespace
+
+// Constructor
+NegativeCache::NegativeCache(time_t ttl, size_t max_entries) : ttl_(ttl), max_entries_(max_entries) {}
+
+// Remove entries whose failure window has passed
+void NegativeCache::purgeExpired(time_t now) {
+    for (auto it = failed_until_.begin(); it != failed_until_.end();) {
+        if (it->second <= now) {
+            it = failed_until_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Thread-safe failure record
+void NegativeCache::markFailed(const std::string& host, const std::string& port) {
+    if (ttl_ <= 0) {
+        return;
+    }
+    time_t now = CoarseClock::now();
+    utils::WriterLock lock(mutex_, write_site);
+    if (failed_until_.size() >= max_entries_) {
+        purgeExpired(now);
+        if (failed_until_.size() >= max_entries_) {
+            return;  // Still full of live failures; don't grow without bound
+        }
+    }
+    failed_until_[host + ":" + port] = now + ttl_;
+}
+
+// Thread-safe failure lookup
+bool NegativeCache::isFailed(const std::string& host, const std::string& port) const {
+    if (ttl_ <= 0) {
+        return false;
+    }
+    utils::ReaderLock lock(mutex_, read_site);
+    auto it = failed_until_.find(host + ":" + port);
+    return it != failed_until_.end() && it->second > CoarseClock::now();
+}
@@ -0,0 +1,51 @@
+#ifndef NEGATIVE_CACHE_HPP
+#define NEGATIVE_CACHE_HPP
+
+#include <ctime>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "utils/locks.hpp"
+
+/**
+ * Short-lived memory of origins that could not be reached
+ *
+ * After a DNS or connect failure the origin is remembered for a few seconds,
+ * and requests for it fail fast with 502 instead of each paying for (and
+ * adding to) another failing connection attempt.
+ */
+class NegativeCache {
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, time_t> failed_until_;  // "host:port" -> expiry
+    time_t ttl_;
+    size_t max_entries_;
+
+    /**
+     * Drops expired entries; caller holds the writer lock
+     */
+    void purgeExpired(time_t now);
+
+public:
+    /**
+     * @param ttl Seconds an origin stays marked after a failure (0 disables)
+     * @param max_entries Bound on remembered origins
+     */
+    explicit NegativeCache(time_t ttl = 5, size_t max_entries = 10000);
+
+    /**
+     * Records a failed attempt to reach host:port
+     */
+    void markFailed(const std::string& host, const std::string& port);
+
+    /**
+     * Checks whether host:port failed recently
+     *
+     * @return True while the failure is still remembered
+     */
+    bool isFailed(const std::string& host, const std::string& port) const;
+
+    time_t ttl() const { return ttl_; }
+};
+
+#endif // NEGATIVE_CACHE_HPP
@@ -0,0 +1,131 @@
+#include "range.hpp"
+#include "http_date.hpp"
+#include <algorithm>
+#include <strings.h>
+
+namespace {
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Non-empty run of digits; false on anything else or overflow
+bool parse_offset(std::string_view s, size_t& out) {
+    if (s.empty() || s.size() > 19) {
+        return false;
+    }
+    out = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        out = out * 10 + static_cast<size_t>(c - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+namespace http_range {
+
+Result parse(std::string_view value, size_t length, std::vector<Slice>& slices) {
+    slices.clear();
+    value = trim(value);
+    size_t eq = value.find('=');
+    if (eq == std::string_view::npos || eq != 5 || strncasecmp(value.data(), "bytes", 5) != 0) {
+        return Result::Ignore;
+    }
+    value.remove_prefix(eq + 1);
+
+    size_t specs = 0;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view spec = trim(value.substr(0, comma));
+        value = (comma == std::string_view::npos) ? std::string_view() : value.substr(comma + 1);
+        if (spec.empty()) {
+            continue;  // Empty list elements are allowed
+        }
+        if (++specs > MAX_RANGES) {
+            slices.clear();
+            return Result::Ignore;
+        }
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) {
+            slices.clear();
+            return Result::Ignore;
+        }
+        std::string_view first_str = trim(spec.substr(0, dash));
+        std::string_view last_str = trim(spec.substr(dash + 1));
+        size_t first, last;
+        if (first_str.empty()) {
+            // Suffix range: the final N bytes
+            size_t suffix;
+            if (!parse_offset(last_str, suffix)) {
+                slices.clear();
+                return Result::Ignore;
+            }
+            if (suffix == 0 || length == 0) {
+                continue;
+            }
+            first = suffix >= length ? 0 : length - suffix;
+            last = length - 1;
+        } else {
+            if (!parse_offset(first_str, first)) {
+                slices.clear();
+                return Result::Ignore;
+            }
+            if (last_str.empty()) {
+                last = length > 0 ? length - 1 : 0;
+            } else if (!parse_offset(last_str, last) || last < first) {
+                slices.clear();
+                return Result::Ignore;
+            }
+            if (first >= length) {
+                continue;  // Unsatisfiable on its own; others may still apply
+            }
+            last = std::min(last, length - 1);
+        }
+        slices.push_back(Slice{first, last});
+    }
+    if (specs == 0) {
+        return Result::Ignore;
+    }
+    if (slices.empty()) {
+        return Result::Unsatisfiable;
+    }
+
+    std::sort(slices.begin(), slices.end(), [](const Slice& a, const Slice& b) { return a.first < b.first; });
+    size_t merged = 0;
+    for (size_t i = 1; i < slices.size(); ++i) {
+        if (slices[i].first <= slices[merged].last + 1) {
+            slices[merged].last = std::max(slices[merged].last, slices[i].last);
+        } else {
+            slices[++merged] = slices[i];
+        }
+    }
+    slices.resize(merged + 1);
+    return Result::Satisfiable;
+}
+
+bool if_range_matches(std::string_view if_range, std::string_view etag, std::string_view last_modified) {
+    if_range = trim(if_range);
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range.front() == '"' || if_range.substr(0, 2) == "W/") {
+        // Strong comparison: weak tags never match
+        return if_range.front() == '"' && !etag.empty() && etag.front() == '"' && if_range == etag;
+    }
+    time_t requested, modified;
+    return !last_modified.empty() && http_date::parse(if_range, requested) &&
+           http_date::parse(last_modified, modified) && requested == modified;
+}
+
+std::string content_range(const Slice& slice, size_t length) {
+    return "bytes " + std::to_string(slice.first) + "-" + std::to_string(slice.last) + "/" + std::to_string(length);
+}
+
+} // namespace http_range
@@ -0,0 +1,58 @@
+#ifndef RANGE_HPP
+#define RANGE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Byte range requests (RFC 9110 section 14)
+ */
+namespace http_range {
+
+/**
+ * Inclusive byte offsets of one resolved range
+ */
+struct Slice {
+    size_t first;
+    size_t last;
+
+    size_t length() const { return last - first + 1; }
+};
+
+enum class Result {
+    Ignore,         // No usable Range: send the whole representation (200)
+    Satisfiable,    // Send the slices (206)
+    Unsatisfiable,  // No slice overlaps the representation (416)
+};
+
+// More ranges than this are treated as abuse and answered with the whole body
+const size_t MAX_RANGES = 16;
+
+/**
+ * Resolves a Range field value against a representation length
+ *
+ * Handles "first-last", "first-" and "-suffix" specs. Overlapping or
+ * adjacent slices are merged and returned in ascending order. Syntax errors
+ * and units other than bytes give Ignore, as the RFC requires.
+ */
+Result parse(std::string_view value, size_t length, std::vector<Slice>& slices);
+
+/**
+ * Evaluates If-Range against the stored validators
+ *
+ * An entity tag must match strongly; a date must equal Last-Modified.
+ *
+ * @return True if the Range may be honoured
+ */
+bool if_range_matches(std::string_view if_range, std::string_view etag, std::string_view last_modified);
+
+/**
+ * Content-Range value for a slice: "bytes first-last/length"
+ */
+std::string content_range(const Slice& slice, size_t length);
+
+} // namespace http_range
+
+#endif // RANGE_HPP
@@ -0,0 +1,170 @@
+#include "rate_limit.hpp"
+#include "utils/hash.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+std::string limit_labels(const char* kind, const char* limit) {
+    return std::string("key=\"") + kind + "\",limit=\"" + limit + "\"";
+}
+
+const char* LIMITED_HELP = "Requests answered 429, by key and by the limit they hit";
+
+} // namespace
+
+RateLimiter::RateLimiter(const char* kind, size_t capacity, const Limits& limits)
+    : kind_(kind),
+      limited_requests_("proxy_rate_limited_total", LIMITED_HELP, limit_labels(kind, "requests")),
+      limited_connections_("proxy_rate_limited_total", LIMITED_HELP, limit_labels(kind, "connections")),
+      limited_bytes_("proxy_rate_limited_total", LIMITED_HELP, limit_labels(kind, "bytes")) {
+    size_t size = MAX_PROBE;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mask_ = size - 1;
+    buckets_.reset(new Bucket[size]);
+    setLimits(limits);
+}
+
+void RateLimiter::setLimits(const Limits& limits) {
+    requests_per_sec_.store(std::max(0.0, limits.requests_per_sec), std::memory_order_relaxed);
+    burst_.store(std::max(1.0, limits.burst), std::memory_order_relaxed);
+    max_connections_.store(std::max(0L, limits.max_connections), std::memory_order_relaxed);
+    bytes_per_sec_.store(std::max(0.0, limits.bytes_per_sec), std::memory_order_relaxed);
+}
+
+RateLimiter::Limits RateLimiter::limits() const {
+    Limits limits;
+    limits.requests_per_sec = requests_per_sec_.load(std::memory_order_relaxed);
+    limits.burst = burst_.load(std::memory_order_relaxed);
+    limits.max_connections = max_connections_.load(std::memory_order_relaxed);
+    limits.bytes_per_sec = bytes_per_sec_.load(std::memory_order_relaxed);
+    return limits;
+}
+
+int64_t RateLimiter::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * The key's bucket, claiming a free or idle one on its probe path if the key
+ * has none; nullptr when all of them are in use
+ */
+RateLimiter::Bucket* RateLimiter::find(uint64_t key, int64_t now) {
+    size_t home = key & mask_;
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+        Bucket& bucket = buckets_[(home + probe) & mask_];
+        if (bucket.key.load(std::memory_order_acquire) == key) {
+            return &bucket;
+        }
+    }
+    const int64_t idle_ns = IDLE_SECONDS * 1000000000LL;
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+        Bucket& bucket = buckets_[(home + probe) & mask_];
+        uint64_t current = bucket.key.load(std::memory_order_acquire);
+        bool reusable = current == 0 || (bucket.connections.load(std::memory_order_relaxed) <= 0 &&
+                                         now - bucket.last_used.load(std::memory_order_relaxed) > idle_ns);
+        if (!reusable) {
+            continue;
+        }
+        if (bucket.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+            bucket.last_used.store(now, std::memory_order_relaxed);
+            bucket.request_tat.store(0, std::memory_order_relaxed);
+            bucket.byte_tat.store(0, std::memory_order_relaxed);
+            bucket.connections.store(0, std::memory_order_relaxed);
+            return &bucket;
+        }
+        if (current == key) {
+            return &bucket;  // Another thread claimed it for the same key
+        }
+    }
+    return nullptr;
+}
+
+RateLimiter::Verdict RateLimiter::acquire(std::string_view key, Permit& permit, double& retry_after) {
+    double rate = requests_per_sec_.load(std::memory_order_relaxed);
+    long max_connections = max_connections_.load(std::memory_order_relaxed);
+    double bytes_per_sec = bytes_per_sec_.load(std::memory_order_relaxed);
+    if (rate == 0 && max_connections == 0 && bytes_per_sec == 0) {
+        return Verdict::Allowed;
+    }
+
+    uint64_t hashed = utils::hash128(key.data(), key.size()).lo;
+    hashed += hashed == 0;  // 0 marks a free bucket
+    int64_t now = now_ns();
+    Bucket* bucket = find(hashed, now);
+    if (bucket == nullptr) {
+        return Verdict::Allowed;
+    }
+    bucket->last_used.store(now, std::memory_order_relaxed);
+
+    // Bytes already sent count against the key until the rate has paid them off
+    if (bytes_per_sec > 0) {
+        int64_t ahead = bucket->byte_tat.load(std::memory_order_relaxed) - now;
+        if (ahead > 1000000000LL) {
+            retry_after = (ahead - 1000000000LL) / 1e9;
+            limited_bytes_.inc();
+            return Verdict::Bytes;
+        }
+    }
+
+    if (max_connections > 0 && bucket->connections.fetch_add(1, std::memory_order_relaxed) >= max_connections) {
+        bucket->connections.fetch_sub(1, std::memory_order_relaxed);
+        retry_after = 1;
+        limited_connections_.inc();
+        return Verdict::Connections;
+    }
+
+    if (rate > 0) {
+        const int64_t interval = static_cast<int64_t>(1e9 / rate);
+        const int64_t tolerance = static_cast<int64_t>(burst_.load(std::memory_order_relaxed) * interval);
+        int64_t tat = bucket->request_tat.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t next = std::max(tat, now) + interval;
+            if (next - now > tolerance) {
+                if (max_connections > 0) {
+                    bucket->connections.fetch_sub(1, std::memory_order_relaxed);
+                }
+                retry_after = (next - now - tolerance) / 1e9;
+                limited_requests_.inc();
+                return Verdict::Requests;
+            }
+            if (bucket->request_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+    }
+
+    permit.release();
+    permit.limiter_ = this;
+    permit.bucket_ = bucket;
+    permit.key_ = max_connections > 0 ? hashed : 0;
+    return Verdict::Allowed;
+}
+
+void RateLimiter::Permit::charge(uint64_t bytes) {
+    if (bucket_ == nullptr || bytes == 0) {
+        return;
+    }
+    double bytes_per_sec = limiter_->bytes_per_sec_.load(std::memory_order_relaxed);
+    if (bytes_per_sec == 0) {
+        return;
+    }
+    int64_t cost = static_cast<int64_t>(bytes * 1e9 / bytes_per_sec);
+    int64_t now = now_ns();
+    int64_t tat = bucket_->byte_tat.load(std::memory_order_relaxed);
+    while (!bucket_->byte_tat.compare_exchange_weak(tat, std::max(tat, now) + cost, std::memory_order_relaxed)) {
+    }
+}
+
+void RateLimiter::Permit::release() {
+    // Skip the decrement if the bucket went to another key meanwhile
+    if (key_ != 0 && bucket_->key.load(std::memory_order_relaxed) == key_) {
+        bucket_->connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+    limiter_ = nullptr;
+    bucket_ = nullptr;
+    key_ = 0;
+}
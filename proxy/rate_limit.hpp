@@ -0,0 +1,110 @@
+#ifndef RATE_LIMIT_HPP
+#define RATE_LIMIT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "metrics.hpp"
+
+/**
+ * Rate limits for one kind of key, e.g. client address or origin host
+ *
+ * Each key gets a bucket in a fixed open-addressing table. A bucket limits
+ * requests per second (with a burst), connections at once and bytes per
+ * second. Rates use GCRA, the token bucket kept as a single "theoretical
+ * arrival time" that a CAS moves forward, so checks take no lock. A bucket
+ * idle for IDLE_SECONDS, or never used, is taken over by the next new key
+ * that probes it; when every probed bucket is busy the request is let
+ * through rather than limited.
+ *
+ * Races between a key taking over a bucket and a late update for the old
+ * key can blur one request's accounting; the limits are approximate by
+ * design. All limits may be changed while requests are being checked.
+ */
+class RateLimiter {
+public:
+    struct Limits {
+        double requests_per_sec = 0;  // 0 is unlimited
+        double burst = 1;             // Requests allowed at once, before the rate applies
+        long max_connections = 0;     // 0 is unlimited
+        double bytes_per_sec = 0;     // 0 is unlimited; a second's worth may be sent at once
+    };
+
+    enum class Verdict { Allowed, Requests, Connections, Bytes };
+
+    static const int64_t IDLE_SECONDS = 60;
+    static const size_t MAX_PROBE = 8;
+
+    struct alignas(64) Bucket {
+        std::atomic<uint64_t> key{0};  // 0 is free
+        std::atomic<int64_t> last_used{0};
+        std::atomic<int64_t> request_tat{0};
+        std::atomic<int64_t> byte_tat{0};
+        std::atomic<int32_t> connections{0};
+    };
+
+    /**
+     * Holds one of a key's connections and charges its bytes
+     */
+    class Permit {
+    public:
+        Permit() = default;
+        ~Permit() { release(); }
+
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+
+        /**
+         * Charges bytes sent on behalf of the key; later requests wait for them
+         */
+        void charge(uint64_t bytes);
+        void release();
+
+    private:
+        friend class RateLimiter;
+
+        RateLimiter* limiter_ = nullptr;
+        Bucket* bucket_ = nullptr;
+        uint64_t key_ = 0;
+    };
+
+    /**
+     * @param kind Label for metrics and logs, e.g. "client"
+     * @param capacity Buckets in the table, rounded up to a power of two
+     */
+    RateLimiter(const char* kind, size_t capacity, const Limits& limits);
+
+    /**
+     * Checks a request for key against every limit
+     *
+     * @param permit Holds the connection on success
+     * @param retry_after Seconds until the key would be allowed, when limited
+     */
+    Verdict acquire(std::string_view key, Permit& permit, double& retry_after);
+
+    void setLimits(const Limits& limits);
+    Limits limits() const;
+    const char* kind() const { return kind_; }
+
+private:
+    Bucket* find(uint64_t key, int64_t now);
+    static int64_t now_ns();
+
+    const char* kind_;
+    size_t mask_;
+    std::unique_ptr<Bucket[]> buckets_;
+
+    std::atomic<double> requests_per_sec_;
+    std::atomic<double> burst_;
+    std::atomic<long> max_connections_;
+    std::atomic<double> bytes_per_sec_;
+
+    metrics::Counter limited_requests_;
+    metrics::Counter limited_connections_;
+    metrics::Counter limited_bytes_;
+};
+
+#endif // RATE_LIMIT_HPP
@@ -1,10 +1,11 @@
 #include "request.hpp"
+#include "log.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
 
 // Default constructor implementation
-Request::Request() : request(""), line(""), body(""), method(""), uri(""), port(""), hostname("") {}
+Request::Request() : request(""), line(""), body(""), method(""), uri(""), scheme(""), port(""), hostname("") {}
 
 // Destructor implementation 
 Request::~Request() {}
@@ -26,7 +27,7 @@ void Request::parse() {
         parser.put(boost::asio::buffer(request), ec);
         
         if (ec) {
-            std::cerr << "[ERROR] Failed to parse HTTP request: " << ec.message() << std::endl;
+            LOG_DEBUG("(no-id)", "Failed to parse HTTP request: " + ec.message());
             throw InvalidRequest(); // Throw custom exception on error
         }
 
@@ -39,6 +40,13 @@ void Request::parse() {
         // Extract the requested URI (e.g., /index.html)
         uri = req.target().to_string();           
 
+        // An absolute-form URI (e.g., http://host/path) names its scheme
+        std::size_t scheme_end = uri.find("://");
+        if (scheme_end != std::string::npos && uri.find('/') > scheme_end) {
+            scheme = uri.substr(0, scheme_end);
+            for (char& c : scheme) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+
         // Construct the full request line (e.g., GET /index.html HTTP/1.1)
         line = method + " " + uri + " HTTP/" + 
                std::to_string(req.version() / 10) + "." + 
@@ -50,21 +58,42 @@ void Request::parse() {
         }
 
         // Default to port 80 if none is specified in the Host header
-        port = "80"; 
+        port = "80";
+        // An IPv6 literal is bracketed, "[2001:db8::1]:8080"; keep the address alone
         std::size_t colon_pos = hostname.find(':');
-        
+        if (!hostname.empty() && hostname[0] == '[' && hostname.find(']') != std::string::npos) {
+            std::size_t close_pos = hostname.find(']');
+            colon_pos = hostname.find(':', close_pos);
+            port = colon_pos != std::string::npos ? hostname.substr(colon_pos + 1) : port;
+            hostname = hostname.substr(1, close_pos - 1);
+            colon_pos = std::string::npos;
+        }
+
         // If a port is specified in the Host header, extract it
         if (colon_pos != std::string::npos) {
             port = hostname.substr(colon_pos + 1);
             hostname = hostname.substr(0, colon_pos); // Remove port from hostname
         }
 
+        // Collect all headers; repeated fields are combined into one comma-separated value
+        for (const auto& field : req.base()) {
+            std::string name = field.name_string().to_string();
+            for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            std::string value = field.value().to_string();
+            auto existing = headers.find(name);
+            if (existing == headers.end()) {
+                headers.emplace(std::move(name), std::move(value));
+            } else {
+                existing->second += ", " + value;
+            }
+        }
+
         // Extract the request body (for POST, PUT methods, etc.)
         body = req.body();
         
     } catch (const std::exception& e) {
         // Catch any standard exceptions and log the error
-        std::cerr << "[ERROR] Exception during request parsing: " << e.what() << std::endl;
+        LOG_DEBUG("(no-id)", "Exception during request parsing: " + std::string(e.what()));
         throw InvalidRequest(); // Re-throw as a custom InvalidRequest exception
     }
 }
@@ -6,6 +6,7 @@
 #include <cstring>
 #include <iostream>
 #include <unordered_map>
+#include <cctype>
 
 /*
 Sample POST Request:
@@ -45,9 +46,10 @@ private:
     std::string body;           // Request body
     std::string method;         // HTTP method (GET, POST, etc.)
     std::string uri;            // Request URI
+    std::string scheme;         // URI scheme, from an absolute-form URI or "http"
     std::string port;           // Port number
     std::string hostname;       // Hostname
-    std::unordered_map<std::string, std::string> headers; // Request headers
+    std::unordered_map<std::string, std::string> headers; // Request headers, keyed by lowercase name
 
 public:
     Request(); // Default constructor
@@ -63,6 +65,7 @@ public:
         body(""), 
         method(""), 
         uri(""), 
+        scheme(""), 
         port(""), 
         hostname("") {
         
@@ -95,10 +98,13 @@ public:
     std::string get_body() const { return body; }
     std::string get_method() const { return method; }
     std::string get_uri() const { return uri; }
+    std::string get_scheme() const { return scheme.empty() ? "http" : scheme; }
     std::string get_port() const { return port.empty() ? "80" : port; }
     std::string get_hostname() const { return hostname; }
     std::string get_header(const std::string& key) const {
-        auto it = headers.find(key);
+        std::string lower_key(key);
+        for (char& c : lower_key) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        auto it = headers.find(lower_key);
         return (it != headers.end()) ? it->second : "";
     }
 };
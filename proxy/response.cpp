@@ -1,6 +1,12 @@
 #include "response.hpp"
+#include "http_scanner.hpp"
+#include "http_date.hpp"
+#include "freshness.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
 #include <ctime>
 
@@ -10,6 +16,28 @@ class InvalidResponse : public std::exception {
             return "Invalid response";
         }
     };
+
+namespace {
+
+const char* const kKnownHeaders[] = {
+    "Age", "Cache-Control", "Content-Encoding", "Content-Length", "Content-Type", "Date",
+    "ETag", "Expires", "Last-Modified", "Location", "Pragma", "Transfer-Encoding", "Vary",
+};
+
+/**
+ * Header names are case-insensitive; known ones are stored under their canonical spelling
+ */
+std::string canonical_name(std::string_view name) {
+    for (const char* known : kKnownHeaders) {
+        if (name.size() == strlen(known) && strncasecmp(name.data(), known, name.size()) == 0) {
+            return known;
+        }
+    }
+    return std::string(name);
+}
+
+} // namespace
+
 /**
  * @brief Parse the raw HTTP response into structured components.
  * 
@@ -26,50 +54,74 @@ void Response::parse(const std::string& raw) {
     }
 
     // Split the headers and body
-    std::string headers_str = raw.substr(0, body_pos);
+    std::string_view headers_str(raw.data(), body_pos);
     body_ = raw.substr(body_pos + 4);
     raw_response_ = raw;
 
-    // Parse status line (first line of headers)
-    std::istringstream header_stream(headers_str);
-    std::string status_line;
-    std::getline(header_stream, status_line);
-
-    // Parse the status line (e.g., HTTP/1.1 200 OK)
-    std::istringstream status_stream(status_line);
-    status_stream >> version_ >> status_code_ >> std::ws;
-    std::getline(status_stream, status_phrase_);
+    // Parse status line (first line of headers), e.g. HTTP/1.1 200 OK
+    size_t line_end = http_scan::find_crlf(headers_str.data(), headers_str.size());
+    std::string_view status_line = headers_str.substr(0, line_end);
+    size_t sp1 = status_line.find(' ');
+    if (sp1 == std::string_view::npos) {
+        throw InvalidResponse();
+    }
+    version_ = std::string(status_line.substr(0, sp1));
+    size_t sp2 = status_line.find(' ', sp1 + 1);
+    status_code_ = std::string(status_line.substr(sp1 + 1, sp2 == std::string_view::npos ? std::string_view::npos : sp2 - sp1 - 1));
+    if (sp2 != std::string_view::npos) {
+        status_phrase_ = std::string(status_line.substr(sp2 + 1));
+    }
 
     // Parse all remaining headers
-    std::string header_line;
-    while (std::getline(header_stream, header_line) && !header_line.empty()) {
-        size_t colon_pos = header_line.find(": ");
-        if (colon_pos != std::string::npos) {
-            std::string key = header_line.substr(0, colon_pos);
-            std::string value = header_line.substr(colon_pos + 2);
-            headers_map[key] = value;
+    size_t pos = (line_end == http_scan::npos) ? headers_str.size() : line_end + 2;
+    while (pos < headers_str.size()) {
+        size_t len = http_scan::find_crlf(headers_str.data() + pos, headers_str.size() - pos);
+        if (len == http_scan::npos) {
+            len = headers_str.size() - pos;
+        }
+        std::string_view name_view, value_view;
+        if (http_scan::split_header(headers_str.substr(pos, len), name_view, value_view)) {
+            std::string key = canonical_name(name_view);
+            std::string value(value_view);
+            // Repeated lines of a list field (Vary, Link, ...) mean one comma-joined
+            // value (RFC 9110 section 5.3); Set-Cookie is the exception and never stored
+            auto existing = headers_map.find(key);
+            if (existing == headers_map.end() || strcasecmp(key.c_str(), "Set-Cookie") == 0) {
+                headers_map[key] = value;
+            } else {
+                existing->second += ", " + value;
+            }
 
             // Parse specific headers
             if (key == "Content-Type") {
                 content_type_ = value;
             } else if (key == "Content-Length") {
-                content_length_ = std::stoi(value);
+                parse_content_length(value_view);
             } else if (key == "ETag") {
                 etag_ = value;
             } else if (key == "Cache-Control") {
-                cache_control_ = value;
-                process_cache_control(value);
-            } else if (key == "Transfer-Encoding" && value == "chunked") {
-                is_chunked_ = true;
+                // Repeated Cache-Control lines are combined rather than overwritten
+                cache_control_ = cache_control_.empty() ? value : cache_control_ + ", " + value;
+                directives_.parse(value);
+            } else if (key == "Pragma") {
+                directives_.parse_pragma(value);
+            } else if (key == "Transfer-Encoding") {
+                // Chunked framing applies when chunked is the final coding
+                std::string_view last = value_view.substr(value_view.rfind(',') + 1);
+                while (!last.empty() && (last.front() == ' ' || last.front() == '\t')) last.remove_prefix(1);
+                is_chunked_ = last.size() == 7 && strncasecmp(last.data(), "chunked", 7) == 0;
             } else if (key == "Date") {
                 date_ = parse_time(value);
+            } else if (key == "Age") {
+                age_ = parse_age(value);
             } else if (key == "Last-Modified") {
                 last_modified_ = parse_time(value);
-                need_validate_ = true;
             } else if (key == "Expires") {
+                has_expires_ = true;
                 expire_time_ = parse_time(value);
             }
         }
+        pos += len + 2;
     }
 
     // Manage cache time and freshness
@@ -78,76 +130,84 @@ void Response::parse(const std::string& raw) {
 }
 
 /**
- * @brief Process cache control directives from the Cache-Control header.
- * 
- * @param cache_control_str The raw Cache-Control header value.
+ * @brief Parse an HTTP date string into a time_t value.
  * 
- * This function sets various caching-related flags and ages based on the directives.
+ * @param time_str The date string (e.g., "Tue, 15 Nov 1994 08:12:31 GMT").
+ * @return time_t The parsed time, or 0 if the value is not a valid HTTP-date.
  */
-void Response::process_cache_control(const std::string& cache_control_str) {
-    is_private_ = cache_control_str.find("private") != std::string::npos;
-    is_no_store_ = cache_control_str.find("no-store") != std::string::npos;
-    is_no_cache_ = cache_control_str.find("no-cache") != std::string::npos;
-    is_revalidate_ = cache_control_str.find("must-revalidate") != std::string::npos;
-
-    size_t pos;
-    if ((pos = cache_control_str.find("s-maxage=")) != std::string::npos) {
-        s_max_age_ = std::stol(cache_control_str.substr(pos + 9));
-    }
-    if ((pos = cache_control_str.find("max-age=")) != std::string::npos) {
-        max_age_ = std::stol(cache_control_str.substr(pos + 8));
+time_t Response::parse_time(const std::string& time_str) {
+    time_t parsed = 0;
+    return http_date::parse(time_str, parsed) ? parsed : 0;
+}
+
+/**
+ * @brief Parse a Content-Length value (RFC 9112 section 6.3); a value that is
+ * not a number, or differs from an earlier Content-Length line, marks the
+ * framing as bad.
+ */
+void Response::parse_content_length(std::string_view value) {
+    uint64_t length = 0;
+    auto parsed = std::from_chars(value.data(), value.data() + value.size(), length);
+    if (value.empty() || parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() ||
+        length > static_cast<uint64_t>(INT64_MAX) ||
+        (content_length_ >= 0 && static_cast<uint64_t>(content_length_) != length)) {
+        bad_content_length_ = true;
+        return;
     }
+    content_length_ = static_cast<int64_t>(length);
 }
 
 /**
- * @brief Parse an HTTP date string into a time_t value.
- * 
- * @param time_str The date string (e.g., "Tue, 15 Nov 1994 08:12:31 GMT").
- * @return time_t The parsed time.
+ * @brief Parse the Age header (delta-seconds); invalid values count as 0 and
+ * values too large to represent saturate at 2^31 (RFC 9111 section 1.2.2).
  */
-time_t Response::parse_time(const std::string& time_str) {
-    struct tm gmttime = {};
-    strptime(time_str.c_str(), "%a, %d %b %Y %H:%M:%S %Z", &gmttime);
-    return timegm(&gmttime);
+time_t Response::parse_age(const std::string& age_str) {
+    const time_t max_age = 2147483648L;
+    time_t age = 0;
+    for (char c : age_str) {
+        if (c < '0' || c > '9') {
+            return 0;
+        }
+        if (age < max_age) {
+            age = age * 10 + (c - '0');
+        }
+    }
+    return age < max_age ? age : max_age;
 }
 
 /**
  * @brief Calculate cache expiration and freshness based on cache directives.
  * 
- * This function computes the expiration time using max-age, s-maxage, or Expires header.
+ * Follows RFC 9111 section 4.2: the lifetime comes from s-maxage, max-age or
+ * Expires, else from the Last-Modified heuristic or a per-status default. The
+ * current age starts at the corrected initial age (Age header plus transit
+ * delay), so expire_time_ is the instant the entry's age reaches its lifetime.
  */
 void Response::manage_cache_time() {
-    time_t now = time(NULL);
-    double age = difftime(now, date_);
-
-    if (s_max_age_ > 0) {
-        expire_time_ = date_ + s_max_age_;
-        is_fresh_ = s_max_age_ > age;
-    } else if (max_age_ > 0) {
-        expire_time_ = date_ + max_age_;
-        is_fresh_ = max_age_ > age;
-    } else if (expire_time_ > 0) {
-        is_fresh_ = expire_time_ > now;
-    } else {
-        is_fresh_ = true; // Default to fresh if no explicit cache control is found
-    }
-    current_age_ = now - date_;
+    FreshnessInputs in;
+    in.status = std::atoi(status_code_.c_str());
+    in.request_time = request_time_;
+    in.response_time = response_time_;
+    in.date = date_;
+    in.age = age_;
+    in.has_expires = has_expires_;
+    in.expires = expire_time_;
+    in.last_modified = last_modified_;
+
+    current_age_ = freshness::corrected_initial_age(in);
+    freshness_lifetime_ = freshness::lifetime(in, directives_, FreshnessPolicy::global(), is_heuristic_);
+    expire_time_ = response_time_ - current_age_ + freshness_lifetime_;
+    is_fresh_ = freshness_lifetime_ > current_age_;
 }
 
 /**
  * @brief Determine if the response needs revalidation.
  * 
- * The need for validation depends on freshness and cache-control directives.
+ * A stale response, or one marked no-cache (including Pragma: no-cache when no
+ * Cache-Control is present), must be validated before it is reused.
  */
 void Response::validate_freshness() {
-    need_validate_ = !is_fresh_;
-    if (!need_validate_ && headers_map.find("Cache-Control") != headers_map.end()) {
-        std::string cache_control = headers_map["Cache-Control"];
-        if (cache_control.find("must-revalidate") != std::string::npos || 
-            cache_control.find("no-cache") != std::string::npos) {
-            need_validate_ = true;
-        }
-    }
+    need_validate_ = !is_fresh_ || directives_.no_cache;
 }
 
 /**
@@ -2,9 +2,13 @@
 #define RESPONSE_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <ctime>
+#include <cstdint>
+#include "cache_control.hpp"
+#include "http_date.hpp"
 
 // Custom exception for invalid responses
 // class InvalidResponse : public std::exception {
@@ -53,38 +57,47 @@ private:
     std::string cache_control_;
     std::string transfer_encoding_;
     std::string content_type_;
-    std::string cache_mode;
+    CacheControl directives_;
 
-    int content_length_ = -1;
-    long max_age_ = -1;
-    long s_max_age_ = -1;
+    int64_t content_length_ = -1;       // -1 when absent
+    bool bad_content_length_ = false;   // Not a number, or repeated with different values
 
-    bool is_private_ = false;
-    bool is_revalidate_ = false;
-    bool is_no_cache_ = false;
-    bool is_no_store_ = false;
     bool is_chunked_ = false;
-    bool is_fresh_ = true;
+    bool is_fresh_ = false;
+    bool is_heuristic_ = false;
     bool need_validate_ = true;
+    bool has_expires_ = false;
 
     // Time management
+    time_t request_time_ = 0;
+    time_t response_time_ = 0;
     time_t date_ = 0;
+    time_t age_ = 0;
     time_t expire_time_ = 0;
     time_t current_age_ = 0;
     time_t last_modified_ = 0;
+    long freshness_lifetime_ = 0;
 
     // Helper methods
     void parse(const std::string& raw_response);
-    void parse_headers(const std::string& headers_str);
-    void process_cache_control(const std::string& cache_control_str);
     time_t parse_time(const std::string& time_str);
+    time_t parse_age(const std::string& age_str);
+    void parse_content_length(std::string_view value);
     void manage_cache_time();
     void validate_freshness();
 
 public:
     // Constructors
     Response() = default;
-    explicit Response(const std::string& raw_response) { parse(raw_response); }
+    explicit Response(const std::string& raw_response)
+        : request_time_(CoarseClock::now()), response_time_(request_time_) { parse(raw_response); }
+
+    /**
+     * @param request_time When the request was sent upstream
+     * @param response_time When the response headers were received
+     */
+    Response(const std::string& raw_response, time_t request_time, time_t response_time)
+        : request_time_(request_time), response_time_(response_time) { parse(raw_response); }
 
     // Getters
     std::string get_version() const { return version_; }
@@ -97,24 +110,29 @@ public:
     std::string get_transfer_encoding() const { return transfer_encoding_; }
     std::string get_content_type() const { return content_type_; }
     std::string get_header(const std::string& key) const;
-    int get_content_length() const { return content_length_; }
+    const std::unordered_map<std::string, std::string>& get_headers() const { return headers_map; }
+    int64_t get_content_length() const { return content_length_; }
+    bool has_bad_content_length() const { return bad_content_length_; }
 
     // Caching and validation flags
-    bool is_private() const { return is_private_; }
-    bool is_revalidate() const { return is_revalidate_; }
-    bool is_no_cache() const { return is_no_cache_; }
-    bool is_no_store() const { return is_no_store_; }
+    const CacheControl& get_directives() const { return directives_; }
+    bool is_private() const { return directives_.is_private; }
+    bool is_revalidate() const { return directives_.must_revalidate || directives_.proxy_revalidate; }
+    bool is_no_cache() const { return directives_.no_cache; }
+    bool is_no_store() const { return directives_.no_store; }
     bool is_chunked() const { return is_chunked_; }
     bool is_fresh() const { return is_fresh_; }
+    bool is_heuristic() const { return is_heuristic_; }
     bool needs_validation() const { return need_validate_; }
 
     // Time-related getters
     time_t get_date() const { return date_; }
     time_t get_expire_time() const { return expire_time_; }
-    time_t get_current_age() const { return current_age_; }
+    time_t get_current_age() const { return current_age_; }  // Corrected initial age
     time_t get_last_modified() const { return last_modified_; }
-    long get_max_age() const { return max_age_; }
-    long get_s_max_age() const { return s_max_age_; }
+    long get_freshness_lifetime() const { return freshness_lifetime_; }
+    long get_max_age() const { return directives_.max_age; }
+    long get_s_max_age() const { return directives_.s_maxage; }
 
     // Utility methods
     void set_raw_response(const std::string& raw_response) { raw_response_ = raw_response; }
@@ -0,0 +1,298 @@
+#include "slab_allocator.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstring>
+#include "utils/locks.hpp"
+
+/**
+ * Header at the start of every slab; chunks follow at SLAB_HEADER
+ */
+struct SlabAllocator::Slab {
+    SizeClass* cls;
+    Slab* prev;       // Links in cls->partial
+    Slab* next;
+    void* free_list;  // Freed chunks, linked through their first word
+    size_t bump;      // Chunks never handed out start at this index
+    size_t used;
+    bool in_partial;
+};
+
+namespace {
+
+const size_t MIN_CHUNK = 64;
+const size_t PAGE = 4096;
+const size_t LARGE_CHUNK = 16 * 1024;  // Freed chunks this big release their pages
+
+utils::LockSite class_site("slab.class");  // Shared by every size class
+
+uint8_t* chunk_base(void* slab) {
+    return static_cast<uint8_t*>(slab) + SlabAllocator::SLAB_HEADER;
+}
+
+} // namespace
+
+SlabAllocator::SlabAllocator() {
+    static_assert(sizeof(Slab) <= SLAB_HEADER, "Slab header must fit in SLAB_HEADER");
+
+    // 64, 80, 100, ... rounded to 16 bytes, up to MAX_CHUNK
+    for (double size = MIN_CHUNK; size < MAX_CHUNK; size *= 1.25) {
+        size_t rounded = (static_cast<size_t>(size) + 15) & ~size_t(15);
+        if (class_size_.empty() || rounded > class_size_.back()) {
+            class_size_.push_back(rounded);
+        }
+    }
+    class_size_.push_back(MAX_CHUNK);
+
+    classes_ = new SizeClass[class_size_.size()];
+    for (size_t i = 0; i < class_size_.size(); ++i) {
+        classes_[i].chunk_size = class_size_[i];
+        classes_[i].chunks_per_slab = (SLAB_SIZE - SLAB_HEADER) / class_size_[i];
+    }
+}
+
+SlabAllocator::~SlabAllocator() {
+    delete[] classes_;  // Slabs still holding live chunks stay mapped until exit
+}
+
+SlabAllocator& SlabAllocator::global() {
+    static SlabAllocator* instance = new SlabAllocator();  // Never destroyed: cache entries may outlive main()
+    return *instance;
+}
+
+// Smallest class that fits; classes are few, so a binary search is plenty
+size_t SlabAllocator::classFor(size_t size) const {
+    size_t lo = 0, hi = class_size_.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (class_size_[mid] >= size) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Map a SLAB_SIZE-aligned slab, so a chunk's slab is found by masking its address
+SlabAllocator::Slab* SlabAllocator::mapSlab(SizeClass& cls) {
+    void* raw = mmap(nullptr, SLAB_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + SLAB_SIZE - 1) & ~(uintptr_t)(SLAB_SIZE - 1);
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    uintptr_t end = start + SLAB_SIZE * 2;
+    if (end > aligned + SLAB_SIZE) {
+        munmap(reinterpret_cast<void*>(aligned + SLAB_SIZE), end - (aligned + SLAB_SIZE));
+    }
+
+    Slab* slab = reinterpret_cast<Slab*>(aligned);
+    resetSlab(slab, cls);
+    slabs_.fetch_add(1, std::memory_order_relaxed);
+    return slab;
+}
+
+void SlabAllocator::resetSlab(Slab* slab, SizeClass& cls) {
+    slab->cls = &cls;
+    slab->prev = slab->next = nullptr;
+    slab->free_list = nullptr;
+    slab->bump = 0;
+    slab->used = 0;
+    slab->in_partial = false;
+}
+
+void SlabAllocator::unmapSlab(Slab* slab) {
+    munmap(slab, SLAB_SIZE);
+    slabs_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void* SlabAllocator::allocate(size_t size) {
+    if (size == 0 || size > MAX_CHUNK) {
+        return nullptr;
+    }
+    SizeClass& cls = classes_[classFor(size)];
+    utils::ScopedLock<std::mutex> lock(cls.mutex, class_site);
+
+    Slab* slab = cls.partial;
+    if (!slab) {
+        if (cls.spare) {
+            slab = cls.spare;
+            cls.spare = nullptr;
+            spares_.fetch_sub(1, std::memory_order_relaxed);
+        } else {
+            slab = mapSlab(cls);
+            if (!slab) {
+                return nullptr;
+            }
+        }
+        partialPushBack(cls.partial, slab);
+    }
+
+    void* chunk;
+    if (slab->free_list) {
+        chunk = slab->free_list;
+        std::memcpy(&slab->free_list, chunk, sizeof(void*));
+    } else {
+        // Untouched chunks are carved lazily so their pages stay unbacked until used
+        chunk = chunk_base(slab) + slab->bump * cls.chunk_size;
+        ++slab->bump;
+    }
+    ++slab->used;
+    if (slab->used == cls.chunks_per_slab) {
+        partialUnlink(cls.partial, slab);
+    }
+
+    chunk_bytes_.fetch_add(cls.chunk_size, std::memory_order_relaxed);
+    requested_bytes_.fetch_add(size, std::memory_order_relaxed);
+    return chunk;
+}
+
+void SlabAllocator::deallocate(void* chunk, size_t size) {
+    if (!chunk) {
+        return;
+    }
+    Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(chunk) & ~(uintptr_t)(SLAB_SIZE - 1));
+    SizeClass& cls = *slab->cls;
+
+    // Large chunks give their whole pages back while still owned here; only
+    // the free-list link in the first word stays resident
+    if (cls.chunk_size >= LARGE_CHUNK) {
+        uintptr_t begin = (reinterpret_cast<uintptr_t>(chunk) + sizeof(void*) + PAGE - 1) & ~(uintptr_t)(PAGE - 1);
+        uintptr_t end = (reinterpret_cast<uintptr_t>(chunk) + cls.chunk_size) & ~(uintptr_t)(PAGE - 1);
+        if (end > begin) {
+            madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+        }
+    }
+
+    Slab* to_unmap = nullptr;
+    {
+        utils::ScopedLock<std::mutex> lock(cls.mutex, class_site);
+        std::memcpy(chunk, &slab->free_list, sizeof(void*));
+        slab->free_list = chunk;
+        --slab->used;
+
+        if (slab->used == 0) {
+            // Empty: keep one spare per class, give the rest back to the kernel
+            if (slab->in_partial) {
+                partialUnlink(cls.partial, slab);
+            }
+            if (!cls.spare) {
+                // Keep the mapping but drop its pages; this zeroes the header too
+                madvise(slab, SLAB_SIZE, MADV_DONTNEED);
+                resetSlab(slab, cls);
+                cls.spare = slab;
+                spares_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                to_unmap = slab;
+            }
+        } else if (!slab->in_partial) {
+            // Was full; refill it after older partial slabs so recently drained slabs can empty out
+            partialPushBack(cls.partial, slab);
+        }
+    }
+    if (to_unmap) {
+        unmapSlab(to_unmap);
+    }
+
+    chunk_bytes_.fetch_sub(cls.chunk_size, std::memory_order_relaxed);
+    requested_bytes_.fetch_sub(size, std::memory_order_relaxed);
+}
+
+SlabStats SlabAllocator::stats() const {
+    SlabStats stats;
+    stats.spare_slabs = spares_.load(std::memory_order_relaxed);
+    stats.slabs = slabs_.load(std::memory_order_relaxed) - stats.spare_slabs;
+    stats.mapped_bytes = stats.slabs * SLAB_SIZE;
+    stats.chunk_bytes = chunk_bytes_.load(std::memory_order_relaxed);
+    stats.requested_bytes = requested_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Partial lists are circular in prev only: head->prev is the tail
+void SlabAllocator::partialPushBack(Slab*& head, Slab* slab) {
+    slab->next = nullptr;
+    slab->in_partial = true;
+    if (!head) {
+        slab->prev = slab;
+        head = slab;
+        return;
+    }
+    Slab* tail = head->prev;
+    tail->next = slab;
+    slab->prev = tail;
+    head->prev = slab;
+}
+
+void SlabAllocator::partialUnlink(Slab*& head, Slab* slab) {
+    slab->in_partial = false;
+    if (slab == head) {
+        head = slab->next;
+        if (head) head->prev = slab->prev;
+    } else {
+        slab->prev->next = slab->next;
+        if (slab->next) slab->next->prev = slab->prev;
+        else head->prev = slab->prev;
+    }
+    slab->prev = slab->next = nullptr;
+}
+
+// SlabBuffer
+
+SlabBuffer::SlabBuffer(const void* data, size_t size) {
+    SlabAllocator& allocator = SlabAllocator::global();
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    chunks_.reserve((size + SlabAllocator::MAX_CHUNK - 1) / SlabAllocator::MAX_CHUNK);
+    size_t offset = 0;
+    while (offset < size) {
+        size_t len = std::min(size - offset, SlabAllocator::MAX_CHUNK);
+        void* chunk = allocator.allocate(len);
+        if (!chunk) {
+            failed_ = true;
+            release();
+            return;
+        }
+        std::memcpy(chunk, src + offset, len);
+        chunks_.push_back(static_cast<uint8_t*>(chunk));
+        size_ = offset + len;
+        offset += len;
+    }
+}
+
+SlabBuffer::SlabBuffer(SlabBuffer&& other) noexcept
+    : chunks_(std::move(other.chunks_)), size_(other.size_), failed_(other.failed_) {
+    other.chunks_.clear();
+    other.size_ = 0;
+    other.failed_ = false;
+}
+
+SlabBuffer& SlabBuffer::operator=(SlabBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        chunks_ = std::move(other.chunks_);
+        size_ = other.size_;
+        failed_ = other.failed_;
+        other.chunks_.clear();
+        other.size_ = 0;
+        other.failed_ = false;
+    }
+    return *this;
+}
+
+void SlabBuffer::release() {
+    SlabAllocator& allocator = SlabAllocator::global();
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        allocator.deallocate(chunks_[i], chunk(i).size());
+    }
+    chunks_.clear();
+    chunks_.shrink_to_fit();
+    size_ = 0;
+}
+
+size_t SlabBuffer::footprint() const {
+    SlabAllocator& allocator = SlabAllocator::global();
+    size_t bytes = 0;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        bytes += allocator.chunkSize(chunk(i).size());
+    }
+    return bytes;
+}
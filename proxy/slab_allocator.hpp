@@ -0,0 +1,150 @@
+#ifndef SLAB_ALLOCATOR_HPP
+#define SLAB_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/**
+ * Fragmentation figures for the slab allocator
+ *
+ * mapped >= chunk >= requested; the gaps are the two kinds of waste.
+ */
+struct SlabStats {
+    size_t slabs = 0;            // Slabs holding chunks
+    size_t spare_slabs = 0;      // Empty slabs kept mapped, pages released
+    size_t mapped_bytes = 0;     // slabs * SLAB_SIZE (what RSS can reach)
+    size_t chunk_bytes = 0;      // Capacity of chunks handed out
+    size_t requested_bytes = 0;  // Bytes callers asked for
+
+    // Waste from rounding requests up to their size class
+    double internalFragmentation() const {
+        return chunk_bytes ? 1.0 - double(requested_bytes) / chunk_bytes : 0.0;
+    }
+    // Free chunks stranded in partially used slabs
+    double externalFragmentation() const {
+        return mapped_bytes ? 1.0 - double(chunk_bytes) / mapped_bytes : 0.0;
+    }
+};
+
+/**
+ * Size-class slab allocator for long-lived cache memory
+ *
+ * Memory comes from 1 MiB mmap'd slabs, each carved into equal chunks of one
+ * size class (64 bytes up to MAX_CHUNK, classes 1.25x apart). Mixed-size,
+ * long-lived cache data therefore never interleaves with short-lived request
+ * buffers on the general heap, and a slab whose chunks are all freed is
+ * returned to the kernel, so mapped memory follows the live cache size.
+ *
+ * Thread-safe: each size class has its own mutex.
+ */
+class SlabAllocator {
+public:
+    static constexpr size_t SLAB_SIZE = 1 << 20;
+    static constexpr size_t SLAB_HEADER = 64;  // Slab bookkeeping at the start of each slab
+    static constexpr size_t MAX_CHUNK = ((SLAB_SIZE - SLAB_HEADER) / 16) & ~size_t(63);
+
+    SlabAllocator();
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    /**
+     * @param size 1..MAX_CHUNK bytes
+     * @return A chunk of at least size bytes, or nullptr if mmap fails
+     */
+    void* allocate(size_t size);
+
+    /**
+     * @param size The size passed to allocate()
+     */
+    void deallocate(void* chunk, size_t size);
+
+    /**
+     * Capacity of the chunk that allocate(size) hands out
+     */
+    size_t chunkSize(size_t size) const { return class_size_[classFor(size)]; }
+
+    SlabStats stats() const;
+
+    static SlabAllocator& global();
+
+private:
+    struct Slab;
+
+    struct SizeClass {
+        std::mutex mutex;
+        size_t chunk_size = 0;
+        size_t chunks_per_slab = 0;
+        Slab* partial = nullptr;  // Slabs with free chunks, allocation order
+        Slab* spare = nullptr;    // One empty slab kept to absorb alloc/free churn
+    };
+
+    std::vector<size_t> class_size_;
+    SizeClass* classes_;
+    std::atomic<size_t> slabs_{0};
+    std::atomic<size_t> spares_{0};
+    std::atomic<size_t> chunk_bytes_{0};
+    std::atomic<size_t> requested_bytes_{0};
+
+    size_t classFor(size_t size) const;
+    Slab* mapSlab(SizeClass& cls);
+    void unmapSlab(Slab* slab);
+    static void resetSlab(Slab* slab, SizeClass& cls);
+    static void partialPushBack(Slab*& head, Slab* slab);
+    static void partialUnlink(Slab*& head, Slab* slab);
+};
+
+/**
+ * Immutable byte string stored in slab chunks
+ *
+ * Up to MAX_CHUNK bytes occupy one chunk of the best-fitting class; longer
+ * contents are split into MAX_CHUNK pieces plus a fitted tail, so a body
+ * never needs one large contiguous allocation. Move-only; frees its chunks
+ * on destruction.
+ */
+class SlabBuffer {
+private:
+    std::vector<uint8_t*> chunks_;
+    size_t size_ = 0;
+    bool failed_ = false;  // Copying in ran out of memory; holds nothing
+
+    void release();
+
+public:
+    SlabBuffer() = default;
+    SlabBuffer(const void* data, size_t size);
+    explicit SlabBuffer(std::string_view data) : SlabBuffer(data.data(), data.size()) {}
+    ~SlabBuffer() { release(); }
+
+    SlabBuffer(SlabBuffer&& other) noexcept;
+    SlabBuffer& operator=(SlabBuffer&& other) noexcept;
+    SlabBuffer(const SlabBuffer&) = delete;
+    SlabBuffer& operator=(const SlabBuffer&) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * False if the allocator ran out of memory while copying in
+     */
+    bool valid() const { return !failed_; }
+
+    size_t chunkCount() const { return chunks_.size(); }
+    std::string_view chunk(size_t i) const {
+        size_t offset = i * SlabAllocator::MAX_CHUNK;
+        size_t len = (i + 1 == chunks_.size()) ? size_ - offset : SlabAllocator::MAX_CHUNK;
+        return std::string_view(reinterpret_cast<const char*>(chunks_[i]), len);
+    }
+
+    /**
+     * Slab bytes held, including rounding up to size classes
+     */
+    size_t footprint() const;
+};
+
+#endif // SLAB_ALLOCATOR_HPP
@@ -1,29 +1,145 @@
 #include "socket.hpp"
+#include "access_log.hpp"
+#include "config.hpp"
 #include <iostream>
 #include <stdexcept>
 #include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
 
+namespace {
+
 /**
- * @brief Default constructor that creates a new TCP socket
- * 
- * Creates a new socket with IPv4 address family and TCP protocol.
- * Sets the SO_REUSEADDR option to allow reusing local addresses.
- * @throws std::runtime_error if socket creation or option setting fails
+ * @brief Orders resolved addresses for happy eyeballs (RFC 8305 section 4)
+ *
+ * Keeps the resolver's preferred address first, then alternates address
+ * families, so a broken family costs one attempt delay at most.
  */
-TcpSocket::TcpSocket() : socket_fd_(-1) {
-    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd_ == -1) {
-        throw std::runtime_error("Failed to create socket");
+std::vector<const addrinfo*> interleave(const addrinfo* list) {
+    std::vector<const addrinfo*> first, other;
+    for (const addrinfo* ai = list; ai != nullptr; ai = ai->ai_next) {
+        (ai->ai_family == list->ai_family ? first : other).push_back(ai);
     }
+    std::vector<const addrinfo*> order;
+    for (size_t i = 0; i < first.size() || i < other.size(); ++i) {
+        if (i < first.size()) order.push_back(first[i]);
+        if (i < other.size()) order.push_back(other[i]);
+    }
+    return order;
+}
 
-    int opt = 1;
-    if (setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        throw std::runtime_error("Failed to set socket options");
+/**
+ * @brief Starts a non-blocking connect
+ * @return The socket, or -1 if the attempt failed at once
+ */
+int start_connect(const addrinfo* ai, bool& connected) {
+    int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) {
+        return -1;
+    }
+    connected = ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    if (!connected && errno != EINPROGRESS) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Formats an address, showing IPv4-mapped IPv6 addresses as plain IPv4
+ */
+std::string address_string(const sockaddr* addr) {
+    char text[INET6_ADDRSTRLEN] = "";
+    if (addr->sa_family == AF_INET6) {
+        const in6_addr& ip = reinterpret_cast<const sockaddr_in6*>(addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&ip)) {
+            inet_ntop(AF_INET, ip.s6_addr + 12, text, sizeof(text));
+        } else {
+            inet_ntop(AF_INET6, &ip, text, sizeof(text));
+        }
+    } else if (addr->sa_family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(addr)->sin_addr, text, sizeof(text));
+    }
+    return text;
+}
+
+/**
+ * @brief Resolves host and port, giving up at give_up
+ *
+ * getaddrinfo cannot be interrupted, so a name that needs the resolver is
+ * looked up on a helper thread while the caller waits until give_up. A
+ * lookup that outlives the wait is abandoned; the helper frees its result.
+ * IP literals are converted in place without a thread.
+ * @return The addresses, to be freed with freeaddrinfo, or nullptr
+ */
+addrinfo* resolve(const std::string& host, int port, std::chrono::steady_clock::time_point give_up) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string service = std::to_string(port);
+    addrinfo* found = nullptr;
+
+    hints.ai_flags = AI_NUMERICHOST;
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &found) == 0) {
+        return found;
+    }
+    hints.ai_flags = 0;
+
+    struct Lookup {
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+        bool abandoned = false;
+        addrinfo* found = nullptr;
+    };
+    auto lookup = std::make_shared<Lookup>();
+    try {
+        std::thread([lookup, host, service, hints] {
+            addrinfo* result = nullptr;
+            if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+                result = nullptr;
+            }
+            std::lock_guard<std::mutex> lock(lookup->mutex);
+            if (lookup->abandoned) {
+                if (result != nullptr) freeaddrinfo(result);
+                return;
+            }
+            lookup->found = result;
+            lookup->done = true;
+            lookup->done_cv.notify_one();
+        }).detach();
+    } catch (const std::system_error&) {
+        return nullptr;  // No thread to spare; treat as a failed lookup
     }
+
+    std::unique_lock<std::mutex> lock(lookup->mutex);
+    if (give_up == std::chrono::steady_clock::time_point::max()) {
+        lookup->done_cv.wait(lock, [&] { return lookup->done; });
+    } else if (!lookup->done_cv.wait_until(lock, give_up, [&] { return lookup->done; })) {
+        lookup->abandoned = true;
+        return nullptr;
+    }
+    return lookup->found;
+}
+
+} // namespace
+
+/**
+ * @brief Default constructor for a socket that is not open yet
+ *
+ * bind() or connect() opens it, in the address family they need.
+ */
+TcpSocket::TcpSocket() : socket_fd_(-1) {
+    std::memset(&address_, 0, sizeof(address_));
 }
 
 /**
@@ -33,11 +149,9 @@ TcpSocket::TcpSocket() : socket_fd_(-1) {
  * @param socket_fd Existing socket file descriptor
  * @param client_addr Socket address information of the client
  */
-TcpSocket::TcpSocket(int socket_fd, struct sockaddr_in client_addr) 
+TcpSocket::TcpSocket(int socket_fd, const struct sockaddr_storage& client_addr)
     : socket_fd_(socket_fd), address_(client_addr) {
-    char ip_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(client_addr.sin_addr), ip_str, INET_ADDRSTRLEN);
-    remote_address_ = std::string(ip_str);
+    remote_address_ = address_string(reinterpret_cast<const sockaddr*>(&client_addr));
 }
 
 /**
@@ -50,17 +164,42 @@ TcpSocket::~TcpSocket() {
 /**
  * @brief Binds the socket to the specified port on all available interfaces
  * 
- * Sets up the socket address structure with the specified port and binds
- * the socket to that address.
+ * Opens an IPv6 socket that also accepts IPv4 clients, as IPv4-mapped
+ * addresses. Hosts without IPv6 get a plain IPv4 socket instead.
  * @param port The port number to bind to
  * @return true if binding was successful, false otherwise
+ * @throws std::runtime_error if socket creation or option setting fails
  */
 bool TcpSocket::bind(int port) {
-    address_.sin_family = AF_INET;
-    address_.sin_addr.s_addr = INADDR_ANY;
-    address_.sin_port = htons(port);
+    close();
+    std::memset(&address_, 0, sizeof(address_));
+    socklen_t length = 0;
+    socket_fd_ = socket(AF_INET6, SOCK_STREAM, 0);
+    if (socket_fd_ != -1) {
+        int off = 0;
+        setsockopt(socket_fd_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6* address = reinterpret_cast<sockaddr_in6*>(&address_);
+        address->sin6_family = AF_INET6;
+        address->sin6_addr = in6addr_any;
+        address->sin6_port = htons(port);
+        length = sizeof(sockaddr_in6);
+    } else {
+        socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (socket_fd_ == -1) {
+            throw std::runtime_error("Failed to create socket");
+        }
+        sockaddr_in* address = reinterpret_cast<sockaddr_in*>(&address_);
+        address->sin_family = AF_INET;
+        address->sin_addr.s_addr = INADDR_ANY;
+        address->sin_port = htons(port);
+        length = sizeof(sockaddr_in);
+    }
 
-    if (::bind(socket_fd_, (struct sockaddr*)&address_, sizeof(address_)) < 0) {
+    int opt = 1;
+    if (setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        throw std::runtime_error("Failed to set socket options");
+    }
+    if (::bind(socket_fd_, (struct sockaddr*)&address_, length) < 0) {
         return false;
     }
     return true;
@@ -90,7 +229,7 @@ bool TcpSocket::listen(int backlog) {
  *         or nullptr if the operation failed
  */
 std::shared_ptr<ISocket> TcpSocket::accept() {
-    struct sockaddr_in client_addr;
+    struct sockaddr_storage client_addr;
     socklen_t addr_len = sizeof(client_addr);
     int client_socket = ::accept(this->socket_fd_, (struct sockaddr*)&client_addr, &addr_len);
     
@@ -104,28 +243,99 @@ std::shared_ptr<ISocket> TcpSocket::accept() {
 /**
  * @brief Initiates a connection to a remote host
  * 
- * Resolves the hostname to an IP address using gethostbyname() and attempts to
- * establish a connection to that address on the specified port.
+ * Resolves the hostname to all its IPv6 and IPv4 addresses and races
+ * non-blocking connects to them (happy eyeballs, RFC 8305). A new attempt
+ * starts every PROXY_HAPPY_EYEBALLS_DELAY_MS, or as soon as one fails, and
+ * the first to connect wins. The rest are closed. The lookup counts
+ * against give_up too.
  * @param host The hostname or IP address of the remote host
  * @param port The port number on the remote host
+ * @param give_up When to stop trying
  * @return true if the connection was successful, false otherwise
  */
-bool TcpSocket::connect(const std::string& host, int port) {
-    struct hostent* server = gethostbyname(host.c_str());
-    if (server == nullptr) {
+bool TcpSocket::connect(const std::string& host, int port, std::chrono::steady_clock::time_point give_up) {
+    using Clock = std::chrono::steady_clock;
+    static const Clock::duration attempt_delay =
+        std::chrono::milliseconds(std::max(10L, Config::get_long("PROXY_HAPPY_EYEBALLS_DELAY_MS", 250)));
+
+    close();
+    addrinfo* found = resolve(host, port, give_up);
+    if (found == nullptr) {
         return false;
     }
+    access_log::Current::mark(access_log::DNS);
 
-    struct sockaddr_in server_addr;
-    std::memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    std::memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    server_addr.sin_port = htons(port);
+    std::vector<const addrinfo*> order = interleave(found);
+    std::vector<pollfd> attempts;
+    std::vector<const addrinfo*> attempt_addrs;
+    const addrinfo* winner_addr = nullptr;
+    int winner = -1;
+    size_t next = 0;
+    Clock::time_point next_start = Clock::now();
+    while (winner < 0) {
+        Clock::time_point now = Clock::now();
+        if (now >= give_up) {
+            break;
+        }
+        if (next < order.size() && now >= next_start) {
+            bool connected = false;
+            int fd = start_connect(order[next], connected);
+            if (connected) {
+                winner = fd;
+                winner_addr = order[next];
+            } else if (fd >= 0) {
+                attempts.push_back({fd, POLLOUT, 0});
+                attempt_addrs.push_back(order[next]);
+            }
+            ++next;
+            next_start = fd >= 0 ? now + attempt_delay : now;
+            continue;
+        }
+        if (attempts.empty()) {
+            if (next < order.size()) continue;
+            break;  // Every address failed
+        }
 
-    if (::connect(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        return false;
+        Clock::time_point wake = next < order.size() ? std::min(give_up, next_start) : give_up;
+        int timeout_ms = -1;
+        if (wake != Clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1;
+            timeout_ms = static_cast<int>(std::min<int64_t>(left, 60000));
+        }
+        if (poll(attempts.data(), attempts.size(), timeout_ms) < 0 && errno != EINTR) {
+            break;
+        }
+        for (size_t i = attempts.size(); i-- > 0;) {
+            if (attempts[i].revents == 0) {
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == 0 && winner < 0) {
+                winner = attempts[i].fd;
+                winner_addr = attempt_addrs[i];
+            } else {
+                ::close(attempts[i].fd);
+                next_start = Clock::now();  // A failed attempt lets the next one start at once
+            }
+            attempts.erase(attempts.begin() + i);
+            attempt_addrs.erase(attempt_addrs.begin() + i);
+        }
     }
-    return true;
+    for (const pollfd& attempt : attempts) {
+        ::close(attempt.fd);
+    }
+
+    if (winner >= 0) {
+        // Callers use blocking I/O
+        fcntl(winner, F_SETFL, fcntl(winner, F_GETFL) & ~O_NONBLOCK);
+        socket_fd_ = winner;
+        std::memcpy(&address_, winner_addr->ai_addr, winner_addr->ai_addrlen);
+        remote_address_ = address_string(winner_addr->ai_addr);
+    }
+    freeaddrinfo(found);
+    return winner >= 0;
 }
 
 /**
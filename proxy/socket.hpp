@@ -1,6 +1,7 @@
 #ifndef SOCKET_HPP
 #define SOCKET_HPP
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <memory>
@@ -8,6 +9,7 @@
 
 // Constants
 constexpr int BUFFER_SIZE = 8192;
+constexpr size_t MAX_REQUEST_HEADER_BYTES = 64 * 1024;
 
 /**
  * Socket interface - Abstract away socket operations for testability
@@ -18,7 +20,11 @@ public:
     virtual bool bind(int port) = 0;
     virtual bool listen(int backlog) = 0;
     virtual std::shared_ptr<ISocket> accept() = 0;
-    virtual bool connect(const std::string& host, int port) = 0;
+    /**
+     * Connects to host, giving up at give_up
+     */
+    virtual bool connect(const std::string& host, int port,
+                         std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::time_point::max()) = 0;
     virtual ssize_t send(const std::vector<uint8_t>& data) = 0;
     virtual ssize_t receive(std::vector<uint8_t>& buffer, size_t max_size) = 0;
     virtual void close() = 0;
@@ -33,18 +39,19 @@ public:
 class TcpSocket : public ISocket {
 private:
     int socket_fd_;
-    struct sockaddr_in address_;
+    struct sockaddr_storage address_;
     std::string remote_address_;
 
 public:
     TcpSocket(); // Constructor declaration
-    explicit TcpSocket(int socket_fd, struct sockaddr_in client_addr); // Constructor declaration
+    explicit TcpSocket(int socket_fd, const struct sockaddr_storage& client_addr); // Constructor declaration
     ~TcpSocket() override; // Destructor declaration
 
     bool bind(int port) override; // Method declaration
     bool listen(int backlog) override; // Method declaration
     std::shared_ptr<ISocket> accept() override; // Method declaration
-    bool connect(const std::string& host, int port) override; // Method declaration
+    bool connect(const std::string& host, int port,
+                 std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::time_point::max()) override;
     ssize_t send(const std::vector<uint8_t>& data) override; // Method declaration
     ssize_t receive(std::vector<uint8_t>& buffer, size_t max_size) override; // Method declaration
     void close() override; // Method declaration
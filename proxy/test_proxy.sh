@@ -6,6 +6,8 @@ set -e
 PROXY="http://localhost:12345"
 TEST_URL="http://example.com"
 LOG_FILE="./logs/proxy.log"
+# The proxy appends its log in the background (PROXY_LOG_FLUSH_MS, 100 ms by default)
+LOG_WAIT=0.3
 
 echo "Starting HTTP proxy integration tests..."
 
@@ -23,6 +25,7 @@ echo "✅ Basic GET successful"
 # Test 2: Cache hit (same request)
 echo "Test 2: Cache hit test"
 curl -s --proxy $PROXY $TEST_URL > /dev/null
+sleep $LOG_WAIT
 if grep -q "in cache, valid" $LOG_FILE; then
   echo "✅ Cache hit successful"
 else
@@ -37,6 +40,7 @@ echo "✅ POST successful"
 # Test 4: HTTPS CONNECT request
 echo "Test 4: HTTPS CONNECT request"
 curl -s --proxy $PROXY https://example.com > /dev/null
+sleep $LOG_WAIT
 if grep -q "Connection Established" $LOG_FILE; then
   echo "✅ CONNECT successful"
 else
@@ -55,6 +59,7 @@ echo "✅ Multiple requests completed"
 echo "Test 6: Handling non-cacheable resources"
 curl -s --proxy $PROXY "http://httpbin.org/response-headers?Cache-Control=no-store" > /dev/null
 
+sleep $LOG_WAIT
 if grep -q "not cacheable" $LOG_FILE; then
   echo "✅ Non-cacheable handling successful"
 else
@@ -66,4 +71,12 @@ echo "Test 7: Error handling"
 curl -s --proxy $PROXY "http://non-existent-domain-12345.com" > /dev/null 2>&1 || true
 echo "✅ Error handling completed"
 
+# Test 8: Metrics endpoint
+echo "Test 8: Metrics endpoint"
+if curl -s -m 5 "http://localhost:12346/metrics" | grep -q 'proxy_cache_lookups_total{result="hit"}'; then
+  echo "✅ Metrics endpoint successful"
+else
+  echo "❌ Metrics endpoint check failed"
+fi
+
 echo "All tests completed!"
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "timeouts.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
+#include <mutex>
+#include <sys/socket.h>
+#include <thread>
+
+namespace timeouts {
+
+namespace {
+
+const int64_t TICK_NS = 10 * 1000000LL;
+const size_t SLOTS = 512;  // About five seconds per turn
+
+const char* const NAMES[KINDS] = {"header_read", "request", "connect", "first_byte", "body_idle", "tunnel_idle"};
+
+struct Setting {
+    const char* variable;
+    long fallback_ms;
+};
+const Setting SETTINGS[KINDS] = {
+    {"PROXY_HEADER_TIMEOUT_MS", 10000},       {"PROXY_REQUEST_TIMEOUT_MS", 300000},
+    {"PROXY_CONNECT_TIMEOUT_MS", 5000},       {"PROXY_FIRST_BYTE_TIMEOUT_MS", 30000},
+    {"PROXY_BODY_IDLE_TIMEOUT_MS", 30000},    {"PROXY_TUNNEL_IDLE_TIMEOUT_MS", 300000},
+};
+
+int64_t limits_ns[KINDS];
+std::atomic<bool> running{false};
+
+const char* HELP = "Socket operations cut off by a deadline, by kind";
+metrics::Counter fired[KINDS] = {
+    {"proxy_timeouts_total", HELP, "kind=\"header_read\""}, {"proxy_timeouts_total", HELP, "kind=\"request\""},
+    {"proxy_timeouts_total", HELP, "kind=\"connect\""},     {"proxy_timeouts_total", HELP, "kind=\"first_byte\""},
+    {"proxy_timeouts_total", HELP, "kind=\"body_idle\""},   {"proxy_timeouts_total", HELP, "kind=\"tunnel_idle\""},
+};
+
+// Due time of the Request deadline on this thread, or 0
+thread_local int64_t request_due_ns = 0;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct Wheel {
+    std::mutex mutex;
+    Deadline* slots[SLOTS] = {};
+    int64_t tick = 0;  // Last tick processed
+
+    /**
+     * First tick at or after due, so the deadline has passed when its slot comes up
+     */
+    static int64_t tickOf(int64_t due_ns) {
+        return (due_ns + TICK_NS - 1) / TICK_NS;
+    }
+
+    void link(Deadline* deadline, int64_t due_ns) {
+        int64_t due_tick = std::max(tickOf(due_ns), tick + 1);
+        deadline->slot_ = static_cast<size_t>(due_tick) % SLOTS;
+        deadline->prev_ = nullptr;
+        deadline->next_ = slots[deadline->slot_];
+        if (deadline->next_) deadline->next_->prev_ = deadline;
+        slots[deadline->slot_] = deadline;
+        deadline->linked_ = true;
+    }
+
+    void unlink(Deadline* deadline) {
+        if (deadline->prev_) {
+            deadline->prev_->next_ = deadline->next_;
+        } else {
+            slots[deadline->slot_] = deadline->next_;
+        }
+        if (deadline->next_) deadline->next_->prev_ = deadline->prev_;
+        deadline->prev_ = deadline->next_ = nullptr;
+        deadline->linked_ = false;
+    }
+
+    void fire(Deadline* deadline) {
+        unlink(deadline);
+        deadline->expired_.store(true, std::memory_order_release);
+        fired[static_cast<size_t>(deadline->cause())].inc();
+        // Reading alone stops for a client still owed an error response
+        if (deadline->fd_ >= 0) {
+            ::shutdown(deadline->fd_, deadline->kind_ == Kind::HeaderRead ? SHUT_RD : SHUT_RDWR);
+        }
+    }
+
+    /**
+     * Expires or moves along everything in the slots up to now
+     */
+    void advance(int64_t now) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t now_tick = now / TICK_NS;
+        // After a long stall one pass over every slot covers all of them
+        if (now_tick - tick > static_cast<int64_t>(SLOTS)) {
+            tick = now_tick - static_cast<int64_t>(SLOTS);
+        }
+        while (tick < now_tick) {
+            ++tick;
+            Deadline* deadline = slots[static_cast<size_t>(tick) % SLOTS];
+            while (deadline) {
+                Deadline* next = deadline->next_;
+                int64_t due = deadline->due_ns_.load(std::memory_order_relaxed);
+                if (due <= now) {
+                    fire(deadline);
+                } else if (static_cast<size_t>(tickOf(due)) % SLOTS != deadline->slot_) {
+                    unlink(deadline);  // Re-armed since it was linked
+                    link(deadline, due);
+                }
+                deadline = next;
+            }
+        }
+    }
+
+    void run() {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(TICK_NS));
+            advance(now_ns());
+        }
+    }
+};
+
+namespace {
+
+Wheel wheel;
+
+} // namespace
+
+const char* name(Kind kind) {
+    return NAMES[static_cast<size_t>(kind)];
+}
+
+Clock::duration limit(Kind kind) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(limits_ns[static_cast<size_t>(kind)]));
+}
+
+Deadline::Deadline(int fd, Kind kind) : fd_(fd), kind_(kind), limit_ns_(0) {
+    if (fd >= 0) {
+        arm();
+    }
+}
+
+Deadline::Deadline(Kind kind) : fd_(-1), kind_(kind), limit_ns_(0) {
+    arm();
+}
+
+void Deadline::arm() {
+    limit_ns_ = running.load(std::memory_order_acquire) ? limits_ns[static_cast<size_t>(kind_)] : 0;
+    if (limit_ns_ <= 0) {
+        return;
+    }
+    int64_t due = dueFrom(now_ns());
+    due_ns_.store(due, std::memory_order_relaxed);
+    if (kind_ == Kind::Request) {
+        request_due_ns = due;
+    }
+    std::lock_guard<std::mutex> lock(wheel.mutex);
+    wheel.link(this, due);
+}
+
+Deadline::~Deadline() {
+    cancel();
+}
+
+int64_t Deadline::dueFrom(int64_t now) {
+    int64_t due = now + limit_ns_;
+    bool capped = kind_ != Kind::Request && request_due_ns != 0 && request_due_ns < due;
+    capped_.store(capped, std::memory_order_relaxed);
+    return capped ? request_due_ns : due;
+}
+
+bool Deadline::expired() const {
+    if (expired_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    // The wheel may not have reached a passed deadline yet
+    return fd_ < 0 && limit_ns_ > 0 && now_ns() >= due_ns_.load(std::memory_order_relaxed);
+}
+
+Clock::time_point Deadline::due() const {
+    if (limit_ns_ <= 0) {
+        return Clock::time_point::max();
+    }
+    return Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::nanoseconds(due_ns_.load(std::memory_order_relaxed))));
+}
+
+void Deadline::rearm() {
+    if (limit_ns_ > 0 && !expired()) {
+        due_ns_.store(dueFrom(now_ns()), std::memory_order_relaxed);
+    }
+}
+
+void Deadline::cancel() {
+    if (limit_ns_ <= 0) {
+        return;
+    }
+    if (kind_ == Kind::Request) {
+        request_due_ns = 0;
+    }
+    std::lock_guard<std::mutex> lock(wheel.mutex);
+    if (linked_) {
+        // The caller of a socketless deadline gave up on time; count it like the wheel would
+        if (fd_ < 0 && now_ns() >= due_ns_.load(std::memory_order_relaxed)) {
+            wheel.fire(this);
+        } else {
+            wheel.unlink(this);
+        }
+    }
+    limit_ns_ = 0;
+}
+
+void start() {
+    for (size_t i = 0; i < KINDS; ++i) {
+        long ms = std::max(0L, Config::get_long(SETTINGS[i].variable, SETTINGS[i].fallback_ms));
+        limits_ns[i] = ms * 1000000LL;
+    }
+    wheel.tick = now_ns() / TICK_NS;
+    running.store(true, std::memory_order_release);
+    std::thread([] { wheel.run(); }).detach();
+}
+
+} // namespace timeouts
@@ -0,0 +1,113 @@
+#ifndef TIMEOUTS_HPP
+#define TIMEOUTS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Deadlines for blocking socket I/O
+ *
+ * Handler threads block in recv, send and connect. A Deadline puts the
+ * socket on a hashed timer wheel, which one thread advances every TICK. When
+ * the deadline passes, the wheel shuts the socket down, and the blocked call
+ * returns at once with an error or end of stream. The caller checks
+ * expired() to tell a timeout from the peer closing.
+ *
+ * Idle timers are re-armed after every read, so rearm() only moves an
+ * atomic due time. The wheel notices the later time when it reaches the
+ * deadline's slot and moves the deadline further along.
+ *
+ * A Request deadline caps every other deadline taken on the same thread
+ * while it lives, so waiting on the origin cannot outlast the request.
+ *
+ * A deadline without a socket is for callers that wait in poll themselves,
+ * such as a connect racing several addresses. They wait no longer than due(),
+ * and the deadline counts as expired once that time has passed.
+ */
+namespace timeouts {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Kind {
+    HeaderRead,  // Client request headers, from accept
+    Request,     // Whole request, from accept until the response is sent
+    Connect,     // DNS lookup and TCP connect to the origin
+    FirstByte,   // From sending to the origin until its response headers
+    BodyIdle,    // Between reads of the origin's response body
+    TunnelIdle,  // CONNECT tunnel with no traffic either way
+};
+const size_t KINDS = 6;
+
+/**
+ * Label used in metrics and logs, e.g. "first_byte"
+ */
+const char* name(Kind kind);
+
+/**
+ * Configured limit for kind; zero when disabled
+ */
+Clock::duration limit(Kind kind);
+
+class Deadline {
+public:
+    /**
+     * Arms the configured limit for kind on fd; does nothing if it is disabled
+     */
+    Deadline(int fd, Kind kind);
+    /**
+     * Arms the configured limit for kind with no socket to shut down
+     */
+    explicit Deadline(Kind kind);
+    ~Deadline();
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+
+    /**
+     * Restarts the limit from now
+     */
+    void rearm();
+    void cancel();
+
+    bool expired() const;
+
+    /**
+     * When the deadline passes; Clock::time_point::max() when disabled
+     */
+    Clock::time_point due() const;
+
+    /**
+     * What ran out: this deadline's own kind, or Request when capped by it
+     */
+    Kind cause() const { return capped_.load(std::memory_order_relaxed) ? Kind::Request : kind_; }
+
+private:
+    friend struct Wheel;
+
+    void arm();
+    int64_t dueFrom(int64_t now_ns);
+
+    int fd_;
+    Kind kind_;
+    int64_t limit_ns_;
+    std::atomic<int64_t> due_ns_{0};
+    std::atomic<bool> expired_{false};
+    std::atomic<bool> capped_{false};
+
+    // Wheel bookkeeping, under the wheel's lock
+    Deadline* prev_ = nullptr;
+    Deadline* next_ = nullptr;
+    size_t slot_ = 0;
+    bool linked_ = false;
+};
+
+/**
+ * Reads the limits and starts the wheel thread
+ */
+void start();
+
+} // namespace timeouts
+
+#endif // TIMEOUTS_HPP
@@ -0,0 +1,188 @@
+/**
+ * Reads the proxy's binary access log (PROXY_ACCESS_LOG).
+ *
+ *   access_decode [file]      one tab-separated line per request, phase
+ *                             times in microseconds after accept
+ *   access_decode -s [file]   percentiles of each phase's duration
+ *
+ * Build with `make access_decode`. The file defaults to ./logs/access.bin.
+ */
+#include "../access_log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace access_log;
+
+namespace {
+
+const char* const PHASE_NAMES[PHASE_COUNT] = {"parse", "dns", "connect", "origin_ttfb", "first_out", "finish"};
+
+struct Entry {
+    Record record;
+    std::string host;
+};
+
+// Reads all records, resynchronizing on the magic after damaged bytes
+bool read_log(const char* path, std::vector<Entry>& entries) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    std::vector<char> data;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    // Each record starts with magic, version and size; the version gives its layout
+    const size_t prefix = offsetof(Record, id);
+    size_t pos = 0, skipped = 0, unknown = 0;
+    while (pos + prefix <= data.size()) {
+        Record record;
+        memcpy(&record, data.data() + pos, prefix);
+        size_t fixed = fixed_size(record.version);
+        if (record.magic != MAGIC || record.size < std::max(fixed, prefix) || pos + record.size > data.size()) {
+            ++pos;
+            ++skipped;
+            continue;
+        }
+        if (fixed == 0) {
+            ++unknown;  // A newer writer; its size still says where the next record starts
+        } else {
+            upgrade(data.data() + pos, record.version, record);
+            size_t host_length = std::min<size_t>(record.host_length, record.size - fixed);
+            entries.push_back({record, std::string(data.data() + pos + fixed, host_length)});
+        }
+        pos += record.size;
+    }
+    if (skipped > 0 || pos != data.size()) {
+        fprintf(stderr, "warning: skipped %zu damaged and %zu trailing bytes\n", skipped, data.size() - pos);
+    }
+    if (unknown > 0) {
+        fprintf(stderr, "warning: skipped %zu records of a version newer than %u\n", unknown,
+                static_cast<unsigned>(VERSION));
+    }
+    return true;
+}
+
+std::string format_id(const uint8_t* id) {
+    char out[37];
+    char* p = out;
+    for (int i = 0; i < 16; ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) *p++ = '-';
+        p += snprintf(p, 3, "%02x", id[i]);
+    }
+    return std::string(out, 36);
+}
+
+std::string format_time(uint64_t ns) {
+    time_t seconds = static_cast<time_t>(ns / 1000000000);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char out[40];
+    size_t len = strftime(out, sizeof(out), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(out + len, sizeof(out) - len, ".%03uZ", static_cast<unsigned>(ns / 1000000 % 1000));
+    return out;
+}
+
+void print_records(const std::vector<Entry>& entries) {
+    printf("time\tid\tmethod\thost\tstatus\tcache\tbytes_in\tbytes_out\tobject");
+    for (const char* name : PHASE_NAMES) printf("\t%s_us", name);
+    printf("\n");
+    for (const Entry& entry : entries) {
+        const Record& r = entry.record;
+        printf("%s\t%s\t%s\t%s\t%u\t%s\t%llu\t%llu", format_time(r.accept_ns).c_str(), format_id(r.id).c_str(),
+               method_name(r.method), entry.host.c_str(), r.status, cache_name(r.cache),
+               static_cast<unsigned long long>(r.bytes_in), static_cast<unsigned long long>(r.bytes_out));
+        if (r.object == 0) {
+            printf("\t-");
+        } else {
+            printf("\t%016llx", static_cast<unsigned long long>(r.object));
+        }
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            if (r.phase_ns[i] == 0) {
+                printf("\t-");
+            } else {
+                printf("\t%.3f", r.phase_ns[i] / 1000.0);
+            }
+        }
+        printf("\n");
+    }
+}
+
+double percentile(std::vector<uint64_t>& values, double p) {
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1e6;
+}
+
+/**
+ * A phase's duration runs from the latest earlier phase the request reached
+ * (or accept), so a cache hit's first_out covers lookup and header build
+ */
+void print_summary(const std::vector<Entry>& entries) {
+    std::vector<uint64_t> durations[PHASE_COUNT + 1];
+    size_t by_cache[5] = {};
+    for (const Entry& entry : entries) {
+        const Record& r = entry.record;
+        uint64_t previous = 0;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            if (r.phase_ns[i] != 0 && r.phase_ns[i] >= previous) {
+                durations[i].push_back(r.phase_ns[i] - previous);
+                previous = r.phase_ns[i];
+            }
+        }
+        durations[PHASE_COUNT].push_back(r.phase_ns[FINISHED]);
+        if (static_cast<size_t>(r.cache) < 5) ++by_cache[static_cast<size_t>(r.cache)];
+    }
+
+    printf("%zu requests:", entries.size());
+    for (int c = 0; c < 5; ++c) {
+        printf(" %s=%zu", cache_name(static_cast<CacheResult>(c)), by_cache[c]);
+    }
+    printf("\n\n%-12s %8s %10s %10s %10s %10s\n", "phase (ms)", "count", "p50", "p90", "p99", "max");
+    for (int i = 0; i <= PHASE_COUNT; ++i) {
+        std::vector<uint64_t>& values = durations[i];
+        const char* name = i < PHASE_COUNT ? PHASE_NAMES[i] : "total";
+        if (values.empty()) {
+            printf("%-12s %8d\n", name, 0);
+            continue;
+        }
+        printf("%-12s %8zu %10.3f %10.3f %10.3f %10.3f\n", name, values.size(), percentile(values, 0.5),
+               percentile(values, 0.9), percentile(values, 0.99), *std::max_element(values.begin(), values.end()) / 1e6);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool summary = false;
+    const char* path = "./logs/access.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            summary = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-s] [access.bin]\n", argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    std::vector<Entry> entries;
+    if (!read_log(path, entries)) {
+        return 1;
+    }
+    if (summary) {
+        print_summary(entries);
+    } else {
+        print_records(entries);
+    }
+    return 0;
+}
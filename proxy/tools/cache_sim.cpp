@@ -0,0 +1,614 @@
+/**
+ * Replays an access trace against cache eviction policies at several
+ * capacities, to pick a cache size and policy from real traffic.
+ *
+ *   cache_sim [-p policies] [-c capacities] [-e max_entries] [-t threads] [trace]
+ *
+ *   -p   comma-separated: lru, fifo, clock, gdsf, tinylfu (all)
+ *   -c   comma-separated byte budgets with optional K/M/G suffix
+ *        (16M,64M,256M,1G,4G)
+ *   -e   entry limit on top of the byte budget, like PROXY_CACHE_MAX_ENTRIES (none)
+ *   -t   worker threads; configurations are spread across them (all CPUs)
+ *
+ * The trace is the proxy's binary access log (PROXY_ACCESS_LOG), in which
+ * every GET answered 200 counts as one request for its cache key, sized by
+ * the bytes sent to the client. Any other file is read as text, one
+ * "key size" pair per line, so traces from elsewhere can be replayed too.
+ * "-" reads standard input; the default is ./logs/access.bin.
+ *
+ * The trace is streamed in blocks that every configuration replays in
+ * turn, so memory stays flat however long the trace is. Output is one
+ * tab-separated row per policy and capacity, with the hit ratio and byte
+ * hit ratio; rows of one policy form its curve.
+ *
+ * "lru" behaves like Cache: a hit moves the entry to the front, a store
+ * evicts from the back until both limits hold, and objects larger than
+ * the budget are not stored. Build with `make cache_sim`.
+ */
+#include "../access_log.hpp"
+#include "../utils/hash.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Access {
+    uint64_t key;
+    uint32_t size;
+};
+
+/**
+ * One cache model; access() reports a hit and updates the model
+ */
+class Policy {
+public:
+    Policy(uint64_t capacity, uint64_t max_entries) : capacity_(capacity), max_entries_(max_entries) {}
+    virtual ~Policy() = default;
+
+    virtual bool access(uint64_t key, uint32_t size) = 0;
+
+protected:
+    // Room for size more bytes and one more entry
+    bool fits(uint64_t used, uint64_t count, uint32_t size) const {
+        return used + size <= capacity_ && (max_entries_ == 0 || count < max_entries_);
+    }
+
+    uint64_t capacity_;
+    uint64_t max_entries_;
+};
+
+/**
+ * LRU, or FIFO when hits leave the order alone
+ */
+class ListPolicy : public Policy {
+public:
+    ListPolicy(uint64_t capacity, uint64_t max_entries, bool reorder)
+        : Policy(capacity, max_entries), reorder_(reorder) {}
+
+    bool access(uint64_t key, uint32_t size) override {
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            if (it->second->size == size) {
+                if (reorder_) order_.splice(order_.begin(), order_, it->second);
+                return true;
+            }
+            remove(it);  // Changed since stored: refetched
+        }
+        if (size > capacity_) return false;
+        while (!order_.empty() && !fits(used_, order_.size(), size)) {
+            remove(index_.find(order_.back().key));
+        }
+        order_.push_front({key, size});
+        index_[key] = order_.begin();
+        used_ += size;
+        return false;
+    }
+
+private:
+    using Iterator = std::list<Access>::iterator;
+
+    void remove(std::unordered_map<uint64_t, Iterator>::iterator it) {
+        used_ -= it->second->size;
+        order_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bool reorder_;
+    uint64_t used_ = 0;
+    std::list<Access> order_;  // Front is most recent
+    std::unordered_map<uint64_t, Iterator> index_;
+};
+
+/**
+ * CLOCK (second chance): a hit sets the entry's bit; the hand gives set
+ * entries another lap and evicts the first clear one
+ */
+class ClockPolicy : public Policy {
+public:
+    using Policy::Policy;
+
+    bool access(uint64_t key, uint32_t size) override {
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second.size == size) {
+                it->second.referenced = true;
+                return true;
+            }
+            used_ -= it->second.size;
+            entries_.erase(it);  // Its ring slot goes stale and is skipped
+        }
+        if (size > capacity_) return false;
+        while (!entries_.empty() && !fits(used_, entries_.size(), size)) {
+            Slot slot = ring_.front();
+            ring_.pop_front();
+            auto victim = entries_.find(slot.key);
+            if (victim == entries_.end() || victim->second.generation != slot.generation) {
+                continue;
+            }
+            if (victim->second.referenced) {
+                victim->second.referenced = false;
+                ring_.push_back(slot);
+            } else {
+                used_ -= victim->second.size;
+                entries_.erase(victim);
+            }
+        }
+        entries_[key] = {size, false, ++generation_};
+        ring_.push_back({key, generation_});
+        used_ += size;
+        return false;
+    }
+
+private:
+    struct Entry {
+        uint32_t size;
+        bool referenced;
+        uint64_t generation;
+    };
+    struct Slot {
+        uint64_t key;
+        uint64_t generation;
+    };
+
+    uint64_t used_ = 0;
+    uint64_t generation_ = 0;
+    std::deque<Slot> ring_;  // The hand is at the front
+    std::unordered_map<uint64_t, Entry> entries_;
+};
+
+/**
+ * GreedyDual-Size-Frequency: evicts the lowest L + frequency / size, where
+ * L rises to each evicted priority so old entries age out
+ */
+class GdsfPolicy : public Policy {
+public:
+    using Policy::Policy;
+
+    bool access(uint64_t key, uint32_t size) override {
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            Entry& entry = it->second;
+            queue_.erase({entry.priority, key});
+            if (entry.size == size) {
+                ++entry.frequency;
+                entry.priority = inflation_ + static_cast<double>(entry.frequency) / std::max<uint32_t>(size, 1);
+                queue_.insert({entry.priority, key});
+                return true;
+            }
+            used_ -= entry.size;
+            entries_.erase(it);
+        }
+        if (size > capacity_) return false;
+        while (!entries_.empty() && !fits(used_, entries_.size(), size)) {
+            auto victim = queue_.begin();
+            inflation_ = victim->first;
+            auto entry = entries_.find(victim->second);
+            used_ -= entry->second.size;
+            entries_.erase(entry);
+            queue_.erase(victim);
+        }
+        double priority = inflation_ + 1.0 / std::max<uint32_t>(size, 1);
+        entries_[key] = {size, 1, priority};
+        queue_.insert({priority, key});
+        used_ += size;
+        return false;
+    }
+
+private:
+    struct Entry {
+        uint32_t size;
+        uint64_t frequency;
+        double priority;
+    };
+
+    uint64_t used_ = 0;
+    double inflation_ = 0;
+    std::set<std::pair<double, uint64_t>> queue_;
+    std::unordered_map<uint64_t, Entry> entries_;
+};
+
+/**
+ * W-TinyLFU: new entries land in a small LRU window; an entry leaving the
+ * window is admitted to the main segmented LRU only if a count-min sketch
+ * has seen it more often than the entries it would displace
+ */
+class TinyLfuPolicy : public Policy {
+public:
+    TinyLfuPolicy(uint64_t capacity, uint64_t max_entries)
+        : Policy(capacity, max_entries),
+          window_capacity_(std::max<uint64_t>(capacity / 100, 1)),
+          main_capacity_(capacity - window_capacity_),
+          protected_capacity_(main_capacity_ * 4 / 5) {
+        // About one counter per 4 KB of budget, the order of objects cached
+        size_t width = 1024;
+        while (width < (1u << 24) && width * 4096 < capacity) width <<= 1;
+        for (auto& row : sketch_) row.assign(width, 0);
+        reset_after_ = width * 10;
+    }
+
+    bool access(uint64_t key, uint32_t size) override {
+        record(key);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            Entry& entry = it->second;
+            if (entry.at->size == size) {
+                hit(entry);
+                return true;
+            }
+            remove(it);
+        }
+        if (size > capacity_) return false;
+        push(Window, {key, size});
+        // Window victims go first, whether the window is over its bytes or
+        // the whole cache over its entry limit
+        while (!lists_[Window].empty() &&
+               (used_[Window] > window_capacity_ || (max_entries_ != 0 && index_.size() > max_entries_))) {
+            Access candidate = lists_[Window].back();
+            remove(index_.find(candidate.key));
+            admit(candidate);
+        }
+        return false;
+    }
+
+private:
+    enum Segment { Window, Probation, Protected, SEGMENTS };
+    struct Entry {
+        Segment segment;
+        std::list<Access>::iterator at;
+    };
+
+    void hit(Entry& entry) {
+        if (entry.segment == Window || entry.segment == Protected) {
+            lists_[entry.segment].splice(lists_[entry.segment].begin(), lists_[entry.segment], entry.at);
+            return;
+        }
+        // Probation to protected; protected overflow drops back to probation
+        move(entry, Protected);
+        while (used_[Protected] > protected_capacity_ && lists_[Protected].size() > 1) {
+            move(index_[lists_[Protected].back().key], Probation);
+        }
+    }
+
+    // Window victim against main's victims, one by one, until it fits or loses
+    void admit(const Access& candidate) {
+        if (candidate.size > main_capacity_) return;
+        uint32_t frequency = estimate(candidate.key);
+        while (used_[Probation] + used_[Protected] + candidate.size > main_capacity_ ||
+               (max_entries_ != 0 && index_.size() >= max_entries_)) {
+            Segment from = !lists_[Probation].empty() ? Probation : Protected;
+            if (lists_[from].empty()) return;  // Only the window is left to hold entries
+            const Access& victim = lists_[from].back();
+            if (frequency <= estimate(victim.key)) return;
+            remove(index_.find(victim.key));
+        }
+        push(Probation, candidate);
+    }
+
+    void push(Segment segment, const Access& access) {
+        lists_[segment].push_front(access);
+        index_[access.key] = {segment, lists_[segment].begin()};
+        used_[segment] += access.size;
+    }
+
+    void move(Entry& entry, Segment to) {
+        used_[entry.segment] -= entry.at->size;
+        used_[to] += entry.at->size;
+        lists_[to].splice(lists_[to].begin(), lists_[entry.segment], entry.at);
+        entry.segment = to;
+    }
+
+    void remove(std::unordered_map<uint64_t, Entry>::iterator it) {
+        used_[it->second.segment] -= it->second.at->size;
+        lists_[it->second.segment].erase(it->second.at);
+        index_.erase(it);
+    }
+
+    // 4-bit count-min sketch, halved every reset_after_ increments so counts decay
+    void record(uint64_t key) {
+        for (size_t row = 0; row < ROWS; ++row) {
+            uint8_t& counter = sketch_[row][slot(key, row)];
+            if (counter < 15) ++counter;
+        }
+        if (++additions_ >= reset_after_) {
+            for (auto& row : sketch_) {
+                for (uint8_t& counter : row) counter >>= 1;
+            }
+            additions_ /= 2;
+        }
+    }
+
+    uint32_t estimate(uint64_t key) const {
+        uint32_t least = 15;
+        for (size_t row = 0; row < ROWS; ++row) {
+            least = std::min<uint32_t>(least, sketch_[row][slot(key, row)]);
+        }
+        return least;
+    }
+
+    size_t slot(uint64_t key, size_t row) const {
+        uint64_t h = (key + row) * 0x9e3779b97f4a7c15ULL;
+        return static_cast<size_t>(h >> 32) & (sketch_[row].size() - 1);
+    }
+
+    static const size_t ROWS = 4;
+
+    uint64_t window_capacity_;
+    uint64_t main_capacity_;
+    uint64_t protected_capacity_;
+    uint64_t used_[SEGMENTS] = {};
+    std::list<Access> lists_[SEGMENTS];  // Front is most recent
+    std::unordered_map<uint64_t, Entry> index_;
+    std::vector<uint8_t> sketch_[ROWS];
+    uint64_t additions_ = 0;
+    uint64_t reset_after_ = 0;
+};
+
+std::unique_ptr<Policy> make_policy(const std::string& name, uint64_t capacity, uint64_t max_entries) {
+    if (name == "lru") return std::make_unique<ListPolicy>(capacity, max_entries, true);
+    if (name == "fifo") return std::make_unique<ListPolicy>(capacity, max_entries, false);
+    if (name == "clock") return std::make_unique<ClockPolicy>(capacity, max_entries);
+    if (name == "gdsf") return std::make_unique<GdsfPolicy>(capacity, max_entries);
+    if (name == "tinylfu") return std::make_unique<TinyLfuPolicy>(capacity, max_entries);
+    return nullptr;
+}
+
+struct Run {
+    std::string policy;
+    uint64_t capacity;
+    std::unique_ptr<Policy> model;
+    uint64_t requests = 0;
+    uint64_t hits = 0;
+    uint64_t bytes = 0;
+    uint64_t hit_bytes = 0;
+};
+
+/**
+ * Streams accesses from either trace format
+ */
+class TraceReader {
+public:
+    explicit TraceReader(FILE* file) : file_(file) {
+        fill();
+        uint32_t magic = 0;
+        if (end_ - pos_ >= sizeof(magic)) memcpy(&magic, buf_.data() + pos_, sizeof(magic));
+        binary_ = magic == access_log::MAGIC;
+    }
+
+    bool binary() const { return binary_; }
+
+    // Appends up to max accesses; false at the end of the trace
+    bool read(std::vector<Access>& out, size_t max) {
+        while (out.size() < max) {
+            if (end_ - pos_ < (binary_ ? sizeof(access_log::Record) : 4096) && !eof_) {
+                fill();
+            }
+            if (pos_ >= end_) return !out.empty();
+            if (binary_ ? !next_record(out) : !next_line(out)) return !out.empty();
+        }
+        return true;
+    }
+
+    uint64_t skipped() const { return skipped_; }
+
+private:
+    void fill() {
+        memmove(buf_.data(), buf_.data() + pos_, end_ - pos_);
+        end_ -= pos_;
+        pos_ = 0;
+        size_t n = fread(buf_.data() + end_, 1, buf_.size() - end_, file_);
+        end_ += n;
+        if (n == 0) eof_ = true;
+    }
+
+    // Resynchronizes on the magic after damaged bytes, like access_decode
+    bool next_record(std::vector<Access>& out) {
+        using access_log::Record;
+        const size_t prefix = offsetof(Record, id);
+        if (end_ - pos_ < prefix) {
+            skipped_ += end_ - pos_;
+            pos_ = end_;
+            return false;
+        }
+        Record record;
+        memcpy(&record, buf_.data() + pos_, prefix);
+        size_t fixed = access_log::fixed_size(record.version);
+        if (record.magic != access_log::MAGIC || record.size < std::max(fixed, prefix)) {
+            ++pos_;
+            ++skipped_;
+            return true;
+        }
+        if (end_ - pos_ < record.size && !eof_) {
+            fill();
+            return true;
+        }
+        if (fixed != 0 && end_ - pos_ >= fixed) {
+            access_log::upgrade(buf_.data() + pos_, record.version, record);
+        } else {
+            fixed = 0;
+        }
+        pos_ += std::min<size_t>(record.size, end_ - pos_);
+        // Version 1 records carry no object key, so only later ones drive the simulation
+        if (fixed != 0 && record.method == access_log::Method::Get &&
+            record.status == 200 && record.object != 0) {
+            out.push_back({record.object, static_cast<uint32_t>(std::min<uint64_t>(record.bytes_out, UINT32_MAX))});
+        }
+        return true;
+    }
+
+    bool next_line(std::vector<Access>& out) {
+        const char* start = buf_.data() + pos_;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', end_ - pos_));
+        size_t len = newline ? static_cast<size_t>(newline - start) : end_ - pos_;
+        if (!newline && !eof_ && pos_ != 0) {
+            fill();
+            return true;
+        }
+        pos_ += len + (newline ? 1 : 0);
+        const char* space = static_cast<const char*>(memchr(start, ' ', len));
+        if (!space) {
+            if (len > 0) ++skipped_;
+            return true;
+        }
+        Access access;
+        access.key = utils::hash128(start, static_cast<size_t>(space - start)).lo;
+        access.size = static_cast<uint32_t>(std::strtoul(space + 1, nullptr, 10));
+        out.push_back(access);
+        return true;
+    }
+
+    FILE* file_;
+    std::vector<char> buf_ = std::vector<char>(1 << 20);
+    size_t pos_ = 0;
+    size_t end_ = 0;
+    bool eof_ = false;
+    bool binary_ = false;
+    uint64_t skipped_ = 0;
+};
+
+bool parse_size(const std::string& text, uint64_t& out) {
+    char* end;
+    double value = std::strtod(text.c_str(), &end);
+    switch (*end) {
+        case 'k': case 'K': value *= 1024; ++end; break;
+        case 'm': case 'M': value *= 1024 * 1024; ++end; break;
+        case 'g': case 'G': value *= 1024.0 * 1024 * 1024; ++end; break;
+        default: break;
+    }
+    out = static_cast<uint64_t>(value);
+    return *end == '\0' && value > 0;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+std::string format_size(uint64_t bytes) {
+    const char* units[] = {"", "K", "M", "G", "T"};
+    int unit = 0;
+    while (unit < 4 && bytes >= 1024 && bytes % 1024 == 0) {
+        bytes /= 1024;
+        ++unit;
+    }
+    return std::to_string(bytes) + units[unit];
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-p policies] [-c capacities] [-e max_entries] [-t threads] [trace|-]\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string policies = "lru,fifo,clock,gdsf,tinylfu";
+    std::string capacities = "16M,64M,256M,1G,4G";
+    uint64_t max_entries = 0;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    const char* path = "./logs/access.bin";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-p" || arg == "-c" || arg == "-e" || arg == "-t") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "-p") policies = value;
+            if (arg == "-c") capacities = value;
+            if (arg == "-e") max_entries = std::strtoull(value.c_str(), nullptr, 10);
+            if (arg == "-t") threads = std::max(1L, std::atol(value.c_str()));
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    std::vector<Run> runs;
+    for (const std::string& policy : split(policies)) {
+        for (const std::string& text : split(capacities)) {
+            uint64_t capacity;
+            if (!parse_size(text, capacity)) {
+                fprintf(stderr, "bad capacity: %s\n", text.c_str());
+                return 2;
+            }
+            Run run;
+            run.policy = policy;
+            run.capacity = capacity;
+            run.model = make_policy(policy, capacity, max_entries);
+            if (!run.model) {
+                fprintf(stderr, "unknown policy: %s\n", policy.c_str());
+                return 2;
+            }
+            runs.push_back(std::move(run));
+        }
+    }
+
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    TraceReader reader(file);
+    threads = std::min(threads, runs.size());
+
+    // Each block is replayed by every run; runs are split across the threads
+    const size_t BLOCK = 1 << 20;
+    std::vector<Access> block;
+    block.reserve(BLOCK);
+    uint64_t total = 0;
+    bool progress = isatty(STDERR_FILENO);
+    while (reader.read(block, BLOCK)) {
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < threads; ++w) {
+            workers.emplace_back([&, w] {
+                for (size_t r = w; r < runs.size(); r += threads) {
+                    Run& run = runs[r];
+                    for (const Access& access : block) {
+                        bool hit = run.model->access(access.key, access.size);
+                        ++run.requests;
+                        run.bytes += access.size;
+                        if (hit) {
+                            ++run.hits;
+                            run.hit_bytes += access.size;
+                        }
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        total += block.size();
+        block.clear();
+        if (progress) fprintf(stderr, "\r%llu requests", static_cast<unsigned long long>(total));
+    }
+    if (file != stdin) fclose(file);
+    fprintf(stderr, "%s%llu requests from a %s trace", progress ? "\r" : "", static_cast<unsigned long long>(total),
+            reader.binary() ? "binary access log" : "text");
+    if (reader.skipped() > 0) {
+        fprintf(stderr, ", %llu bytes or lines skipped", static_cast<unsigned long long>(reader.skipped()));
+    }
+    fprintf(stderr, "\n");
+
+    printf("policy\tcapacity\trequests\thit_ratio\tbyte_hit_ratio\n");
+    for (const Run& run : runs) {
+        printf("%s\t%s\t%llu\t%.4f\t%.4f\n", run.policy.c_str(), format_size(run.capacity).c_str(),
+               static_cast<unsigned long long>(run.requests), run.requests ? double(run.hits) / run.requests : 0.0,
+               run.bytes ? double(run.hit_bytes) / run.bytes : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "upstream.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+
+namespace {
+
+const size_t PRUNE_ABOVE = 4096;  // Origins remembered before idle ones are dropped
+const int64_t MAX_COST_QUANTA = 16;
+
+int64_t to_ns(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+double seconds_until(std::chrono::steady_clock::time_point when) {
+    return std::max(0.0, std::chrono::duration<double>(when - std::chrono::steady_clock::now()).count());
+}
+
+} // namespace
+
+UpstreamScheduler::UpstreamScheduler(const Options& options) : options_(options) {}
+
+bool UpstreamScheduler::hasRoom(const Origin& origin) const {
+    return (options_.max_total == 0 || in_flight_ < options_.max_total) &&
+           (options_.max_per_origin == 0 || origin.in_flight < options_.max_per_origin);
+}
+
+void UpstreamScheduler::grant(Origin& origin) {
+    ++origin.in_flight;
+    ++in_flight_;
+}
+
+UpstreamScheduler::Result UpstreamScheduler::acquire(const std::string& name, Slot& slot, double& retry_after) {
+    slot.release();
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    Origin& origin = origins_[name];
+    origin.last_used = now;
+
+    bool probe = false;
+    if (origin.state == State::Open) {
+        if (now < origin.open_until) {
+            retry_after = seconds_until(origin.open_until);
+            metrics::upstream_circuit_rejected.inc();
+            return Result::CircuitOpen;
+        }
+        origin.state = State::HalfOpen;
+    }
+    if (origin.state == State::HalfOpen) {
+        if (origin.probing) {
+            retry_after = 1;
+            metrics::upstream_circuit_rejected.inc();
+            return Result::CircuitOpen;
+        }
+        origin.probing = probe = true;
+    }
+
+    if (origin.waiting.empty() && hasRoom(origin)) {
+        grant(origin);
+    } else {
+        Waiter waiter;
+        origin.waiting.push_back(&waiter);
+        ++queued_;
+        if (!origin.scheduled) {
+            origin.scheduled = true;
+            ring_.push_back(name);
+        }
+        if (!waiter.cv.wait_until(lock, now + options_.queue_timeout, [&] { return waiter.granted; })) {
+            forget(name, origin, &waiter);
+            if (probe) {
+                origin.probing = false;
+            }
+            retry_after = 1;
+            metrics::upstream_queue_timeouts.inc();
+            return Result::TimedOut;
+        }
+        metrics::upstream_queue_wait.record(Clock::now() - now);
+    }
+
+    slot.scheduler_ = this;
+    slot.origin_ = name;
+    slot.started_ = Clock::now();
+    slot.probe_ = probe;
+    slot.finished_ = false;
+    prune(now);
+    return Result::Admitted;
+}
+
+void UpstreamScheduler::forget(const std::string& name, Origin& origin, Waiter* waiter) {
+    origin.waiting.erase(std::find(origin.waiting.begin(), origin.waiting.end(), waiter));
+    --queued_;
+    if (origin.waiting.empty() && origin.scheduled) {
+        origin.scheduled = false;
+        origin.deficit_ns = 0;
+        ring_.erase(std::find(ring_.begin(), ring_.end(), name));
+    }
+}
+
+void UpstreamScheduler::dispatch() {
+    const int64_t quantum = std::max<int64_t>(1, to_ns(options_.quantum));
+    // Stop after a full turn of the ring in which no origin had room; a
+    // top-up counts as progress, since it leads to a grant
+    size_t blocked = 0;
+    while (!ring_.empty() && blocked < ring_.size() && (options_.max_total == 0 || in_flight_ < options_.max_total)) {
+        Origin& origin = origins_[ring_.front()];
+        if (origin.waiting.empty()) {
+            origin.scheduled = false;
+            origin.deficit_ns = 0;
+            ring_.pop_front();
+            continue;
+        }
+        if (!hasRoom(origin)) {
+            ++blocked;
+            ring_.push_back(ring_.front());
+            ring_.pop_front();
+            continue;
+        }
+        int64_t cost = std::clamp<int64_t>(origin.cost_ns, 1, MAX_COST_QUANTA * quantum);
+        if (origin.deficit_ns < cost) {
+            // This origin's turn is used up; top it up for the next round
+            blocked = 0;
+            origin.deficit_ns += quantum;
+            ring_.push_back(ring_.front());
+            ring_.pop_front();
+            continue;
+        }
+        origin.deficit_ns -= cost;
+        Waiter* waiter = origin.waiting.front();
+        origin.waiting.pop_front();
+        --queued_;
+        grant(origin);
+        waiter->granted = true;
+        waiter->cv.notify_one();
+    }
+}
+
+void UpstreamScheduler::release(Slot& slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    Origin& origin = origins_[slot.origin_];
+    --origin.in_flight;
+    --in_flight_;
+    // Service time, averaged over roughly the last eight requests
+    int64_t service = to_ns(now - slot.started_);
+    origin.cost_ns = origin.cost_ns == 0 ? service : origin.cost_ns + (service - origin.cost_ns) / 8;
+    if (slot.probe_ && !slot.finished_) {
+        origin.probing = false;  // The probe ended without an answer; let another try
+    }
+    dispatch();
+}
+
+void UpstreamScheduler::record(const std::string& name, Origin& origin, bool failed, bool probe, Clock::time_point now) {
+    if (options_.failure_ratio <= 0) {
+        return;
+    }
+    if (now - origin.window_start >= options_.window) {
+        bool adjacent = now - origin.window_start < 2 * options_.window;
+        origin.answered[0] = adjacent ? origin.answered[1] : 0;
+        origin.failed[0] = adjacent ? origin.failed[1] : 0;
+        origin.answered[1] = origin.failed[1] = 0;
+        origin.window_start = now;
+    }
+    ++origin.answered[1];
+    origin.failed[1] += failed;
+
+    if (probe) {
+        origin.probing = false;
+        if (failed) {
+            origin.state = State::Open;
+            origin.open_until = now + options_.open_for;
+            LOG_WARNING("(upstream)", name + " still failing, circuit stays open");
+        } else {
+            origin.state = State::Closed;
+            origin.answered[0] = origin.failed[0] = origin.answered[1] = origin.failed[1] = 0;
+            LOG_NOTE("(upstream)", name + " recovered, circuit closed");
+        }
+        return;
+    }
+    size_t answered = origin.answered[0] + origin.answered[1];
+    size_t failures = origin.failed[0] + origin.failed[1];
+    if (origin.state == State::Closed && answered >= options_.min_requests &&
+        failures >= options_.failure_ratio * answered) {
+        origin.state = State::Open;
+        origin.open_until = now + options_.open_for;
+        metrics::upstream_circuit_opens.inc();
+        LOG_WARNING("(upstream)", name + " failed " + std::to_string(failures) + " of " + std::to_string(answered) +
+                    " recent requests, circuit opened");
+    }
+}
+
+void UpstreamScheduler::prune(Clock::time_point now) {
+    if (origins_.size() <= PRUNE_ABOVE) {
+        return;
+    }
+    for (auto it = origins_.begin(); it != origins_.end();) {
+        const Origin& origin = it->second;
+        bool idle = origin.in_flight == 0 && !origin.scheduled && origin.state == State::Closed &&
+                    now - origin.last_used > 2 * options_.window;
+        it = idle ? origins_.erase(it) : std::next(it);
+    }
+}
+
+size_t UpstreamScheduler::inFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+size_t UpstreamScheduler::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+size_t UpstreamScheduler::openCircuits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::count_if(origins_.begin(), origins_.end(),
+                         [](const auto& entry) { return entry.second.state != State::Closed; });
+}
+
+void UpstreamScheduler::Slot::finish(bool ok, Clock::duration latency) {
+    if (scheduler_ == nullptr || finished_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(scheduler_->mutex_);
+    bool failed = !ok || latency > scheduler_->options_.slow_after;
+    scheduler_->record(origin_, scheduler_->origins_[origin_], failed, probe_, Clock::now());
+    finished_ = true;
+}
+
+void UpstreamScheduler::Slot::release() {
+    if (scheduler_ == nullptr) {
+        return;
+    }
+    scheduler_->release(*this);
+    scheduler_ = nullptr;
+}
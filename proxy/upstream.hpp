@@ -0,0 +1,134 @@
+#ifndef UPSTREAM_HPP
+#define UPSTREAM_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Scheduling of requests to origin servers
+ *
+ * A request holds an upstream slot from connecting until its response has
+ * been relayed. Slots are bounded overall (max_total) and per origin
+ * (max_per_origin), so one slow origin can tie up at most its own share of
+ * handler threads. A request that finds no slot waits up to queue_timeout.
+ *
+ * Freed slots go to waiting origins by deficit round robin. An origin's cost
+ * per request is its recent service time, so each origin with waiters gets
+ * about the same share of upstream time, and a slow one cannot crowd out
+ * fast ones just by having more requests queued.
+ *
+ * Each origin also has a circuit breaker. Once at least min_requests
+ * requests in the last two windows were answered, if failure_ratio of them
+ * failed (no connection, no response, 5xx, or slower than slow_after), the
+ * circuit opens. Requests then fail fast for open_for. After that a single
+ * probe is let through, and its outcome closes the circuit or opens it again.
+ */
+class UpstreamScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t max_total = 128;      // 0 is unlimited
+        size_t max_per_origin = 32;  // 0 is unlimited
+        Clock::duration queue_timeout = std::chrono::seconds(2);
+        Clock::duration quantum = std::chrono::milliseconds(50);
+        Clock::duration window = std::chrono::seconds(10);
+        size_t min_requests = 20;
+        double failure_ratio = 0.5;  // 0 disables the breaker
+        Clock::duration slow_after = std::chrono::seconds(5);
+        Clock::duration open_for = std::chrono::seconds(5);
+    };
+
+    enum class Result { Admitted, TimedOut, CircuitOpen };
+
+    /**
+     * An upstream slot, freed when it goes out of scope
+     */
+    class Slot {
+    public:
+        Slot() = default;
+        ~Slot() { release(); }
+
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+        /**
+         * Reports the origin's answer for the circuit breaker
+         *
+         * @param ok False for no connection, no response or a 5xx
+         * @param latency From connecting until the response headers arrived
+         */
+        void finish(bool ok, Clock::duration latency = Clock::duration::zero());
+        void release();
+
+    private:
+        friend class UpstreamScheduler;
+
+        UpstreamScheduler* scheduler_ = nullptr;
+        std::string origin_;
+        Clock::time_point started_;
+        bool probe_ = false;
+        bool finished_ = false;
+    };
+
+    explicit UpstreamScheduler(const Options& options);
+
+    /**
+     * Waits for a slot for origin ("host:port")
+     *
+     * @param retry_after Seconds until the origin may be tried again, when not admitted
+     */
+    Result acquire(const std::string& origin, Slot& slot, double& retry_after);
+
+    size_t inFlight() const;
+    size_t queued() const;
+    size_t openCircuits() const;
+
+private:
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Waiter {
+        std::condition_variable cv;
+        bool granted = false;
+    };
+
+    struct Origin {
+        size_t in_flight = 0;
+        std::deque<Waiter*> waiting;
+        bool scheduled = false;     // In the round-robin ring
+        int64_t deficit_ns = 0;
+        int64_t cost_ns = 0;        // Moving average of service time
+        State state = State::Closed;
+        bool probing = false;
+        Clock::time_point open_until;
+        Clock::time_point window_start;
+        size_t answered[2] = {0, 0};  // Previous and current window
+        size_t failed[2] = {0, 0};
+        Clock::time_point last_used;
+    };
+
+    bool hasRoom(const Origin& origin) const;
+    void grant(Origin& origin);
+    /**
+     * Hands free slots to waiters in deficit round robin order; caller holds the lock
+     */
+    void dispatch();
+    void release(Slot& slot);
+    void record(const std::string& name, Origin& origin, bool failed, bool probe, Clock::time_point now);
+    void forget(const std::string& name, Origin& origin, Waiter* waiter);
+    void prune(Clock::time_point now);
+
+    Options options_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Origin> origins_;
+    std::deque<std::string> ring_;  // Origins with waiters
+    size_t in_flight_ = 0;
+    size_t queued_ = 0;
+};
+
+#endif // UPSTREAM_HPP
@@ -0,0 +1,148 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace utils {
+
+/**
+ * Hash128 - Fixed-size 128-bit digest, cheap to compare and to use as a map key
+ */
+struct Hash128 {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool operator==(const Hash128& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+    bool empty() const { return lo == 0 && hi == 0; }
+
+    std::string toHex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            out[15 - i] = digits[(hi >> (i * 4)) & 0xf];
+            out[31 - i] = digits[(lo >> (i * 4)) & 0xf];
+        }
+        return out;
+    }
+};
+
+/**
+ * Hasher128 - Streaming MurmurHash3 (x64, 128-bit)
+ *
+ * Input may arrive in arbitrary pieces (e.g. one recv() at a time); the digest
+ * equals that of hashing the concatenation in one call.
+ */
+class Hasher128 {
+private:
+    static constexpr uint64_t C1 = 0x87c37b91114253d5ULL;
+    static constexpr uint64_t C2 = 0x4cf5ad432745937fULL;
+
+    uint64_t h1_;
+    uint64_t h2_;
+    uint8_t tail_[16];
+    size_t tail_len_ = 0;
+    uint64_t total_ = 0;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t fmix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void block(const uint8_t* p) {
+        uint64_t k1, k2;
+        std::memcpy(&k1, p, 8);
+        std::memcpy(&k2, p + 8, 8);
+
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1_ ^= k1;
+        h1_ = rotl(h1_, 27); h1_ += h2_; h1_ = h1_ * 5 + 0x52dce729;
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2_ ^= k2;
+        h2_ = rotl(h2_, 31); h2_ += h1_; h2_ = h2_ * 5 + 0x38495ab5;
+    }
+
+public:
+    explicit Hasher128(uint64_t seed = 0) : h1_(seed), h2_(seed) {}
+
+    Hasher128& update(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total_ += size;
+        if (tail_len_ > 0) {
+            size_t take = std::min(size, sizeof(tail_) - tail_len_);
+            std::memcpy(tail_ + tail_len_, p, take);
+            tail_len_ += take;
+            p += take;
+            size -= take;
+            if (tail_len_ < sizeof(tail_)) {
+                return *this;
+            }
+            block(tail_);
+            tail_len_ = 0;
+        }
+        for (; size >= 16; p += 16, size -= 16) {
+            block(p);
+        }
+        std::memcpy(tail_, p, size);
+        tail_len_ = size;
+        return *this;
+    }
+
+    Hasher128& update(std::string_view s) { return update(s.data(), s.size()); }
+
+    // Hashes a field followed by a separator, so ("ab","c") and ("a","bc") differ
+    Hasher128& field(std::string_view s) {
+        update(s.data(), s.size());
+        const uint8_t sep = 0;
+        return update(&sep, 1);
+    }
+
+    Hash128 finish() const {
+        uint64_t h1 = h1_, h2 = h2_;
+        uint64_t k1 = 0, k2 = 0;
+        for (size_t i = tail_len_; i > 8; --i) k2 = (k2 << 8) | tail_[i - 1];
+        for (size_t i = std::min<size_t>(tail_len_, 8); i > 0; --i) k1 = (k1 << 8) | tail_[i - 1];
+        if (tail_len_ > 8) {
+            k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+        }
+        if (tail_len_ > 0) {
+            k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+        }
+        h1 ^= total_;
+        h2 ^= total_;
+        h1 += h2;
+        h2 += h1;
+        h1 = fmix(h1);
+        h2 = fmix(h2);
+        h1 += h2;
+        h2 += h1;
+        return Hash128{h1, h2};
+    }
+};
+
+inline Hash128 hash128(const void* data, size_t size, uint64_t seed = 0) {
+    return Hasher128(seed).update(data, size).finish();
+}
+
+} // namespace utils
+
+namespace std {
+template <>
+struct hash<utils::Hash128> {
+    size_t operator()(const utils::Hash128& h) const noexcept {
+        return static_cast<size_t>(h.lo ^ (h.hi * 0x9e3779b97f4a7c15ULL));
+    }
+};
+} // namespace std
+
+#endif // HASH_HPP
@@ -0,0 +1,267 @@
+#include "warmup.hpp"
+#include "cache.hpp"
+#include "cache_key.hpp"
+#include "config.hpp"
+#include "handler.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "request.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+metrics::Counter urls_stored("proxy_warmup_urls_total", "Warm-up URLs by outcome", "result=\"stored\"");
+metrics::Counter urls_cached("proxy_warmup_urls_total", "Warm-up URLs by outcome", "result=\"cached\"");
+metrics::Counter urls_not_stored("proxy_warmup_urls_total", "Warm-up URLs by outcome", "result=\"not_stored\"");
+std::atomic<double> recovered_after{0};
+metrics::Callback recovery("proxy_warmup_recovery_seconds",
+                           "Seconds from startup until the hit ratio recovered, 0 until it has", "gauge",
+                           [] { return recovered_after.load(std::memory_order_relaxed); });
+
+struct Source {
+    std::vector<std::string> urls;  // Most requested first
+    double hit_ratio = -1;          // Seen in the log before the restart; -1 if unknown
+};
+
+// The target of a logged GET request line, or the line itself when it is a URL
+bool extract_url(const std::string& line, std::string& url) {
+    size_t get = line.find("\"GET http://");
+    if (get != std::string::npos) {
+        size_t start = get + 5;
+        size_t end = line.find(' ', start);
+        if (end == std::string::npos) return false;
+        url = line.substr(start, end - start);
+        return true;
+    }
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 7, "http://") != 0) {
+        return false;
+    }
+    size_t end = line.find_first_of(" \t\r", start);
+    url = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return true;
+}
+
+/**
+ * Reads the last tail bytes of path and ranks the URLs in it
+ */
+bool load(const std::string& path, long tail, size_t top, Source& source) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    std::string line;
+    if (size > tail) {
+        file.seekg(size - tail);
+        std::getline(file, line);  // Partial line
+    } else {
+        file.seekg(0);
+    }
+
+    std::unordered_map<std::string, size_t> counts;
+    size_t hits = 0, lookups = 0;
+    std::string url;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 7, "warmup-") == 0) {
+            continue;  // An earlier warm-up's own fetches are not demand
+        }
+        if (extract_url(line, url)) {
+            ++counts[url];
+        } else if (line.find(": in cache, valid") != std::string::npos) {
+            ++hits;
+            ++lookups;
+        } else if (line.find(": not in cache") != std::string::npos ||
+                   line.find(": in cache, but expired") != std::string::npos) {
+            ++lookups;
+        }
+    }
+
+    std::vector<std::pair<std::string, size_t>> ranked(counts.begin(), counts.end());
+    size_t keep = std::min(top, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    for (size_t i = 0; i < keep; ++i) {
+        source.urls.push_back(std::move(ranked[i].first));
+    }
+    if (lookups > 0) {
+        source.hit_ratio = static_cast<double>(hits) / lookups;
+    }
+    return true;
+}
+
+/**
+ * Spaces out requests to each origin to at most rate per second
+ */
+class OriginPacer {
+public:
+    explicit OriginPacer(double rate)
+        : interval_(rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))
+                             : Clock::duration::zero()) {}
+
+    void wait(const std::string& origin) {
+        if (interval_ == Clock::duration::zero()) {
+            return;
+        }
+        Clock::time_point slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Clock::time_point& next = next_[origin];
+            slot = std::max(Clock::now(), next);
+            next = slot + interval_;
+        }
+        std::this_thread::sleep_until(slot);
+    }
+
+private:
+    Clock::duration interval_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Clock::time_point> next_;
+};
+
+enum class Outcome { Stored, Cached, NotStored };
+
+Outcome fetch(const std::string& url, const std::string& accept_encoding, OriginPacer& pacer, const std::string& id) {
+    size_t host_start = url.find("://") + 3;
+    std::string host = url.substr(host_start, url.find('/', host_start) - host_start);
+    std::string raw = "GET " + url + " HTTP/1.1\r\nHost: " + host + "\r\nAccept: */*\r\n";
+    if (!accept_encoding.empty()) {
+        raw += "Accept-Encoding: " + accept_encoding + "\r\n";
+    }
+    raw += "Connection: close\r\n\r\n";
+
+    Request request(raw);
+    try {
+        request.parse();
+    } catch (const InvalidRequest&) {
+        return Outcome::NotStored;
+    }
+    CacheKey primary = CacheKeyBuilder::primary(request);
+    if (proxy_cache->isValid(CacheKeyBuilder::variant(primary, proxy_cache->getVary(primary), request))) {
+        return Outcome::Cached;
+    }
+    pacer.wait(host);
+    Handler::prefetch(request, id);
+    // The response may have introduced a Vary record, so derive the key again
+    return proxy_cache->isValid(CacheKeyBuilder::variant(primary, proxy_cache->getVary(primary), request))
+               ? Outcome::Stored
+               : Outcome::NotStored;
+}
+
+void run(Source source) {
+    const size_t concurrency = static_cast<size_t>(std::max(1L, Config::get_long("PROXY_WARMUP_CONCURRENCY", 4)));
+    const std::string accept_encoding = Config::get_string("PROXY_WARMUP_ACCEPT_ENCODING", "gzip, deflate, br");
+    OriginPacer pacer(Config::get_double("PROXY_WARMUP_ORIGIN_RATE", 10));
+    const size_t total = source.urls.size();
+    const size_t report_every = std::max<size_t>(1, total / 10);
+    Clock::time_point start = Clock::now();
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0}, stored{0}, cached{0};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < std::min(concurrency, total); ++w) {
+        workers.emplace_back([&] {
+            size_t i;
+            while ((i = next.fetch_add(1)) < total) {
+                Outcome outcome = fetch(source.urls[i], accept_encoding, pacer, "warmup-" + std::to_string(i + 1));
+                if (outcome == Outcome::Stored) {
+                    ++stored;
+                    urls_stored.inc();
+                } else if (outcome == Outcome::Cached) {
+                    ++cached;
+                    urls_cached.inc();
+                } else {
+                    urls_not_stored.inc();
+                }
+                size_t finished = ++done;
+                if (finished % report_every == 0 || finished == total) {
+                    LOG_NOTE("(warmup)", std::to_string(finished) + "/" + std::to_string(total) + " URLs, " +
+                             std::to_string(stored.load()) + " stored, " + std::to_string(cached.load()) +
+                             " already cached");
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    LOG_NOTE("(warmup)", "finished in " + std::to_string(seconds) + " s: " + std::to_string(stored.load()) +
+             " of " + std::to_string(total) + " URLs stored");
+}
+
+/**
+ * Watches the live hit ratio over a sliding window until it reaches target
+ */
+void watch_recovery(double target, Clock::time_point started) {
+    const auto WINDOW = std::chrono::seconds(10);
+    const int64_t MIN_LOOKUPS = 20;  // Fewer make the ratio noise
+    struct Sample {
+        Clock::time_point at;
+        int64_t hits;
+        int64_t lookups;
+    };
+    std::vector<Sample> samples;
+    while (Clock::now() - started < std::chrono::hours(1)) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        int64_t hits = metrics::cache_hits.value();
+        int64_t lookups = hits + metrics::cache_misses.value() + metrics::cache_stale.value();
+        Clock::time_point now = Clock::now();
+        samples.push_back({now, hits, lookups});
+        while (samples.size() > 1 && now - samples.front().at > WINDOW) {
+            samples.erase(samples.begin());
+        }
+        int64_t window_lookups = lookups - samples.front().lookups;
+        if (window_lookups >= MIN_LOOKUPS &&
+            static_cast<double>(hits - samples.front().hits) / window_lookups >= target) {
+            double seconds = std::chrono::duration<double>(now - started).count();
+            recovered_after.store(seconds, std::memory_order_relaxed);
+            LOG_NOTE("(warmup)", "hit ratio recovered to " + std::to_string(target) + " after " +
+                     std::to_string(seconds) + " s");
+            return;
+        }
+    }
+    LOG_WARNING("(warmup)", "hit ratio did not recover to " + std::to_string(target) + " within an hour");
+}
+
+} // namespace
+
+namespace warmup {
+
+void start() {
+    std::string path = Config::get_string("PROXY_WARMUP_FROM", "");
+    if (path.empty() || !proxy_cache) {
+        return;
+    }
+    Clock::time_point started = Clock::now();
+    Source source;
+    long tail = Config::get_long("PROXY_WARMUP_TAIL", 64L << 20);
+    size_t top = static_cast<size_t>(std::max(0L, Config::get_long("PROXY_WARMUP_TOP", 1000)));
+    if (!load(path, tail, top, source)) {
+        LOG_ERROR("(warmup)", "Failed to read " + path);
+        return;
+    }
+    LOG_NOTE("(warmup)", "prefetching the " + std::to_string(source.urls.size()) + " most requested URLs from " + path);
+
+    double target = Config::get_double("PROXY_WARMUP_TARGET", source.hit_ratio > 0 ? 0.9 * source.hit_ratio : 0);
+    if (target > 0) {
+        std::thread(watch_recovery, target, started).detach();
+    }
+    if (!source.urls.empty()) {
+        std::thread(run, std::move(source)).detach();
+    }
+}
+
+} // namespace warmup
@@ -0,0 +1,30 @@
+#ifndef WARMUP_HPP
+#define WARMUP_HPP
+
+/**
+ * Cache warm-up at startup
+ *
+ * Reads PROXY_WARMUP_FROM. That is either a URL list, one absolute http://
+ * URL per line, or a proxy log, of which the last PROXY_WARMUP_TAIL bytes
+ * are scanned for GET request lines. The URLs are ranked by how often they
+ * appear, and the top PROXY_WARMUP_TOP are fetched into the cache in the
+ * background while the proxy serves clients. At most
+ * PROXY_WARMUP_CONCURRENCY fetches run at once, and each origin gets at
+ * most PROXY_WARMUP_ORIGIN_RATE of them per second.
+ *
+ * Progress is logged as it goes. The live hit ratio is then watched until
+ * it recovers to PROXY_WARMUP_TARGET, or by default to 90% of the ratio the
+ * log shows from before the restart, and the time that took is logged and
+ * published as proxy_warmup_recovery_seconds.
+ */
+namespace warmup {
+
+/**
+ * Loads the URL list and starts fetching; returns at once, and does
+ * nothing when PROXY_WARMUP_FROM is unset
+ */
+void start();
+
+} // namespace warmup
+
+#endif // WARMUP_HPP